@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/// \brief 定长整数/浮点数的字节序读写
+///        memcpy由编译器优化为单条load/store指令
+
+namespace rokid {
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+inline uint32_t toLittleEndian(uint32_t v) { return __builtin_bswap32(v); }
+inline uint64_t toLittleEndian(uint64_t v) { return __builtin_bswap64(v); }
+inline uint32_t toBigEndian(uint32_t v) { return v; }
+#else
+inline uint32_t toLittleEndian(uint32_t v) { return v; }
+inline uint64_t toLittleEndian(uint64_t v) { return v; }
+inline uint32_t toBigEndian(uint32_t v) { return __builtin_bswap32(v); }
+#endif
+
+inline void leWriteUint32(uint32_t v, uint8_t* out) {
+  v = toLittleEndian(v);
+  memcpy(out, &v, sizeof(v));
+}
+
+inline void leWriteUint64(uint64_t v, uint8_t* out) {
+  v = toLittleEndian(v);
+  memcpy(out, &v, sizeof(v));
+}
+
+inline void leWriteFloat(float v, uint8_t* out) {
+  uint32_t n;
+  memcpy(&n, &v, sizeof(n));
+  leWriteUint32(n, out);
+}
+
+inline void leWriteDouble(double v, uint8_t* out) {
+  uint64_t n;
+  memcpy(&n, &v, sizeof(n));
+  leWriteUint64(n, out);
+}
+
+inline void beWriteUint32(uint32_t v, uint8_t* out) {
+  v = toBigEndian(v);
+  memcpy(out, &v, sizeof(v));
+}
+
+inline uint32_t leReadUint32(const uint8_t* in) {
+  uint32_t v;
+  memcpy(&v, in, sizeof(v));
+  return toLittleEndian(v);
+}
+
+inline uint64_t leReadUint64(const uint8_t* in) {
+  uint64_t v;
+  memcpy(&v, in, sizeof(v));
+  return toLittleEndian(v);
+}
+
+inline float leReadFloat(const uint8_t* in) {
+  uint32_t n = leReadUint32(in);
+  float v;
+  memcpy(&v, &n, sizeof(v));
+  return v;
+}
+
+inline double leReadDouble(const uint8_t* in) {
+  uint64_t n = leReadUint64(in);
+  double v;
+  memcpy(&v, &n, sizeof(v));
+  return v;
+}
+
+inline uint32_t beReadUint32(const uint8_t* in) {
+  uint32_t v;
+  memcpy(&v, in, sizeof(v));
+  return toBigEndian(v);
+}
+
+} // namespace rokid
@@ -4,6 +4,15 @@
 
 #define CAPS_VERSION 5
 
+/// \brief 序列化选项, 与CAPS_VERSION一起存放于header版本字节
+/// 数据末尾附加4字节CRC32C校验(little endian), 校验范围为此前所有数据
+/// 只作用于顶层Caps, 嵌套Caps不单独校验
+#define CAPS_FLAG_CRC32C 0x80
+/// \brief 整数成员及字符串/二进制数据长度以定长little endian写入
+/// (int32/uint32 4字节, int64/uint64 8字节), 编解码无分支, 数据变大
+/// 嵌套Caps继承此选项
+#define CAPS_FLAG_FIXED_INT 0x40
+
 #define CAPS_MEMBER_TYPE_INT32 'i'
 #define CAPS_MEMBER_TYPE_UINT32 'u'
 #define CAPS_MEMBER_TYPE_INT64 'l'
@@ -14,9 +23,40 @@
 #define CAPS_MEMBER_TYPE_BINARY 'B'
 #define CAPS_MEMBER_TYPE_OBJECT 'O'
 #define CAPS_MEMBER_TYPE_VOID 'V'
+// 投影解析(Caps::Projection)时未选择的成员, 不可序列化
+#define CAPS_MEMBER_TYPE_ABSENT 'A'
+// 投影解析可选择的最大成员下标, 选择表按下标连续存放
+#define CAPS_PROJECTION_MAX_INDEX 65535
+
+#define CAPS_SUCCESS 0
+#define CAPS_ERR_INVALID_PARAM -1
+#define CAPS_ERR_OUT_OF_RANGE -2
+#define CAPS_ERR_TYPE_MISMATCH -3
+// 输入数据格式错误
+#define CAPS_ERR_CORRUPTED -4
+// 输入数据caps版本不符
+#define CAPS_ERR_VERSION -5
+// 输入数据不完整
+#define CAPS_ERR_TRUNCATED -6
+// 输入数据中整数编码超长
+#define CAPS_ERR_OVERFLOW -7
+// 输出buffer长度不足
+#define CAPS_ERR_INSUFFICIENT_BUFFER -8
+// 输入数据嵌套层数超出限制
+#define CAPS_ERR_TOO_DEEP -9
+// 输入数据CRC32C校验失败
+#define CAPS_ERR_CHECKSUM -10
+
+// parse默认允许的最大嵌套层数
+#ifndef CAPS_PARSE_MAX_DEPTH
+#define CAPS_PARSE_MAX_DEPTH 512
+#endif
 
 #ifdef __cplusplus
+#include <assert.h>
+#include <atomic>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <initializer_list>
@@ -25,9 +65,16 @@ namespace rokid {
 
 class Member;
 typedef std::shared_ptr<Member> MemberPointer;
+class FrozenCaps;
+class JsonOutput;
+class JsonParser;
+class CapsBatch;
+class CapsDiff;
 
 class Caps {
 private:
+  struct SerializeCache;
+
   /// \brief Caps中成员变量数据封装类
   class Value {
   public:
@@ -70,6 +117,8 @@ private:
 
     inline bool isVoid() const { return type() == CAPS_MEMBER_TYPE_VOID; }
 
+    inline bool isAbsent() const { return type() == CAPS_MEMBER_TYPE_ABSENT; }
+
   private:
     Value(MemberPointer m);
 
@@ -95,10 +144,42 @@ public:
   /// \brief 序列化
   /// \param out 序列化结果输出buffer
   /// \param size buffer size
+  /// \param flags 序列化选项 (CAPS_FLAG_CRC32C, CAPS_FLAG_FIXED_INT)
   /// \throws invalid_argument
   /// \throws out_of_range
   /// \return count of output bytes
-  uint32_t serialize(void* out, uint32_t size) const;
+  uint32_t serialize(void* out, uint32_t size, uint32_t flags = 0) const;
+
+  /// \brief 序列化，不抛出异常，不格式化错误信息
+  /// \param out 序列化结果输出buffer
+  /// \param size buffer size
+  /// \param result 成功时输出序列化结果长度，失败时输出出错位置
+  /// \param flags 序列化选项 (CAPS_FLAG_CRC32C, CAPS_FLAG_FIXED_INT)
+  /// \return CAPS_SUCCESS
+  ///         CAPS_ERR_INVALID_PARAM out为nullptr或flags不正确
+  ///         CAPS_ERR_INSUFFICIENT_BUFFER buffer长度不足，
+  ///         所需长度可通过binarySize()获取
+  ///         CAPS_ERR_CORRUPTED Caps中存在未知类型成员
+  int32_t trySerialize(void* out, uint32_t size, uint32_t& result,
+      uint32_t flags = 0) const noexcept;
+
+  /// \param flags 序列化选项, 与serialize一致
+  /// \return 序列化结果长度
+  uint32_t binarySize(uint32_t flags = 0) const;
+
+  /// \brief 设置序列化结果缓存，默认关闭
+  ///        开启后serialize缓存本Caps的序列化结果(不含CRC32C校验)，
+  ///        未修改时再次序列化(包括作为其他Caps的嵌套成员)只复制缓存数据
+  ///        write/parse/clear/赋值后缓存失效，复制Caps时共享缓存数据及设置
+  ///        只保留最近一次序列化使用的CAPS_FLAG_FIXED_INT选项的结果
+  /// \param maxSize 序列化结果不超过maxSize字节时缓存，0关闭缓存并释放缓存数据
+  void setSerializeCache(uint32_t maxSize);
+
+  /// \brief 设置parse允许的最大嵌套层数(含本Caps)，默认CAPS_PARSE_MAX_DEPTH
+  ///        超出时parse失败，返回CAPS_ERR_TOO_DEEP
+  ///        解析使用堆上的显式栈，不受线程栈大小限制
+  /// \param depth 最大嵌套层数，1为不允许嵌套Caps
+  void setParseMaxDepth(uint32_t depth);
 
   /// \brief 写入void类型
   void write();
@@ -152,17 +233,167 @@ public:
 
   /// \brief 从二进制数据反序列化生成Caps
   ///        Caps原来的数据将会被清除
+  ///        未被其它Caps或Value引用的原有成员, 若类型与新数据相同则被复用,
+  ///        重复解析相同结构的数据不再分配内存
   /// \param in 输入二进制数据指针
   /// \param size 输入的二进制数据大小
   /// \throws invalid_argument in == nullptr或size长度不正确
-  /// \throws domain_error 输入二进制数据不是Caps序列化生成的，格式错误
+  /// \throws domain_error 输入二进制数据不是Caps序列化生成的，格式错误或校验失败
   void parse(const void* in, uint32_t size);
 
+  /// \brief 从二进制数据反序列化生成Caps，不抛出异常，不格式化错误信息
+  ///        Caps原来的数据将会被清除，失败时Caps为空
+  ///        内存分配失败时仍可能抛出bad_alloc
+  /// \param in 输入二进制数据指针
+  /// \param size 输入的二进制数据大小
+  /// \param errOffset 不为nullptr时，失败时输出出错位置在'in'中的偏移
+  /// \return CAPS_SUCCESS
+  ///         CAPS_ERR_INVALID_PARAM in == nullptr或size长度不正确
+  ///         CAPS_ERR_VERSION caps版本不符
+  ///         CAPS_ERR_CHECKSUM CRC32C校验失败
+  ///         CAPS_ERR_CORRUPTED CAPS_ERR_TRUNCATED CAPS_ERR_OVERFLOW
+  ///         输入二进制数据格式错误
+  ///         CAPS_ERR_TOO_DEEP 嵌套层数超过setParseMaxDepth设置
+  int32_t tryParse(const void* in, uint32_t size, uint32_t* errOffset = nullptr);
+
+  /// \brief 投影解析时选择的成员
+  ///        未选择的成员按长度跳过，不复制数据，类型为CAPS_MEMBER_TYPE_ABSENT
+  class Projection {
+  public:
+    Projection() = default;
+    /// \brief 选择多个成员，参考add(const char*)
+    Projection(std::initializer_list<const char*> paths);
+
+    /// \brief 选择第index个成员(完整解析)
+    /// \throws invalid_argument index大于CAPS_PROJECTION_MAX_INDEX
+    Projection& add(uint32_t index);
+
+    /// \brief 按路径选择成员，以'.'分隔各层下标
+    ///        例如"3.0.2"选择第3个成员(嵌套Caps)中第0个成员(嵌套Caps)的第2个成员，
+    ///        路径上的其它成员为CAPS_MEMBER_TYPE_ABSENT
+    ///        路径指向的非Caps成员被完整解析
+    /// \throws invalid_argument 路径格式错误，或下标大于CAPS_PROJECTION_MAX_INDEX
+    Projection& add(const char* path);
+
+  private:
+    Projection& add(uint32_t index, const char* sub);
+
+    // 扩展选择表以容纳index
+    void reserve(uint32_t index);
+
+  private:
+    // 0: 未选择  1: 完整解析  2: 嵌套Caps按children[i]解析
+    std::vector<uint8_t> selected;
+    std::vector<std::shared_ptr<Projection> > children;
+
+    friend class Caps;
+  };
+
+  /// \brief 只解析proj选择的成员，其它成员为CAPS_MEMBER_TYPE_ABSENT
+  ///        最后一个选择的成员之后的数据不做检查
+  /// \throws 与parse(const void*, uint32_t)相同
+  void parse(const void* in, uint32_t size, const Projection& proj);
+
+  /// \brief 只解析proj选择的成员，不抛出异常
+  /// \return 与tryParse(const void*, uint32_t, uint32_t*)相同
+  int32_t tryParse(const void* in, uint32_t size, const Projection& proj,
+      uint32_t* errOffset = nullptr);
+
+  /// \brief 借用解析，字符串/二进制成员不复制数据，直接引用输入数据
+  ///        成员持有owner，所有引用输入数据的成员销毁后owner才被释放
+  ///        Caps的所有接口不变: tryGet(uint32_t, const void*&, uint32_t&)
+  ///        与tryGet(uint32_t, const char*&, uint32_t&)返回输入数据中的指针，
+  ///        返回const std::string&的接口在首次访问该成员时复制一次数据
+  ///        输入数据在owner释放前不能被修改
+  ///        适合数据量大的字符串/二进制成员，省去接收后的复制
+  /// \param in 输入二进制数据指针，须位于owner持有的内存中
+  /// \param size 输入的二进制数据大小
+  /// \param owner 持有输入数据的对象，例如
+  ///        shared_ptr<const void>(buf, buf->data())
+  /// \throws invalid_argument owner为nullptr，其它同parse(const void*, uint32_t)
+  /// \throws domain_error 同parse(const void*, uint32_t)
+  void parseBorrowed(const void* in, uint32_t size,
+      std::shared_ptr<const void> owner);
+
+  /// \brief 借用解析，不抛出异常，参考parseBorrowed
+  /// \return 同tryParse(const void*, uint32_t, uint32_t*)，
+  ///         owner为nullptr时返回CAPS_ERR_INVALID_PARAM
+  int32_t tryParseBorrowed(const void* in, uint32_t size,
+      std::shared_ptr<const void> owner, uint32_t* errOffset = nullptr);
+
+  /// \brief 从JSON字符串生成Caps
+  ///        Caps原来的数据将会被清除
+  ///        顶层JSON数组的元素依次成为Caps成员，嵌套数组成为嵌套Caps
+  ///        JSON对象成为依次存放key, value的Caps
+  ///        整数写入可容纳其值的最小类型(int32, uint32, int64, uint64)，
+  ///        其它数字写入double，true/false写入bool，null写入void
+  /// \param json JSON字符串
+  /// \param size JSON字符串长度
+  /// \throws invalid_argument json == nullptr
+  /// \throws domain_error JSON格式错误
+  void parseJson(const char* json, uint32_t size);
+
+  /// \brief 从JSON字符串生成Caps，不抛出异常
+  ///        失败时Caps为空
+  /// \param errOffset 不为nullptr时，失败时输出出错位置在'json'中的偏移
+  /// \return CAPS_SUCCESS
+  ///         CAPS_ERR_INVALID_PARAM json == nullptr
+  ///         CAPS_ERR_CORRUPTED CAPS_ERR_TRUNCATED JSON格式错误
+  ///         CAPS_ERR_TOO_DEEP 嵌套层数超出限制
+  int32_t tryParseJson(const char* json, uint32_t size, uint32_t* errOffset = nullptr);
+
   /// \brief 按下标访问Caps内数据成员
   Value at(uint32_t i) const;
   /// \brief 按下标访问Caps内数据成员
   inline Value operator[](uint32_t i) const { return at(i); }
 
+  /// \brief 按下标读取Caps内数据成员，不抛出异常，不分配内存
+  /// \return CAPS_SUCCESS
+  ///         CAPS_ERR_OUT_OF_RANGE 下标越界
+  ///         CAPS_ERR_TYPE_MISMATCH 成员数据类型与v不符，v不被修改
+  int32_t tryGet(uint32_t i, bool& v) const noexcept;
+  int32_t tryGet(uint32_t i, int8_t& v) const noexcept;
+  int32_t tryGet(uint32_t i, uint8_t& v) const noexcept;
+  int32_t tryGet(uint32_t i, int16_t& v) const noexcept;
+  int32_t tryGet(uint32_t i, uint16_t& v) const noexcept;
+  int32_t tryGet(uint32_t i, int32_t& v) const noexcept;
+  int32_t tryGet(uint32_t i, uint32_t& v) const noexcept;
+  int32_t tryGet(uint32_t i, int64_t& v) const noexcept;
+  int32_t tryGet(uint32_t i, uint64_t& v) const noexcept;
+  int32_t tryGet(uint32_t i, float& v) const noexcept;
+  int32_t tryGet(uint32_t i, double& v) const noexcept;
+  /// \param v 输出Caps内部字符串指针，Caps被修改或销毁后失效
+  ///        借用解析(parseBorrowed)的成员首次访问时复制数据，分配内存，
+  ///        因此可能抛出bad_alloc，不分配内存的读取使用
+  ///        tryGet(uint32_t, const char*&, uint32_t&)
+  int32_t tryGet(uint32_t i, const std::string*& v) const;
+  /// \brief 读取字符串成员，不复制数据，不抛出异常
+  /// \param v 输出字符串数据指针，不以'\0'结尾，Caps被修改或销毁后失效
+  /// \param length 输出字符串长度
+  int32_t tryGet(uint32_t i, const char*& v, uint32_t& length) const noexcept;
+  /// \param data 输出Caps内部二进制数据指针，Caps被修改或销毁后失效
+  /// \param size 输出二进制数据长度
+  int32_t tryGet(uint32_t i, const void*& data, uint32_t& size) const noexcept;
+  /// \param v 输出Caps内部对象指针，Caps被修改或销毁后失效
+  int32_t tryGet(uint32_t i, const Caps*& v) const noexcept;
+
+  /// \brief 按下标读取Caps内数据成员，不抛出异常，不分配内存
+  /// \return 下标越界或成员数据类型不符时返回def
+  template <typename T>
+  inline T getOr(uint32_t i, T def) const noexcept {
+    T v;
+    return tryGet(i, v) == CAPS_SUCCESS ? v : def;
+  }
+  /// \brief 字符串成员同tryGet(uint32_t, const std::string*&)，
+  ///        借用解析的成员首次访问时分配内存，可能抛出bad_alloc
+  const char* getOr(uint32_t i, const char* def) const;
+  /// \brief 返回成员或def的引用，不复制
+  ///        def为临时对象时返回的引用随即失效，因此不接受右值
+  const std::string& getOr(uint32_t i, const std::string& def) const;
+  const std::string& getOr(uint32_t i, std::string&& def) const = delete;
+  const Caps& getOr(uint32_t i, const Caps& def) const noexcept;
+  const Caps& getOr(uint32_t i, Caps&& def) const = delete;
+
   class type_error : public std::runtime_error {
   public:
     explicit type_error(const std::string& msg) : std::runtime_error(msg) {}
@@ -200,20 +431,192 @@ public:
   /// \return 迭代器
   iterator iterate(uint32_t idx = 0) const;
 
+  /// \brief Caps内数据成员的轻量引用
+  ///        不持有成员数据，Caps被修改或销毁后失效
+  class MemberRef {
+  public:
+    /// \return 数据类型 (CAPS_MEMBER_TYPE_INT32 etc.)
+    char type() const;
+
+    inline bool isVoid() const { return type() == CAPS_MEMBER_TYPE_VOID; }
+
+    inline bool isAbsent() const { return type() == CAPS_MEMBER_TYPE_ABSENT; }
+
+    /// \brief 读取成员数据到v
+    /// \throws type_error 成员数据类型与v不符
+    void read(bool& v) const;
+    void read(int8_t& v) const;
+    void read(uint8_t& v) const;
+    void read(int16_t& v) const;
+    void read(uint16_t& v) const;
+    void read(int32_t& v) const;
+    void read(uint32_t& v) const;
+    void read(int64_t& v) const;
+    void read(uint64_t& v) const;
+    void read(float& v) const;
+    void read(double& v) const;
+    void read(std::string& v) const;
+    void read(std::vector<char>& v) const;
+    void read(Caps& v) const;
+
+    template <typename T>
+    inline T read() const {
+      T v;
+      read(v);
+      return v;
+    }
+
+  private:
+    explicit MemberRef(const Member* m) : member{m} {}
+
+    const Member* member;
+
+    friend class Caps;
+  };
+
+  /// \brief Caps内数据成员的轻量迭代器，支持range-for
+  ///        迭代过程没有引用计数操作
+  ///        Caps被修改或销毁后迭代器失效，由assert检查，
+  ///        是否检查取决于使用方编译时是否定义NDEBUG，迭代器布局与NDEBUG无关
+  class const_iterator {
+  public:
+    inline MemberRef operator*() const {
+      check();
+      return MemberRef(cur->get());
+    }
+
+    inline const_iterator& operator++() {
+      ++cur;
+      return *this;
+    }
+
+    inline bool operator == (const const_iterator& o) const {
+      return cur == o.cur;
+    }
+
+    inline bool operator != (const const_iterator& o) const {
+      return cur != o.cur;
+    }
+
+    /// \brief 读取当前成员数据到v，并移动到下一个成员
+    /// \throws type_error 成员数据类型与v不符
+    template <typename T>
+    inline const_iterator& read(T& v) {
+      check();
+      MemberRef(cur->get()).read(v);
+      ++cur;
+      return *this;
+    }
+
+    template <typename T>
+    inline const_iterator& operator >> (T& v) { return read(v); }
+
+  private:
+    inline void check() const {
+#ifndef NDEBUG
+      assert(!aliveIndicator.expired());
+      assert(cur < last);
+#endif
+    }
+
+    const MemberPointer* cur;
+    // 无论是否定义NDEBUG都保留, libcaps与使用方的NDEBUG设置可能不同
+    const MemberPointer* last;
+    std::weak_ptr<int32_t> aliveIndicator;
+
+    friend class Caps;
+  };
+  const_iterator begin() const;
+  const_iterator end() const;
+
   bool empty() const;
 
   /// \return Caps内数据成员数量
   uint32_t size() const;
 
+  /// \brief 深度比较成员类型及数据
+  ///        浮点数按位比较(NaN与相同位模式的NaN相等, 0.0与-0.0不等)
+  bool operator == (const Caps& o) const;
+  inline bool operator != (const Caps& o) const { return !(*this == o); }
+
+  /// \brief 内容哈希(wyhash)，直接遍历成员，不序列化
+  ///        相等(operator ==)的Caps哈希相同，与序列化选项无关
+  ///        结果按seed缓存于Caps，修改后失效；嵌套Caps各自缓存，
+  ///        再次计算时未修改的嵌套Caps不重新遍历
+  /// \param seed 哈希种子
+  uint64_t hash(uint64_t seed = 0) const;
+
+  /// \brief 不反序列化，由serialize生成的二进制数据直接计算哈希
+  ///        结果与parse后调用hash(seed)相同
+  /// \throws 同parse
+  static uint64_t hashBinary(const void* in, uint32_t size, uint64_t seed = 0);
+
+  /// \brief 同hashBinary，失败时返回错误码，不抛出异常
+  /// \param result 成功时输出哈希
+  /// \param errOffset 不为nullptr时，失败时输出出错位置在'in'中的偏移
+  /// \return 同tryParse
+  static int32_t tryHashBinary(const void* in, uint32_t size, uint64_t& result,
+      uint64_t seed = 0, uint32_t* errOffset = nullptr);
+
   /// \brief 生成Caps内部数据可视字符串
   /// \param out 输出缓冲区
   /// \param size 缓冲区大小
   /// \return 字符串长度
   uint32_t dump(char* out, uint32_t size) const;
 
+  /// \brief 不反序列化，直接生成Caps二进制数据的可视字符串，格式与dump相同
+  /// \param in serialize生成的二进制数据
+  /// \param size 二进制数据长度
+  /// \param out 输出缓冲区
+  /// \param outSize 缓冲区大小
+  /// \throws out_of_range 输出缓冲区不足
+  /// \throws domain_error 输入数据格式错误
+  /// \return 字符串长度
+  static uint32_t dumpBinary(const void* in, uint32_t size, char* out,
+      uint32_t outSize);
+
+  /// \brief 生成JSON字符串，追加到out
+  ///        Caps输出为JSON数组，嵌套Caps输出为嵌套数组
+  ///        void输出为null，二进制数据输出为base64编码字符串
+  ///        浮点数输出为可精确还原的最短十进制表示，nan/inf输出为null
+  void toJson(std::string& out) const;
+
+  /// \brief 生成单行紧凑格式可视字符串，追加到out
+  ///        与JSON格式相同，但保留成员类型:
+  ///        uint32/int64/uint64/float分别带'u'/'l'/'ul'/'f'后缀，
+  ///        二进制数据为b"<base64>"，void为void
+  void toText(std::string& out) const;
+
+  /// \brief 生成由from变为to的补丁，用于增量同步
+  ///        逐个比较相同下标的成员，递归比较嵌套Caps，只记录不同的成员，
+  ///        from多出的成员被删除，to多出的成员被追加
+  ///        补丁本身是Caps，可直接序列化传输:
+  ///        第0个成员为uint32，to的成员数量
+  ///        其后每两个成员为一项修改: uint32 (下标 << 1 | nested)及新值，
+  ///        nested为1时新值是对嵌套Caps的补丁，否则为替换的成员，下标递增
+  ///        补丁与from/to共享成员数据，不复制
+  /// \return 补丁，from与to相等时只有第0个成员
+  static Caps diff(const Caps& from, const Caps& to);
+
+  /// \brief 将diff生成的补丁应用到本Caps，本Caps须与diff的from相同
+  ///        只替换修改的成员，未修改的成员及嵌套Caps不复制；
+  ///        被其他Caps共享的嵌套Caps复制后修改，不影响其他Caps
+  /// \throws domain_error 补丁格式错误或与本Caps不匹配，本Caps不被修改
+  void apply(const Caps& patch);
+
+  /// \brief 应用补丁，不抛出异常
+  /// \return CAPS_SUCCESS
+  ///         CAPS_ERR_CORRUPTED 补丁格式错误或与本Caps不匹配，本Caps不被修改
+  int32_t tryApply(const Caps& patch);
+
   /// \brief 清除Caps内部数据
   void clear();
 
+  /// \brief 生成Caps的不可变快照
+  ///        快照深度复制所有数据，之后对Caps的修改不影响快照
+  /// \return 快照对象，可被多个线程并发读取
+  FrozenCaps freeze() const;
+
   /// \brief 获取Caps二进制数据长度
   ///        例如serialize后的数据通过网络传输
   ///        接收端需要此函数来获取完整的一个Caps二进制数据长度
@@ -223,29 +626,180 @@ public:
   /// throws out_of_range 输入参数'in'的长度不足
   static uint32_t getBinarySize(const void* in, uint32_t size);
 
+  /// \brief 直接修改serialize生成的二进制数据中第i个成员的值，不重新序列化
+  ///        成员类型须与v一致，只支持顶层成员
+  ///        float/double总能修改；整数新值的编码长度不超过原编码长度时
+  ///        以填充字节写入，CAPS_FLAG_FIXED_INT格式的整数总能修改
+  ///        带有CRC32C校验的数据增量更新校验值，原数据损坏时更新后仍校验失败
+  /// \param data serialize生成的二进制数据
+  /// \param size 二进制数据长度
+  /// \param i 成员下标
+  /// \return CAPS_SUCCESS
+  ///         CAPS_ERR_INVALID_PARAM data为nullptr或size长度不正确
+  ///         CAPS_ERR_OUT_OF_RANGE i超出成员数
+  ///         CAPS_ERR_TYPE_MISMATCH 成员类型与v不符
+  ///         CAPS_ERR_INSUFFICIENT_BUFFER 新值编码长度超过原编码长度，须重新序列化
+  ///         CAPS_ERR_VERSION CAPS_ERR_CORRUPTED CAPS_ERR_TRUNCATED
+  ///         CAPS_ERR_OVERFLOW 二进制数据格式错误
+  static int32_t tryPatch(void* data, uint32_t size, uint32_t i, int32_t v);
+  static int32_t tryPatch(void* data, uint32_t size, uint32_t i, uint32_t v);
+  static int32_t tryPatch(void* data, uint32_t size, uint32_t i, int64_t v);
+  static int32_t tryPatch(void* data, uint32_t size, uint32_t i, uint64_t v);
+  static int32_t tryPatch(void* data, uint32_t size, uint32_t i, float v);
+  static int32_t tryPatch(void* data, uint32_t size, uint32_t i, double v);
+
 private:
-  uint8_t* serializeMemberDesc(uint8_t* out, uint32_t size) const;
+  int32_t doSerialize(uint8_t* out, uint8_t*& p, const uint8_t* end,
+      uint32_t flags) const;
+
+  int32_t serializeMemberDesc(uint8_t*& p, const uint8_t* end) const;
 
-  uint8_t* serializeMembers(uint8_t* out, uint32_t size) const;
+  int32_t serializeMembers(uint8_t*& p, const uint8_t* end, uint32_t flags) const;
 
-  void serializeHeader(uint8_t* out, uint32_t size) const;
+  void serializeHeader(uint8_t* out, uint32_t size, uint32_t flags) const;
 
   void clearMembers();
 
-  const uint8_t* parseHeader(const uint8_t* p, uint32_t& totalSize);
+  // 成员修改后使缓存失效
+  void invalidateCache();
+
+  // 复制o的hash及序列化缓存
+  void copyCache(const Caps& o);
 
-  void parseMembers(const uint8_t* in, uint32_t psize,
-      const uint8_t* desc, uint32_t descLen);
+  // 与flags的CAPS_FLAG_FIXED_INT选项一致的序列化缓存, 没有时返回nullptr
+  std::shared_ptr<const std::string> cachedBinary(uint32_t flags) const;
+
+  void storeCachedBinary(const uint8_t* data, uint32_t size) const;
+
+  int32_t doTryParse(const void* in, uint32_t size, const Projection* proj,
+      const std::shared_ptr<const void>* owner, uint32_t* errOffset);
+
+  struct ParseFrame;
+
+  // 以显式栈逐层解析嵌套Caps, 不递归
+  // off: 成功时为已解析长度, 失败时为出错位置
+  // owner: 借用解析时持有in的对象, 否则为nullptr
+  int32_t doParse(const uint8_t* in, uint32_t size, uint32_t& off,
+      const Projection* proj, const std::shared_ptr<const void>* owner);
+
+  // 检查header并读取成员类型描述, 本Caps作为f的解析对象
+  int32_t beginParse(ParseFrame& f, const uint8_t* in, uint32_t size,
+      const Projection* proj);
 
   uint32_t dump(uint32_t indent, char* out, uint32_t size) const;
 
+  void toJson(JsonOutput& out, bool json) const;
+
 private:
   std::vector<MemberPointer> members;
   std::shared_ptr<int32_t> aliveIndicator;
+  // hash缓存, hashCheck为hashValue ^ seed
+  // 多个线程hash()同一(共享的嵌套)Caps时, 读到不一致的一对值只会导致重新计算
+  mutable std::atomic<bool> hashCached{false};
+  mutable std::atomic<uint64_t> hashValue{0};
+  mutable std::atomic<uint64_t> hashCheck{0};
+  // 序列化缓存, 内容相同的Caps副本共享, 以std::atomic_load/atomic_store访问
+  mutable std::shared_ptr<SerializeCache> serializeCache;
+  uint32_t serializeCacheLimit{0};
+  uint32_t parseMaxDepth{CAPS_PARSE_MAX_DEPTH};
+
+  friend class FrozenCaps;
+  friend class JsonParser;
+  friend class ParseStack;
+  friend class CapsBatch;
+  friend class CapsDiff;
+};
+
+/// \brief Caps的不可变快照，由Caps::freeze()生成
+///        所有读操作不修改任何共享状态，也没有引用计数操作，
+///        可被多个线程并发读取
+///        嵌套的Caps对象不持有数据，仅在根快照存活期间有效
+class FrozenCaps {
+private:
+  struct Slot;
+  struct Storage;
+
+public:
+  /// \brief FrozenCaps中成员变量数据封装类
+  class Value {
+  public:
+    operator bool() const;
+    operator int8_t() const;
+    operator uint8_t() const;
+    operator int16_t() const;
+    operator uint16_t() const;
+    operator int32_t() const;
+    operator uint32_t() const;
+    operator int64_t() const;
+    operator uint64_t() const;
+    operator float() const;
+    operator double() const;
+    operator const std::string&() const;
+    operator FrozenCaps() const;
+    void get(std::vector<char>& out) const;
+
+    /// \return 数据类型 (CAPS_MEMBER_TYPE_INT32 etc.)
+    char type() const;
+
+    inline bool isVoid() const { return type() == CAPS_MEMBER_TYPE_VOID; }
+
+    inline bool isAbsent() const { return type() == CAPS_MEMBER_TYPE_ABSENT; }
+
+  private:
+    Value(const Storage* s, const Slot* sl) : storage{s}, slot{sl} {}
+
+    const Slot* check(char type) const;
+
+    const Storage* storage;
+    const Slot* slot;
+
+    friend class FrozenCaps;
+  };
+
+  FrozenCaps();
+
+  /// \brief 按下标访问快照内数据成员
+  /// \throws out_of_range
+  Value at(uint32_t i) const;
+  /// \brief 按下标访问快照内数据成员
+  inline Value operator[](uint32_t i) const { return at(i); }
+
+  inline bool empty() const { return count == 0; }
+
+  /// \return 快照内数据成员数量
+  inline uint32_t size() const { return count; }
+
+private:
+  explicit FrozenCaps(const Caps& caps);
+
+  FrozenCaps(const Storage* s, uint32_t f, uint32_t c)
+    : storage{s}, first{f}, count{c} {}
+
+  static void build(Storage& storage, uint32_t first,
+      const std::vector<MemberPointer>& members);
+
+private:
+  std::shared_ptr<const Storage> owner;
+  const Storage* storage;
+  uint32_t first;
+  uint32_t count;
+
+  friend class Caps;
 };
 
 } // namespace rokid
 
+namespace std {
+
+template <>
+struct hash<rokid::Caps> {
+  size_t operator()(const rokid::Caps& caps) const {
+    return caps.hash();
+  }
+};
+
+} // namespace std
+
 extern "C" {
 #endif // __cplusplus
 
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "caps.h"
+
+/// \brief CapsBatch序列化数据header中的版本字节, 与Caps数据区分
+#define CAPS_BATCH_VERSION 0x15
+
+namespace rokid {
+
+/// \brief 同结构记录(成员数及各成员类型相同的Caps)的列式批量容器
+///        成员类型描述只存放一次，各列数据连续存放:
+///        数值列为定长数组，可直接读取整列；整数列序列化时
+///        按列选择定长或差分(zigzag + uleb128)编码
+///        序列化格式: 4字节长度(big endian) + CAPS_BATCH_VERSION
+///        + 行数(uleb128) + 列数(uleb128) + 每列类型(1字节)
+///        + 每列: 编码(1字节) + 数据长度(uleb128) + 数据
+class CapsBatch {
+public:
+  CapsBatch();
+
+  /// \brief 追加一行，第一行决定各列类型
+  /// \throws invalid_argument row与第一行成员数或成员类型不符，
+  ///         或含有投影解析未选择的成员
+  void append(const Caps& row);
+
+  /// \brief 同append，失败时返回错误码，不修改CapsBatch
+  /// \return CAPS_SUCCESS
+  ///         CAPS_ERR_TYPE_MISMATCH 成员数或成员类型与第一行不符
+  ///         CAPS_ERR_INVALID_PARAM 含有投影解析未选择的成员
+  int32_t tryAppend(const Caps& row);
+
+  /// \return 行数
+  inline uint32_t rows() const { return rowCount; }
+
+  /// \return 列数(每行成员数)
+  inline uint32_t columns() const { return cols.size(); }
+
+  /// \return 第c列数据类型 (CAPS_MEMBER_TYPE_INT32 etc.)
+  /// \throws out_of_range
+  char columnType(uint32_t c) const;
+
+  /// \brief 读取第i行
+  /// \throws out_of_range
+  void row(uint32_t i, Caps& out) const;
+  Caps row(uint32_t i) const;
+
+  /// \brief 读取数值列，data指向按行连续存放的rows()个值
+  ///        CapsBatch被修改或销毁后失效
+  /// \throws out_of_range
+  /// \throws Caps::type_error 列类型与data不符
+  void column(uint32_t c, const int32_t*& data) const;
+  void column(uint32_t c, const uint32_t*& data) const;
+  void column(uint32_t c, const int64_t*& data) const;
+  void column(uint32_t c, const uint64_t*& data) const;
+  void column(uint32_t c, const float*& data) const;
+  void column(uint32_t c, const double*& data) const;
+
+  /// \brief 读取string/binary/object列第i行数据
+  ///        object为嵌套Caps的序列化数据
+  /// \throws out_of_range
+  /// \throws Caps::type_error 列类型不是string/binary/object
+  void cell(uint32_t c, uint32_t i, const void*& data, uint32_t& size) const;
+
+  /// \return 序列化结果长度
+  uint32_t binarySize() const;
+
+  /// \brief 序列化
+  /// \throws invalid_argument out为nullptr
+  /// \throws out_of_range buffer长度不足
+  /// \return 序列化结果长度
+  uint32_t serialize(void* out, uint32_t size) const;
+
+  /// \brief 序列化，不抛出异常
+  /// \param result 成功时输出序列化结果长度
+  /// \return CAPS_SUCCESS
+  ///         CAPS_ERR_INVALID_PARAM out为nullptr
+  ///         CAPS_ERR_INSUFFICIENT_BUFFER buffer长度不足
+  int32_t trySerialize(void* out, uint32_t size, uint32_t& result) const;
+
+  /// \brief 反序列化，替换当前数据
+  /// \throws 同Caps::parse
+  void parse(const void* in, uint32_t size);
+
+  /// \brief 反序列化，失败时返回错误码，不抛出异常，CapsBatch被清空
+  /// \param errOffset 不为nullptr时，失败时输出出错位置在'in'中的偏移
+  /// \return 同Caps::tryParse
+  int32_t tryParse(const void* in, uint32_t size, uint32_t* errOffset = nullptr);
+
+  /// \brief 清除所有行及列类型
+  void clear();
+
+private:
+  struct Column {
+    char type;
+    // 定长类型每行字节数, 其他类型为0
+    uint32_t width;
+    // 定长类型: 本机字节序按行连续存放
+    std::vector<uint8_t> fixed;
+    // string/binary/object: 第i行数据为bytes[offsets[i], offsets[i + 1])
+    std::vector<uint32_t> offsets;
+    std::string bytes;
+  };
+
+  const Column& checkColumn(uint32_t c, char type) const;
+
+  int32_t doParse(const uint8_t* in, uint32_t size, uint32_t& off);
+
+  int32_t parseColumn(Column& col, uint8_t encoding, const uint8_t* in,
+      uint32_t size);
+
+  uint32_t columnSize(const Column& col, uint8_t& encoding) const;
+
+private:
+  std::vector<Column> cols;
+  uint32_t rowCount{0};
+};
+
+} // namespace rokid
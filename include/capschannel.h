@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "caps.h"
+
+namespace rokid {
+
+/// \brief 基于流式fd(Unix domain socket, pipe等)的Caps消息通道
+///        每条消息为一个完整的Caps序列化数据，以header中的长度分帧
+///        发送: 消息序列化到发送队列，多条消息以一次writev写出
+///        接收: 一次read读取尽可能多的数据，其中的完整消息依次解析
+///        发送队列与接收缓冲区有上限，接收缓冲区满时停止读取，
+///        由内核socket缓冲区将背压传递给发送端
+///        内部使用epoll，非线程安全
+class CapsChannel {
+public:
+  /// \param fd 已连接的socket或其他流式fd，由CapsChannel接管，析构时关闭，
+  ///           构造抛出异常时也已关闭
+  ///           fd被设置为非阻塞
+  ///           fd不是socket时(如pipe)，对端关闭后写入产生SIGPIPE，须由调用者处理
+  /// \param maxSendBytes 发送队列上限(字节)
+  /// \param maxRecvBytes 接收缓冲区上限(字节)，须大于单条消息长度
+  /// \throws system_error 设置非阻塞或epoll创建失败
+  explicit CapsChannel(int fd, uint32_t maxSendBytes = 4 * 1024 * 1024,
+      uint32_t maxRecvBytes = 4 * 1024 * 1024);
+  ~CapsChannel();
+
+  CapsChannel(const CapsChannel&) = delete;
+  CapsChannel& operator = (const CapsChannel&) = delete;
+
+  /// \brief 序列化caps并加入发送队列，不阻塞
+  ///        队列中数据超过一个chunk时尝试写出
+  /// \param flags 序列化选项 (CAPS_FLAG_CRC32C, CAPS_FLAG_FIXED_INT)
+  /// \return false 发送队列已满，稍后重试
+  /// \throws system_error 写入失败
+  /// \throws logic_error 通道已关闭
+  bool trySend(const Caps& caps, uint32_t flags = 0);
+
+  /// \brief 将已序列化的Caps数据加入发送队列，不阻塞
+  /// \throws invalid_argument data不是完整的Caps序列化数据
+  bool trySend(const void* data, uint32_t size);
+
+  /// \brief 加入发送队列，队列已满时等待
+  /// \throws system_error 写入失败
+  /// \throws logic_error 通道已关闭
+  void send(const Caps& caps, uint32_t flags = 0);
+
+  /// \brief 写出发送队列中的数据，不阻塞
+  /// \return 发送队列中剩余字节数
+  /// \throws system_error 写入失败
+  uint32_t flush();
+
+  /// \brief 接收一条消息，不阻塞
+  ///        接收缓冲区中没有完整消息时尝试读取一次
+  /// \return false 没有完整消息
+  /// \throws system_error 读取失败
+  /// \throws 同Caps::parse 消息格式错误
+  bool tryRecv(Caps& out);
+
+  /// \brief 接收一条消息
+  /// \param timeout 等待时间(毫秒)，-1一直等待
+  /// \return false 超时或通道已关闭
+  bool recv(Caps& out, int32_t timeout = -1);
+
+  /// \brief 等待fd可读/可写事件，读取数据并写出发送队列
+  /// \param timeout 等待时间(毫秒)，-1一直等待
+  /// \return 接收缓冲区中完整消息数
+  /// \throws system_error 读写失败
+  uint32_t poll(int32_t timeout);
+
+  /// \return 发送队列中字节数
+  inline uint32_t pendingSend() const { return sendBytes; }
+
+  /// \return 对端已关闭或连接出错，接收缓冲区中的消息仍可读取
+  inline bool closed() const { return peerClosed; }
+
+  /// \return 内部epoll fd，可加入外部事件循环，可读时调用poll(0)
+  inline int pollFd() const { return epollFd; }
+
+  inline int fd() const { return sockFd; }
+
+private:
+  struct Chunk {
+    std::vector<uint8_t> data;
+    uint32_t size;
+  };
+
+  uint8_t* reserve(uint32_t size);
+
+  void commit(uint32_t size);
+
+  // 读取可用数据直到EAGAIN或缓冲区满
+  void fill();
+
+  // 接收缓冲区中第一条完整消息的长度, 没有时返回0
+  uint32_t frameSize() const;
+
+  void updateEvents();
+
+private:
+  int sockFd;
+  int epollFd;
+  bool isSocket{false};
+  bool peerClosed{false};
+  uint32_t events{0};
+  uint32_t maxSendBytes;
+  uint32_t maxRecvBytes;
+  // 发送队列, front的[sendOffset, size)未写出
+  std::deque<Chunk> chunks;
+  std::vector<Chunk> freeChunks;
+  uint32_t sendOffset{0};
+  uint32_t sendBytes{0};
+  // 接收缓冲区, [recvStart, recvEnd)未解析
+  std::vector<uint8_t> recvBuf;
+  uint32_t recvStart{0};
+  uint32_t recvEnd{0};
+};
+
+} // namespace rokid
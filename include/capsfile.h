@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "caps.h"
+
+namespace rokid {
+
+/// \brief Caps记录文件
+///        数据文件: 8字节文件头 + 顺序追加的记录
+///        每条记录为 8字节时间戳(little endian) + Caps序列化数据
+///        索引文件(数据文件名 + ".idx"): 8字节文件头 + 每条记录的索引项
+///        每个索引项为 8字节记录偏移 + 8字节时间戳(little endian)
+class CapsFileWriter {
+public:
+  CapsFileWriter();
+  ~CapsFileWriter();
+
+  CapsFileWriter(const CapsFileWriter&) = delete;
+  CapsFileWriter& operator = (const CapsFileWriter&) = delete;
+
+  /// \brief 打开记录文件，文件不存在时创建
+  ///        截断末尾不完整的记录(写入过程中崩溃)，并修复索引文件
+  /// \throws system_error 文件操作失败
+  /// \throws domain_error 不是Caps记录文件
+  void open(const char* path);
+
+  /// \brief 追加一条记录
+  /// \throws logic_error 文件未打开
+  /// \throws system_error 文件写入失败
+  void append(const Caps& caps, uint64_t timestamp = 0);
+
+  /// \brief 追加一条已序列化的记录
+  /// \param data Caps序列化数据
+  /// \param size 'data'长度，必须与Caps数据中的长度一致
+  /// \throws invalid_argument 'data'不是完整的Caps序列化数据
+  void append(const void* data, uint32_t size, uint64_t timestamp = 0);
+
+  /// \brief 将已追加的记录写入磁盘
+  void sync();
+
+  void close();
+
+  /// \return 记录数量
+  inline uint32_t count() const { return recordCount; }
+
+private:
+  void recover();
+
+  void appendRecord(uint64_t timestamp);
+
+  void writeAll(int fd, const void* data, size_t size, uint64_t off);
+
+private:
+  int logFd;
+  int indexFd;
+  uint64_t logSize;
+  uint32_t recordCount;
+  std::vector<uint8_t> buffer;
+};
+
+/// \brief Caps记录文件读取
+///        通过mmap映射数据文件与索引文件，记录数据直接从映射内存解析
+///        只能读到打开时索引文件中已有的记录
+class CapsFileReader {
+public:
+  CapsFileReader();
+  ~CapsFileReader();
+
+  CapsFileReader(const CapsFileReader&) = delete;
+  CapsFileReader& operator = (const CapsFileReader&) = delete;
+
+  /// \brief 打开记录文件
+  /// \param sequential true: 顺序扫描为主，内核预读更多数据
+  ///                   false: 随机访问为主
+  /// \throws system_error 文件操作失败
+  /// \throws domain_error 不是Caps记录文件
+  void open(const char* path, bool sequential = false);
+
+  void close();
+
+  /// \return 记录数量
+  inline uint32_t count() const { return recordCount; }
+
+  /// \brief 获取第i条记录的Caps序列化数据，指向映射内存，close后失效
+  /// \param size 输出数据长度
+  /// \throws out_of_range i超出范围
+  /// \throws domain_error 索引或数据文件损坏
+  const void* data(uint32_t i, uint32_t& size) const;
+
+  /// \return 第i条记录的时间戳
+  /// \throws out_of_range i超出范围
+  uint64_t timestamp(uint32_t i) const;
+
+  /// \brief 从映射内存解析第i条记录
+  void read(uint32_t i, Caps& caps) const;
+
+  /// \brief 从映射内存解析第i条记录，不抛出异常
+  /// \return CAPS_SUCCESS
+  ///         CAPS_ERR_OUT_OF_RANGE i超出范围
+  ///         其它 Caps::tryParse返回值
+  int32_t tryRead(uint32_t i, Caps& caps) const;
+
+private:
+  int32_t record(uint32_t i, const uint8_t*& data, uint32_t& size) const;
+
+private:
+  const uint8_t* logData;
+  uint64_t logSize;
+  const uint8_t* indexData;
+  uint64_t indexSize;
+  uint32_t recordCount;
+};
+
+} // namespace rokid
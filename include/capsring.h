@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+#include "caps.h"
+
+namespace rokid {
+
+/// \brief 进程间共享内存环形缓冲区，单生产者单消费者，无锁
+///        生产者直接将Caps序列化到环形缓冲区，消费者在缓冲区中
+///        原地解析或读取序列化数据，每条消息没有额外复制
+///        只在一方等待(缓冲区空/满)时通过futex唤醒，忙碌时没有系统调用
+///        共享内存为memfd，fork后子进程直接使用，
+///        或将fd()传递给其他进程后attach
+class CapsRing {
+public:
+  CapsRing();
+  ~CapsRing();
+
+  CapsRing(const CapsRing&) = delete;
+  CapsRing& operator = (const CapsRing&) = delete;
+
+  /// \brief 创建共享内存环形缓冲区
+  /// \param capacity 数据区大小，向上取整为2的幂，最小4096
+  /// \throws system_error 创建或映射共享内存失败
+  void create(uint32_t capacity);
+
+  /// \brief 映射其他进程创建的环形缓冲区
+  /// \param fd create创建的共享内存fd，attach后由CapsRing持有(dup)
+  /// \throws system_error 映射共享内存失败
+  /// \throws domain_error 不是CapsRing共享内存
+  void attach(int fd);
+
+  void close();
+
+  /// \return 共享内存fd
+  inline int fd() const { return shmFd; }
+
+  /// \return 单条消息最大长度
+  uint32_t maxMessageSize() const;
+
+  // 生产者
+
+  /// \brief 预留size字节的连续空间，不阻塞
+  /// \return 预留空间，缓冲区空间不足时返回nullptr
+  /// \throws length_error size超过maxMessageSize()
+  uint8_t* tryReserve(uint32_t size);
+
+  /// \brief 发布tryReserve预留空间中的size字节
+  ///        size不大于预留长度
+  void commit(uint32_t size);
+
+  /// \brief 将caps序列化到缓冲区，不阻塞
+  /// \return false 缓冲区空间不足
+  bool tryWrite(const Caps& caps, uint32_t flags = 0);
+
+  /// \brief 将caps序列化到缓冲区，空间不足时等待
+  /// \param timeout 等待时间(毫秒)，-1一直等待
+  /// \return false 超时
+  bool write(const Caps& caps, uint32_t flags = 0, int32_t timeout = -1);
+
+  // 消费者
+
+  /// \brief 读取下一条消息的序列化数据，不阻塞，不移出消息
+  /// \param size 输出消息长度
+  /// \return 消息数据，指向共享内存，release后失效；没有消息时返回nullptr
+  /// \throws domain_error 共享内存数据被破坏
+  const uint8_t* tryPeek(uint32_t& size);
+
+  /// \brief 移出tryPeek读取的消息
+  void release();
+
+  /// \brief 解析并移出下一条消息，不阻塞
+  /// \return false 没有消息
+  /// \throws 同Caps::parse
+  bool tryRead(Caps& out);
+
+  /// \brief 解析并移出下一条消息，没有消息时等待
+  /// \param timeout 等待时间(毫秒)，-1一直等待
+  /// \return false 超时
+  bool read(Caps& out, int32_t timeout = -1);
+
+private:
+  struct Control;
+
+  void map(int fd, uint32_t capacity);
+
+private:
+  int shmFd{-1};
+  Control* control{nullptr};
+  uint8_t* data{nullptr};
+  uint32_t capacity{0};
+  // 生产者本地状态
+  uint64_t writePos{0};
+  uint64_t cachedTail{0};
+  uint32_t reserved{0};
+  // 消费者本地状态
+  uint64_t readPos{0};
+  uint64_t cachedHead{0};
+  uint32_t peeked{0};
+};
+
+} // namespace rokid
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "caps.h"
+
+namespace rokid {
+
+/// \brief 消息签名表，由序列化数据的成员类型描述确定消息的处理者
+///        签名为成员类型字符组成的字符串，例如"iSSO"，
+///        与Caps序列化数据中的成员类型描述相同；嵌套Caps只匹配'O'，不检查其内部结构
+///        匹配时只读取header及类型描述，不解析成员，不校验CRC32C:
+///        对类型描述计算一次哈希，在开放寻址哈希表中定位后以一次memcmp确认
+///        注册完成后tryMatch可被多个线程并发调用
+class CapsSignatures {
+public:
+  CapsSignatures();
+
+  /// \brief 注册签名
+  /// \param signature 成员类型字符串，空字符串匹配没有成员的Caps
+  /// \param id 匹配时输出的处理者id
+  /// \throws invalid_argument signature为nullptr，含有不可序列化的类型，或已注册
+  void add(const char* signature, uint32_t id);
+
+  /// \brief 查找序列化数据的签名，不解析成员，不抛出异常
+  /// \param in serialize生成的二进制数据
+  /// \param size 二进制数据长度
+  /// \param id 成功时输出签名注册的id
+  /// \return CAPS_SUCCESS
+  ///         CAPS_ERR_TYPE_MISMATCH 没有匹配的签名
+  ///         CAPS_ERR_INVALID_PARAM in为nullptr或size长度不正确
+  ///         CAPS_ERR_VERSION caps版本不符
+  ///         CAPS_ERR_CORRUPTED CAPS_ERR_TRUNCATED CAPS_ERR_OVERFLOW
+  ///         header或类型描述格式错误
+  int32_t tryMatch(const void* in, uint32_t size, uint32_t& id) const noexcept;
+
+  /// \return 注册的签名数
+  inline uint32_t size() const { return count; }
+
+  /// \brief 清除所有签名
+  void clear();
+
+private:
+  struct Slot {
+    uint64_t hash;
+    // 签名在pool中的位置
+    uint32_t offset;
+    uint32_t length;
+    uint32_t id;
+    bool used;
+  };
+
+  const Slot* find(const uint8_t* desc, uint32_t length, uint64_t hash) const;
+
+  void grow();
+
+private:
+  // 所有签名连续存放
+  std::string pool;
+  // 容量为2的幂, 负载不超过1/2
+  std::vector<Slot> slots;
+  uint32_t count{0};
+};
+
+} // namespace rokid
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace rokid {
+
+#define CAPS_STATS_TYPE_COUNT 10
+
+/// \brief caps库运行统计
+///
+/// 库须以BUILD_STATS选项编译(定义CAPS_STATS宏), 否则统计代码不会编译进库,
+/// 所有计数为0
+/// 计数器为线程独立, snapshot时汇总所有线程(包括已退出线程)
+class CapsStats {
+public:
+  /// 顶层serialize/trySerialize调用次数
+  uint64_t serializeCalls;
+  /// 序列化输出字节数
+  uint64_t serializeBytes;
+  /// 序列化耗时(纳秒)
+  uint64_t serializeNanos;
+  /// 顶层parse/tryParse调用次数
+  uint64_t parseCalls;
+  /// 失败的parse/tryParse调用次数
+  uint64_t parseErrors;
+  /// 反序列化输入字节数
+  uint64_t parseBytes;
+  /// 反序列化耗时(纳秒)
+  uint64_t parseNanos;
+  /// 创建的成员数
+  uint64_t memberAllocs;
+  /// serialize/parse过程中处理的嵌套Caps数
+  uint64_t nestedObjects;
+  /// serialize/parse过程中遇到的最大嵌套层数(不含顶层)
+  uint32_t maxDepth;
+
+  /// \brief 指定类型成员的创建数
+  /// \param type CAPS_MEMBER_TYPE_INT32 etc.
+  uint64_t memberAllocsOf(char type) const;
+
+  /// \return 库是否以CAPS_STATS编译
+  static bool enabled();
+
+  /// \brief 汇总所有线程的计数
+  static CapsStats snapshot();
+
+  /// \brief 计数清零
+  /// 最大嵌套层数的清零不与其它线程同步, 并发执行serialize/parse时可能残留旧值
+  static void reset();
+
+private:
+  uint64_t typeAllocs[CAPS_STATS_TYPE_COUNT];
+
+  friend class StatsRegistry;
+};
+
+} // namespace rokid
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <stdint.h>
+#include "caps.h"
+#include "leb128.h"
+#include "byteorder.h"
+
+// 嵌套Caps最大层数
+#define CAPS_VISIT_MAX_DEPTH 512
+
+namespace rokid {
+
+/// \brief 直接遍历Caps序列化数据，每个成员回调一次visitor，不生成Caps，不分配内存
+///
+/// visitor类型须实现以下回调(可继承CapsVisitor只实现需要的部分):
+///   void onInt32(int32_t v);
+///   void onUint32(uint32_t v);
+///   void onInt64(int64_t v);
+///   void onUint64(uint64_t v);
+///   void onFloat(float v);
+///   void onDouble(double v);
+///   void onString(const char* data, uint32_t size);
+///   void onBinary(const void* data, uint32_t size);
+///   void onVoid();
+///   // 顶层与嵌套Caps都会回调, count为成员数
+///   void onBeginObject(uint32_t count);
+///   void onEndObject();
+/// 回调以模板静态绑定，可被编译器内联
+/// string/binary数据指针指向输入数据，回调返回后不应继续使用
+class CapsVisitor {
+public:
+  inline void onInt32(int32_t) {}
+  inline void onUint32(uint32_t) {}
+  inline void onInt64(int64_t) {}
+  inline void onUint64(uint64_t) {}
+  inline void onFloat(float) {}
+  inline void onDouble(double) {}
+  inline void onString(const char*, uint32_t) {}
+  inline void onBinary(const void*, uint32_t) {}
+  inline void onVoid() {}
+  inline void onBeginObject(uint32_t) {}
+  inline void onEndObject() {}
+
+  /// \brief 遍历serialize生成的二进制数据
+  ///        出错时已经发生的回调不会撤销
+  /// \param in serialize生成的二进制数据
+  /// \param size 二进制数据长度
+  /// \param visitor 回调对象
+  /// \param errOffset 不为nullptr时，失败时输出出错位置在'in'中的偏移
+  /// \return 与Caps::tryParse相同
+  ///         CAPS_ERR_TOO_DEEP 嵌套层数超过CAPS_VISIT_MAX_DEPTH
+  template <typename V>
+  static int32_t visit(const void* in, uint32_t size, V& visitor,
+      uint32_t* errOffset = nullptr) {
+    uint32_t off{0};
+    auto r = visitCaps(reinterpret_cast<const uint8_t*>(in), size, visitor,
+        off, 0);
+    if (r != CAPS_SUCCESS && errOffset)
+      *errOffset = off;
+    return r;
+  }
+
+private:
+  /// \brief 检查header(数据长度，版本，CRC32C校验)
+  /// \param size 输入数据长度，输出不含CRC32C校验数据的长度
+  /// \param fixed 输出是否为CAPS_FLAG_FIXED_INT格式
+  static int32_t checkHeader(const uint8_t* in, uint32_t& size, bool& fixed,
+      uint32_t& off);
+
+  template <typename R>
+  static int32_t readError(uint32_t size, bool fixed) {
+    if (fixed || size < (sizeof(R) == 4 ? LEB128_MAX_INT32_BYTES
+          : LEB128_MAX_INT64_BYTES))
+      return CAPS_ERR_TRUNCATED;
+    return CAPS_ERR_OVERFLOW;
+  }
+
+  template <typename T>
+  static uint32_t readInt(const uint8_t* in, uint32_t size, bool fixed, T& v) {
+    if (!fixed)
+      return leb128TryRead(in, size, v);
+    if (size < sizeof(T))
+      return 0;
+    if (sizeof(T) == sizeof(uint32_t))
+      v = leReadUint32(in);
+    else
+      v = leReadUint64(in);
+    return sizeof(T);
+  }
+
+  template <typename T>
+  static uint32_t readUint(const uint8_t* in, uint32_t size, bool fixed, T& v) {
+    if (!fixed)
+      return uleb128TryRead(in, size, v);
+    if (size < sizeof(T))
+      return 0;
+    if (sizeof(T) == sizeof(uint32_t))
+      v = leReadUint32(in);
+    else
+      v = leReadUint64(in);
+    return sizeof(T);
+  }
+
+  template <typename V>
+  static int32_t visitCaps(const uint8_t* in, uint32_t size, V& visitor,
+      uint32_t& off, uint32_t depth) {
+    bool fixed;
+    auto r = checkHeader(in, size, fixed, off);
+    if (r != CAPS_SUCCESS)
+      return r;
+    uint32_t descLen;
+    auto c = uleb128TryRead(in + off, size - off, descLen);
+    if (c == 0)
+      return readError<uint32_t>(size - off, false);
+    off += c;
+    if (size - off < descLen)
+      return CAPS_ERR_CORRUPTED;
+    auto desc = in + off;
+    off += descLen;
+    visitor.onBeginObject(descLen);
+    uint32_t i;
+    for (i = 0; i < descLen; ++i) {
+      switch (desc[i]) {
+      case CAPS_MEMBER_TYPE_INT32: {
+        int32_t v;
+        c = readInt(in + off, size - off, fixed, v);
+        if (c == 0)
+          return readError<int32_t>(size - off, fixed);
+        visitor.onInt32(v);
+        break;
+      }
+      case CAPS_MEMBER_TYPE_UINT32: {
+        uint32_t v;
+        c = readUint(in + off, size - off, fixed, v);
+        if (c == 0)
+          return readError<uint32_t>(size - off, fixed);
+        visitor.onUint32(v);
+        break;
+      }
+      case CAPS_MEMBER_TYPE_INT64: {
+        int64_t v;
+        c = readInt(in + off, size - off, fixed, v);
+        if (c == 0)
+          return readError<int64_t>(size - off, fixed);
+        visitor.onInt64(v);
+        break;
+      }
+      case CAPS_MEMBER_TYPE_UINT64: {
+        uint64_t v;
+        c = readUint(in + off, size - off, fixed, v);
+        if (c == 0)
+          return readError<uint64_t>(size - off, fixed);
+        visitor.onUint64(v);
+        break;
+      }
+      case CAPS_MEMBER_TYPE_FLOAT:
+        if (size - off < sizeof(float))
+          return CAPS_ERR_CORRUPTED;
+        visitor.onFloat(leReadFloat(in + off));
+        c = sizeof(float);
+        break;
+      case CAPS_MEMBER_TYPE_DOUBLE:
+        if (size - off < sizeof(double))
+          return CAPS_ERR_CORRUPTED;
+        visitor.onDouble(leReadDouble(in + off));
+        c = sizeof(double);
+        break;
+      case CAPS_MEMBER_TYPE_STRING:
+      case CAPS_MEMBER_TYPE_BINARY: {
+        uint32_t v;
+        c = readUint(in + off, size - off, fixed, v);
+        if (c == 0)
+          return readError<uint32_t>(size - off, fixed);
+        off += c;
+        if (size - off < v)
+          return CAPS_ERR_CORRUPTED;
+        if (desc[i] == CAPS_MEMBER_TYPE_STRING)
+          visitor.onString(reinterpret_cast<const char*>(in + off), v);
+        else
+          visitor.onBinary(in + off, v);
+        c = v;
+        break;
+      }
+      case CAPS_MEMBER_TYPE_OBJECT: {
+        if (depth + 1 >= CAPS_VISIT_MAX_DEPTH)
+          return CAPS_ERR_TOO_DEEP;
+        if (size - off < sizeof(uint32_t))
+          return CAPS_ERR_CORRUPTED;
+        c = beReadUint32(in + off);
+        if (c > size - off)
+          return CAPS_ERR_CORRUPTED;
+        uint32_t sub;
+        r = visitCaps(in + off, c, visitor, sub, depth + 1);
+        if (r != CAPS_SUCCESS) {
+          off += sub;
+          return r == CAPS_ERR_INVALID_PARAM ? CAPS_ERR_CORRUPTED : r;
+        }
+        break;
+      }
+      case CAPS_MEMBER_TYPE_VOID:
+        visitor.onVoid();
+        c = 0;
+        break;
+      default:
+        off = desc + i - in;
+        return CAPS_ERR_CORRUPTED;
+      }
+      off += c;
+    }
+    visitor.onEndObject();
+    return CAPS_SUCCESS;
+  }
+};
+
+} // namespace rokid
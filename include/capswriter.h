@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "caps.h"
+
+namespace rokid {
+
+/// \brief 不构建Caps成员，直接生成序列化数据
+///        写入顺序与Caps::write相同时，结果与Caps::serialize完全一致
+///        各层Caps的header与成员类型描述在endObject/finish时写入，
+///        预留空间(memberHint)与实际成员数不符时移动该层已写入的数据
+class CapsWriter {
+public:
+  /// \param flags 序列化选项 (CAPS_FLAG_CRC32C, CAPS_FLAG_FIXED_INT)
+  /// \param memberHint 预计的顶层成员数
+  /// \throws invalid_argument flags不正确
+  explicit CapsWriter(uint32_t flags = 0, uint32_t memberHint = 0);
+
+  /// \brief 丢弃已写入数据，保留buffer容量，重新开始写入
+  void reset(uint32_t memberHint = 0);
+
+  /// \brief 写入void类型
+  void write();
+  inline void write(bool v) { write((uint32_t)(v ? 1 : 0)); }
+  inline void write(int8_t v) { write((int32_t)v); }
+  inline void write(uint8_t v) { write((uint32_t)v); }
+  inline void write(int16_t v) { write((int32_t)v); }
+  inline void write(uint16_t v) { write((uint32_t)v); }
+  void write(int32_t v);
+  void write(uint32_t v);
+  void write(int64_t v);
+  void write(uint64_t v);
+  void write(float v);
+  void write(double v);
+  /// \brief 写入字符串类型
+  void write(const char* v);
+  /// \brief 写入字符串类型，与Caps::write相同，截断于第一个'\0'
+  inline void write(const std::string& v) { write(v.c_str()); }
+  /// \brief 写入二进制数据类型
+  void write(const void* data, uint32_t size);
+  inline void write(const std::vector<char>& v) { write(v.data(), v.size()); }
+  /// \brief 写入Caps类型
+  /// \throws range_error v含有投影解析未选择的成员，与Caps::serialize相同，
+  ///         此时不写入任何数据
+  void write(const Caps& v);
+  inline void operator << (bool v) { write(v); }
+  inline void operator << (int8_t v) { write(v); }
+  inline void operator << (uint8_t v) { write(v); }
+  inline void operator << (int16_t v) { write(v); }
+  inline void operator << (uint16_t v) { write(v); }
+  inline void operator << (int32_t v) { write(v); }
+  inline void operator << (uint32_t v) { write(v); }
+  inline void operator << (float v) { write(v); }
+  inline void operator << (int64_t v) { write(v); }
+  inline void operator << (uint64_t v) { write(v); }
+  inline void operator << (double v) { write(v); }
+  inline void operator << (const char* v) { write(v); }
+  inline void operator << (const std::string& v) { write(v); }
+  inline void operator << (const std::vector<char>& v) { write(v); }
+  inline void operator << (const Caps& v) { write(v); }
+
+  /// \brief 开始写入嵌套Caps，之后写入的值为嵌套Caps的成员
+  /// \param memberHint 预计的成员数
+  void beginObject(uint32_t memberHint = 0);
+
+  /// \brief 结束嵌套Caps
+  /// \throws logic_error 没有对应的beginObject
+  void endObject();
+
+  /// \brief 结束写入，生成完整的序列化数据
+  /// \throws logic_error 存在未结束的嵌套Caps
+  /// \return 序列化数据长度
+  uint32_t finish();
+
+  /// \return 序列化数据，finish之后有效
+  inline const uint8_t* data() const { return buffer.data(); }
+
+  /// \return 序列化数据长度，finish之后有效
+  inline uint32_t size() const { return length; }
+
+private:
+  struct Level {
+    // 本层Caps起始位置
+    uint32_t start;
+    // 为header与成员类型描述预留的长度
+    uint32_t reserved;
+    // 本层成员类型在types中的起始位置
+    uint32_t firstType;
+  };
+
+  uint8_t* ensure(uint32_t n);
+
+  uint8_t* append(char type, uint32_t n);
+
+  void checkWritable() const;
+
+  void close(const Level& level, uint32_t trailer);
+
+private:
+  uint32_t flags;
+  std::vector<uint8_t> buffer;
+  uint32_t length{0};
+  std::vector<char> types;
+  std::vector<Level> levels;
+  bool finished{false};
+};
+
+} // namespace rokid
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdexcept>
+#include <type_traits>
+
+#define LEB128_BYTE_MASK 0x7f
+#define LEB128_BITS_PER_BYTE 7
+#define LEB128_MAX_INT32_BYTES 5
+#define LEB128_MAX_INT64_BYTES 10
+
+namespace rokid {
+
+// 不抛出异常版本, 返回读取的字节数
+// 返回0: 输入数据不足或数据超长
+template <typename T, typename R, int32_t M = std::is_same<R, int32_t>::value ? LEB128_MAX_INT32_BYTES : LEB128_MAX_INT64_BYTES,
+         typename std::enable_if<std::is_same<R, int32_t>::value || std::is_same<R, int64_t>::value, R>::type* = nullptr,
+         typename std::enable_if<std::is_same<T, const uint8_t>::value || std::is_same<T, uint8_t>::value, T>::type* = nullptr>
+uint32_t leb128TryRead(T* in, uint32_t size, R& res) {
+  R cur;
+  T* p = in;
+  uint8_t curShift{0};
+  uint8_t signExtBits{std::is_same<R, int32_t>::value ? 32 : 64};
+
+  res = 0;
+  while (true) {
+    if (p - in >= M || p - in >= size)
+      return 0;
+    cur = *p;
+    res |= (cur & LEB128_BYTE_MASK) << curShift;
+    curShift += LEB128_BITS_PER_BYTE;
+    ++p;
+    if (cur <= LEB128_BYTE_MASK)
+      break;
+  }
+  if (curShift < (sizeof(R) << 3))
+    signExtBits -= curShift;
+  res = (res << signExtBits) >> signExtBits;
+  return p - in;
+}
+
+template <typename T, typename R, int32_t M = std::is_same<R, uint32_t>::value ? LEB128_MAX_INT32_BYTES : LEB128_MAX_INT64_BYTES,
+         typename std::enable_if<std::is_same<R, uint32_t>::value || std::is_same<R, uint64_t>::value, R>::type* = nullptr,
+         typename std::enable_if<std::is_same<T, const uint8_t>::value || std::is_same<T, uint8_t>::value, T>::type* = nullptr>
+uint32_t uleb128TryRead(T* in, uint32_t size, R& res) {
+  R cur;
+  T* p = in;
+  uint8_t curShift{0};
+
+  res = 0;
+  while (true) {
+    if (p - in >= M || p - in >= size)
+      return 0;
+    cur = *p;
+    res |= (cur & LEB128_BYTE_MASK) << curShift;
+    curShift += LEB128_BITS_PER_BYTE;
+    ++p;
+    if (cur <= LEB128_BYTE_MASK)
+      break;
+  }
+  return p - in;
+}
+
+// leb128TryRead失败原因: 输入数据长度不足最大编码长度时为数据不足, 否则为数据超长
+template <typename R>
+void leb128ThrowReadError(uint32_t size) {
+  if (size < (sizeof(R) == 4 ? LEB128_MAX_INT32_BYTES : LEB128_MAX_INT64_BYTES))
+    throw std::out_of_range("input data size not enough");
+  throw std::length_error("input data corrupted");
+}
+
+template <typename T, typename R>
+uint32_t leb128Read(T* in, uint32_t size, R& res) {
+  auto r = leb128TryRead(in, size, res);
+  if (r == 0)
+    leb128ThrowReadError<R>(size);
+  return r;
+}
+
+template <typename T, typename R>
+uint32_t uleb128Read(T* in, uint32_t size, R& res) {
+  auto r = uleb128TryRead(in, size, res);
+  if (r == 0)
+    leb128ThrowReadError<R>(size);
+  return r;
+}
+
+// 不抛出异常版本, 返回写入数据末尾
+// 返回nullptr: buffer长度不足
+template <typename T,
+         typename std::enable_if<std::is_same<T, int32_t>::value || std::is_same<T, int64_t>::value, T>::type* = nullptr>
+uint8_t* leb128TryWrite(T v, uint8_t* out, uint32_t size) {
+  bool more{true};
+  int32_t cur;
+  auto p = out;
+  while (more) {
+    if (p - out >= size)
+      return nullptr;
+    cur = v & LEB128_BYTE_MASK;
+    v >>= 7;
+    if ((v == 0 && cur < 0x40) || (v == -1 && cur >= 0x40)) {
+      more = false;
+    } else {
+      cur |= 0x80;
+    }
+    *p = cur;
+    ++p;
+  }
+  return p;
+}
+
+template <typename T,
+         typename std::enable_if<std::is_same<T, uint32_t>::value || std::is_same<T, uint64_t>::value, T>::type* = nullptr>
+uint8_t* uleb128TryWrite(T v, uint8_t* out, uint32_t size) {
+  bool more{true};
+  uint32_t cur;
+  auto p = out;
+  while (more) {
+    if (p - out >= size)
+      return nullptr;
+    cur = v & LEB128_BYTE_MASK;
+    v >>= 7;
+    if (v == 0) {
+      more = false;
+    } else {
+      cur |= 0x80;
+    }
+    *p = cur;
+    ++p;
+  }
+  return p;
+}
+
+template <typename T>
+uint8_t* leb128Write(T v, uint8_t* out, uint32_t size) {
+  auto p = leb128TryWrite(v, out, size);
+  if (p == nullptr)
+    throw std::out_of_range("no enough buffer");
+  return p;
+}
+
+template <typename T>
+uint8_t* uleb128Write(T v, uint8_t* out, uint32_t size) {
+  auto p = uleb128TryWrite(v, out, size);
+  if (p == nullptr)
+    throw std::out_of_range("no enough buffer");
+  return p;
+}
+
+// 编码后的字节数
+template <typename T,
+         typename std::enable_if<std::is_same<T, int32_t>::value || std::is_same<T, int64_t>::value, T>::type* = nullptr>
+uint32_t leb128Size(T v) {
+  uint32_t r{1};
+  while (v >= 0x40 || v < -0x40) {
+    v >>= 7;
+    ++r;
+  }
+  return r;
+}
+
+template <typename T,
+         typename std::enable_if<std::is_same<T, uint32_t>::value || std::is_same<T, uint64_t>::value, T>::type* = nullptr>
+uint32_t uleb128Size(T v) {
+  uint32_t r{1};
+  while (v > LEB128_BYTE_MASK) {
+    v >>= 7;
+    ++r;
+  }
+  return r;
+}
+
+// 以len字节写入v, 多余字节为不改变解码结果的填充
+// 返回false: v的编码长度超过len
+template <typename T,
+         typename std::enable_if<std::is_same<T, int32_t>::value || std::is_same<T, int64_t>::value, T>::type* = nullptr>
+bool leb128WritePadded(T v, uint8_t* out, uint32_t len) {
+  if (len == 0 || leb128Size(v) > len)
+    return false;
+  uint32_t i;
+  for (i = 0; i + 1 < len; ++i) {
+    out[i] = (v & LEB128_BYTE_MASK) | 0x80;
+    v >>= 7;
+  }
+  out[i] = v & LEB128_BYTE_MASK;
+  return true;
+}
+
+template <typename T,
+         typename std::enable_if<std::is_same<T, uint32_t>::value || std::is_same<T, uint64_t>::value, T>::type* = nullptr>
+bool uleb128WritePadded(T v, uint8_t* out, uint32_t len) {
+  if (len == 0 || uleb128Size(v) > len)
+    return false;
+  uint32_t i;
+  for (i = 0; i + 1 < len; ++i) {
+    out[i] = (v & LEB128_BYTE_MASK) | 0x80;
+    v >>= 7;
+  }
+  out[i] = v;
+  return true;
+}
+
+} // namespace rokid
@@ -1,29 +1,23 @@
 #include <stdio.h>
-#include <stdarg.h>
+#include <stdlib.h>
 #include <inttypes.h>
 #include <string.h>
-#include <arpa/inet.h>
 #include <stdexcept>
 #include <algorithm>
 #include "caps.h"
 #include "defs.h"
 #include "member.h"
 #include "leb128.h"
+#include "stats.h"
+#include "crc32c.h"
+#include "byteorder.h"
+#include "wyhash.h"
+#include "capsvisitor.h"
 
 using namespace std;
 
 namespace rokid {
 
-template <typename E>
-void throwException(const char* format, ...) {
-  char msg[64];
-  va_list ap;
-  va_start(ap, format);
-  vsnprintf(msg, sizeof(msg), format, ap);
-  va_end(ap);
-  throw E(msg);
-}
-
 Caps::Caps() {
   aliveIndicator = make_shared<int32_t>(0);
 }
@@ -37,338 +31,906 @@ Caps::Caps(initializer_list<Caps::Value> list) {
 
 Caps::~Caps() {
   aliveIndicator.reset();
+  serializeCache.reset();
   clearMembers();
 }
 
 Caps::Caps(const Caps& o) {
   members = o.members;
   aliveIndicator = make_shared<int32_t>(0);
+  copyCache(o);
 }
 
 Caps::Caps(Caps&& o) {
   members = move(o.members);
   aliveIndicator = make_shared<int32_t>(0);
+  copyCache(o);
+  o.serializeCache.reset();
+  o.invalidateCache();
 }
 
 Caps& Caps::operator = (const Caps& o) {
-  members = o.members;
+  if (this != &o) {
+    members = o.members;
+    copyCache(o);
+  }
   return *this;
 }
 
 Caps& Caps::operator = (Caps&& o) {
-  members = move(o.members);
+  if (this != &o) {
+    members = move(o.members);
+    copyCache(o);
+    o.serializeCache.reset();
+    o.invalidateCache();
+  }
   return *this;
 }
 
 void Caps::write() {
+  invalidateCache();
   members.push_back(make_shared<VoidMember>());
 }
 
 void Caps::write(int32_t v) {
+  invalidateCache();
   members.push_back(make_shared<Int32Member>(v));
 }
 
 void Caps::write(uint32_t v) {
+  invalidateCache();
   members.push_back(make_shared<Uint32Member>(v));
 }
 
 void Caps::write(float v) {
+  invalidateCache();
   members.push_back(make_shared<FloatMember>(v));
 }
 
 void Caps::write(int64_t v) {
+  invalidateCache();
   members.push_back(make_shared<Int64Member>(v));
 }
 
 void Caps::write(uint64_t v) {
+  invalidateCache();
   members.push_back(make_shared<Uint64Member>(v));
 }
 
 void Caps::write(double v) {
+  invalidateCache();
   members.push_back(make_shared<DoubleMember>(v));
 }
 
 void Caps::write(const char* v) {
+  invalidateCache();
   members.push_back(make_shared<StringMember>(v));
 }
 
 void Caps::write(const void* data, uint32_t size) {
+  invalidateCache();
   members.push_back(make_shared<BinaryMember>(data, size));
 }
 
 void Caps::write(const Caps& v) {
+  invalidateCache();
   members.push_back(make_shared<ObjectMember>(v));
 }
 
-uint32_t Caps::serialize(void* out, uint32_t size) const {
+uint32_t Caps::serialize(void* out, uint32_t size, uint32_t flags) const {
   if (out == nullptr)
     throw invalid_argument("out is nullptr");
   if (size <= HEADER_SIZE)
     throw out_of_range("out buffer size too small");
-  uint8_t* p = reinterpret_cast<uint8_t*>(out);
-  p += HEADER_SIZE;
-  auto psize = size - (p - reinterpret_cast<uint8_t*>(out));
-  p = serializeMemberDesc(p, psize);
-  psize = size - (p - reinterpret_cast<uint8_t*>(out));
-  p = serializeMembers(p, psize);
-  uint32_t totalSize = p - reinterpret_cast<uint8_t*>(out);
-  serializeHeader(reinterpret_cast<uint8_t*>(out), totalSize);
-  return totalSize;
-}
-
-void Caps::serializeHeader(uint8_t* out, uint32_t size) const {
-  size = htonl(size);
-  memcpy(out, &size, sizeof(size));
-  out[sizeof(size)] = CAPS_VERSION;
-}
-
-uint8_t* Caps::serializeMemberDesc(uint8_t* out, uint32_t size) const {
-  auto p = uleb128Write((uint32_t)members.size(), out, size);
-  auto psize = size - (p - out);
-  if (psize < members.size())
+  uint32_t r;
+  switch (trySerialize(out, size, r, flags)) {
+  case CAPS_SUCCESS:
+    break;
+  case CAPS_ERR_INVALID_PARAM:
+    throwException<invalid_argument>("invalid serialize flags 0x%x", flags);
+  case CAPS_ERR_INSUFFICIENT_BUFFER:
     throw out_of_range("out buffer size too small");
+  default:
+    // 投影解析未选择的成员
+    throw range_error("absent member can not be serialized");
+  }
+  return r;
+}
+
+int32_t Caps::trySerialize(void* out, uint32_t size, uint32_t& result,
+    uint32_t flags) const noexcept {
+  result = 0;
+  if (out == nullptr || (flags & ~(CAPS_FLAG_CRC32C | CAPS_FLAG_FIXED_INT)))
+    return CAPS_ERR_INVALID_PARAM;
+  CAPS_STATS_START(start);
+  auto b = reinterpret_cast<uint8_t*>(out);
+  auto p = b;
+  auto r = doSerialize(b, p, b + size, flags);
+  result = p - b;
+  CAPS_STATS_SERIALIZE(start, result);
+  return r;
+}
+
+int32_t Caps::doSerialize(uint8_t* out, uint8_t*& p, const uint8_t* end,
+    uint32_t flags) const {
+  uint32_t trailer = flags & CAPS_FLAG_CRC32C ? CRC_SIZE : 0;
+  if (end - p <= HEADER_SIZE + trailer)
+    return CAPS_ERR_INSUFFICIENT_BUFFER;
+  end -= trailer;
+  auto fixed = flags & CAPS_FLAG_FIXED_INT;
+  auto cached = cachedBinary(fixed);
+  if (cached) {
+    if (end - p < (uint32_t)cached->size())
+      return CAPS_ERR_INSUFFICIENT_BUFFER;
+    memcpy(p, cached->data(), cached->size());
+    p += cached->size();
+  } else {
+    p += HEADER_SIZE;
+    auto r = serializeMemberDesc(p, end);
+    if (r != CAPS_SUCCESS)
+      return r;
+    r = serializeMembers(p, end, fixed);
+    if (r != CAPS_SUCCESS)
+      return r;
+    serializeHeader(out, p - out, fixed);
+    if (p - out <= serializeCacheLimit)
+      storeCachedBinary(out, p - out);
+  }
+  if (trailer) {
+    serializeHeader(out, p - out + trailer, flags);
+    // 刚写入的数据仍在cache中, 硬件crc32c的开销远小于编码本身
+    leWriteUint32(crc32c(0, out, p - out), p);
+    p += trailer;
+  }
+  return CAPS_SUCCESS;
+}
+
+void Caps::serializeHeader(uint8_t* out, uint32_t size, uint32_t flags) const {
+  beWriteUint32(size, out);
+  out[sizeof(size)] = CAPS_VERSION | flags;
+}
+
+int32_t Caps::serializeMemberDesc(uint8_t*& p, const uint8_t* end) const {
+  auto np = uleb128TryWrite((uint32_t)members.size(), p, end - p);
+  if (np == nullptr)
+    return CAPS_ERR_INSUFFICIENT_BUFFER;
+  p = np;
+  if (end - p < (uint32_t)members.size())
+    return CAPS_ERR_INSUFFICIENT_BUFFER;
   for_each(members.begin(), members.end(), [&p](const MemberPointer& member) {
     p[0] = member->type();
     ++p;
   });
-  return p;
+  return CAPS_SUCCESS;
 }
 
-static void leWriteFloat(float v, uint8_t* out) {
-  uint32_t n = *(uint32_t*)(&v);
-  out[0] = n;
-  out[1] = n >> 8;
-  out[2] = n >> 16;
-  out[3] = n >> 24;
+// 定长整数与leb128整数编码
+template <typename T>
+static uint8_t* fixedTryWrite(T v, uint8_t* out, uint32_t size) {
+  if (size < sizeof(T))
+    return nullptr;
+  if (sizeof(T) == sizeof(uint32_t))
+    leWriteUint32(v, out);
+  else
+    leWriteUint64(v, out);
+  return out + sizeof(T);
 }
 
-static void leWriteDouble(double v, uint8_t* out) {
-  uint64_t n = *(uint64_t*)(&v);
-  out[0] = n;
-  out[1] = n >> 8;
-  out[2] = n >> 16;
-  out[3] = n >> 24;
-  out[4] = n >> 32;
-  out[5] = n >> 40;
-  out[6] = n >> 48;
-  out[7] = n >> 56;
+template <typename T>
+static uint8_t* intTryWrite(T v, uint8_t* out, uint32_t size, bool fixed) {
+  if (fixed)
+    return fixedTryWrite(v, out, size);
+  return leb128TryWrite(v, out, size);
 }
 
-uint8_t* Caps::serializeMembers(uint8_t* out, uint32_t size) const {
-  auto p = out;
-  for_each(members.begin(), members.end(),
-      [&p, out, size](const MemberPointer& member) {
-    auto psize = size - (p - out);
+template <typename T>
+static uint8_t* uintTryWrite(T v, uint8_t* out, uint32_t size, bool fixed) {
+  if (fixed)
+    return fixedTryWrite(v, out, size);
+  return uleb128TryWrite(v, out, size);
+}
+
+int32_t Caps::serializeMembers(uint8_t*& p, const uint8_t* end,
+    uint32_t flags) const {
+  bool fixed = flags & CAPS_FLAG_FIXED_INT;
+  uint8_t* np{nullptr};
+  for (auto it = members.begin(); it != members.end(); ++it) {
+    auto member = it->get();
     switch (member->type()) {
     case CAPS_MEMBER_TYPE_INT32:
-      p = leb128Write(static_pointer_cast<Int32Member>(member)->value.number,
-          p, psize);
+      np = intTryWrite(static_cast<Int32Member*>(member)->value.number,
+          p, end - p, fixed);
       break;
     case CAPS_MEMBER_TYPE_UINT32:
-      p = uleb128Write(static_pointer_cast<Uint32Member>(member)->value.number,
-          p, psize);
+      np = uintTryWrite(static_cast<Uint32Member*>(member)->value.number,
+          p, end - p, fixed);
       break;
     case CAPS_MEMBER_TYPE_INT64:
-      p = leb128Write(static_pointer_cast<Int64Member>(member)->value.number,
-          p, psize);
+      np = intTryWrite(static_cast<Int64Member*>(member)->value.number,
+          p, end - p, fixed);
       break;
     case CAPS_MEMBER_TYPE_UINT64:
-      p = uleb128Write(static_pointer_cast<Uint64Member>(member)->value.number,
-          p, psize);
+      np = uintTryWrite(static_cast<Uint64Member*>(member)->value.number,
+          p, end - p, fixed);
       break;
     case CAPS_MEMBER_TYPE_FLOAT:
-      if (psize < sizeof(float))
-        throw out_of_range("out buffer size too small");
-      leWriteFloat(static_pointer_cast<FloatMember>(member)->value.number, p);
-      p += sizeof(float);
+      if (end - p < (uint32_t)sizeof(float))
+        return CAPS_ERR_INSUFFICIENT_BUFFER;
+      leWriteFloat(static_cast<FloatMember*>(member)->value.number, p);
+      np = p + sizeof(float);
       break;
     case CAPS_MEMBER_TYPE_DOUBLE:
-      if (psize < sizeof(double))
-        throw out_of_range("out buffer size too small");
-      leWriteDouble(static_pointer_cast<DoubleMember>(member)->value.number, p);
-      p += sizeof(double);
+      if (end - p < (uint32_t)sizeof(double))
+        return CAPS_ERR_INSUFFICIENT_BUFFER;
+      leWriteDouble(static_cast<DoubleMember*>(member)->value.number, p);
+      np = p + sizeof(double);
       break;
     case CAPS_MEMBER_TYPE_STRING:
     case CAPS_MEMBER_TYPE_BINARY: {
-      auto m = static_pointer_cast<StringMember>(member);
-      uint32_t dataSize = m->data.length();
-      p = uleb128Write(dataSize, p, psize);
-      psize = size - (p - out);
-      if (psize < dataSize)
-        throw out_of_range("out buffer size too small");
-      memcpy(p, m->data.data(), dataSize);
-      p += dataSize;
+      auto m = static_cast<BytesMember*>(member);
+      uint32_t dataSize = m->length();
+      np = uintTryWrite(dataSize, p, end - p, fixed);
+      if (np == nullptr)
+        return CAPS_ERR_INSUFFICIENT_BUFFER;
+      p = np;
+      if (end - p < dataSize)
+        return CAPS_ERR_INSUFFICIENT_BUFFER;
+      memcpy(p, m->ptr(), dataSize);
+      np = p + dataSize;
       break;
     }
-    case CAPS_MEMBER_TYPE_OBJECT:
-      p += static_pointer_cast<ObjectMember>(member)->value.serialize(p, psize);
-      break;
+    case CAPS_MEMBER_TYPE_OBJECT: {
+      CAPS_STATS_ENTER_OBJECT();
+      auto r = static_cast<ObjectMember*>(member)->value.doSerialize(p, p, end,
+          flags);
+      CAPS_STATS_LEAVE_OBJECT();
+      if (r != CAPS_SUCCESS)
+        return r;
+      continue;
+    }
     case CAPS_MEMBER_TYPE_VOID:
-      break;
+      continue;
     default:
-      throwException<range_error>("unknown member type '%c'", member->type());
+      return CAPS_ERR_CORRUPTED;
     }
-  });
-  return p;
+    if (np == nullptr)
+      return CAPS_ERR_INSUFFICIENT_BUFFER;
+    p = np;
+  }
+  return CAPS_SUCCESS;
 }
 
-static uint32_t beReadUint32(const uint8_t* in) {
-  uint32_t v;
-  v = in[3];
-  v |= in[2] << 8;
-  v |= in[1] << 16;
-  v |= in[0] << 24;
-  return v;
-}
+struct Caps::SerializeCache {
+  // 不含CRC32C校验, header中的版本字节记录CAPS_FLAG_FIXED_INT选项
+  shared_ptr<const string> data;
+};
 
-void Caps::parse(const void* in, uint32_t size) {
-  if (in == nullptr || size <= HEADER_SIZE)
-    throw invalid_argument("'in' is nullptr or size too small");
-  uint32_t totalSize;
-  auto p = reinterpret_cast<const uint8_t*>(in);
-  parseHeader(p, totalSize);
-  if (totalSize != size)
-    throwException<invalid_argument>("incorrect size, expect %u, actual %u",
-        totalSize, size);
-  uint32_t off = HEADER_SIZE;
-  // uint32_t curSize = p - reinterpret_cast<const uint8_t*>(in);
-  uint32_t descLen;
-  off += uleb128Read(p + off, size - off, descLen);
-  auto desc = p + off;
-  off += descLen;
-  if (off > size)
-    throw domain_error("input data may corrupted");
-  clearMembers();
-  parseMembers(p + off, size - off, desc, descLen);
+void Caps::setParseMaxDepth(uint32_t depth) {
+  parseMaxDepth = depth ? depth : 1;
 }
 
-const uint8_t* Caps::parseHeader(const uint8_t* p, uint32_t& totalSize) {
-  totalSize = beReadUint32(p);
-  p += sizeof(uint32_t);
-  auto version = p[0];
-  if (version != CAPS_VERSION)
-    throwException<domain_error>("incorrect caps version, expect %u, actual %u",
-        CAPS_VERSION, version);
-  ++p;
-  return p;
+void Caps::setSerializeCache(uint32_t maxSize) {
+  serializeCacheLimit = maxSize;
+  if (maxSize == 0)
+    atomic_store(&serializeCache, shared_ptr<SerializeCache>());
+  else if (atomic_load(&serializeCache) == nullptr)
+    atomic_store(&serializeCache, make_shared<SerializeCache>());
 }
 
-static float leReadFloat(const uint8_t* in) {
-  union {
-    float f;
-    uint32_t i;
-  } r;
-  r.i = in[0];
-  r.i |= in[1] << 8;
-  r.i |= in[2] << 16;
-  r.i |= in[3] << 24;
-  return r.f;
+shared_ptr<const string> Caps::cachedBinary(uint32_t flags) const {
+  if (serializeCacheLimit == 0)
+    return nullptr;
+  auto cache = atomic_load(&serializeCache);
+  if (cache == nullptr)
+    return nullptr;
+  auto data = atomic_load(&cache->data);
+  if (data && (data->at(sizeof(uint32_t)) & CAPS_FLAG_FIXED_INT)
+      == (flags & CAPS_FLAG_FIXED_INT))
+    return data;
+  return nullptr;
 }
 
-static double leReadDouble(const uint8_t* in) {
-  union {
-    double f;
-    uint32_t i[2];
-  } r;
-  r.i[0] = in[0];
-  r.i[0] |= in[1] << 8;
-  r.i[0] |= in[2] << 16;
-  r.i[0] |= in[3] << 24;
-  r.i[1] = in[4];
-  r.i[1] |= in[5] << 8;
-  r.i[1] |= in[6] << 16;
-  r.i[1] |= in[7] << 24;
-  return r.f;
-}
-
-void Caps::parseMembers(const uint8_t* in, uint32_t psize,
-    const uint8_t* desc, uint32_t descLen) {
-  uint32_t i;
-  uint32_t off{0};
-  for (i = 0; i < descLen; ++i) {
-    switch (desc[i]) {
-    case CAPS_MEMBER_TYPE_INT32: {
-      int32_t v;
-      off += leb128Read(in + off, psize - off, v);
-      members.push_back(make_shared<Int32Member>(v));
-      break;
-    }
-    case CAPS_MEMBER_TYPE_INT64: {
-      int64_t v;
-      off += leb128Read(in + off, psize - off, v);
-      members.push_back(make_shared<Int64Member>(v));
+void Caps::storeCachedBinary(const uint8_t* data, uint32_t size) const {
+  auto cache = atomic_load(&serializeCache);
+  if (cache == nullptr) {
+    cache = make_shared<SerializeCache>();
+    atomic_store(&serializeCache, cache);
+  }
+  shared_ptr<const string> d = make_shared<string>(
+      reinterpret_cast<const char*>(data), size);
+  atomic_store(&cache->data, d);
+}
+
+uint32_t Caps::binarySize(uint32_t flags) const {
+  auto cached = cachedBinary(flags);
+  if (cached)
+    return cached->size() + (flags & CAPS_FLAG_CRC32C ? CRC_SIZE : 0);
+  uint32_t r = HEADER_SIZE + uleb128Size((uint32_t)members.size()) + members.size();
+  if (flags & CAPS_FLAG_CRC32C)
+    r += CRC_SIZE;
+  flags &= CAPS_FLAG_FIXED_INT;
+  bool fixed = flags;
+  for_each(members.begin(), members.end(), [&r, flags, fixed](const MemberPointer& m) {
+    auto member = m.get();
+    switch (member->type()) {
+    case CAPS_MEMBER_TYPE_INT32:
+      r += fixed ? sizeof(int32_t)
+        : leb128Size(static_cast<Int32Member*>(member)->value.number);
       break;
-    }
-    case CAPS_MEMBER_TYPE_UINT32: {
-      uint32_t v;
-      off += uleb128Read(in + off, psize - off, v);
-      members.push_back(make_shared<Uint32Member>(v));
+    case CAPS_MEMBER_TYPE_UINT32:
+      r += fixed ? sizeof(uint32_t)
+        : uleb128Size(static_cast<Uint32Member*>(member)->value.number);
       break;
-    }
-    case CAPS_MEMBER_TYPE_UINT64: {
-      uint64_t v;
-      off += uleb128Read(in + off, psize - off, v);
-      members.push_back(make_shared<Uint64Member>(v));
+    case CAPS_MEMBER_TYPE_INT64:
+      r += fixed ? sizeof(int64_t)
+        : leb128Size(static_cast<Int64Member*>(member)->value.number);
       break;
-    }
-    case CAPS_MEMBER_TYPE_FLOAT: {
-      float v;
-      if (psize - off < sizeof(float))
-        throwException<domain_error>("input data may corrupted");
-      v = leReadFloat(in + off);
-      members.push_back(make_shared<FloatMember>(v));
-      off += sizeof(float);
+    case CAPS_MEMBER_TYPE_UINT64:
+      r += fixed ? sizeof(uint64_t)
+        : uleb128Size(static_cast<Uint64Member*>(member)->value.number);
       break;
-    }
-    case CAPS_MEMBER_TYPE_DOUBLE: {
-      double v;
-      if (psize - off < sizeof(double))
-        throwException<domain_error>("input data may corrupted");
-      v = leReadDouble(in + off);
-      members.push_back(make_shared<DoubleMember>(v));
-      off += sizeof(double);
+    case CAPS_MEMBER_TYPE_FLOAT:
+      r += sizeof(float);
       break;
-    }
-    case CAPS_MEMBER_TYPE_STRING: {
-      uint32_t v;
-      off += uleb128Read(in + off, psize - off, v);
-      if (psize - off < v)
-        throwException<domain_error>("input data may corrupted");
-      members.push_back(make_shared<StringMember>(in + off, v));
-      off += v;
+    case CAPS_MEMBER_TYPE_DOUBLE:
+      r += sizeof(double);
       break;
-    }
+    case CAPS_MEMBER_TYPE_STRING:
     case CAPS_MEMBER_TYPE_BINARY: {
-      uint32_t v;
-      off += uleb128Read(in + off, psize - off, v);
-      if (psize - off < v)
-        throwException<domain_error>("input data may corrupted");
-      members.push_back(make_shared<BinaryMember>(in + off, v));
-      off += v;
+      uint32_t dataSize = static_cast<BytesMember*>(member)->length();
+      r += (fixed ? sizeof(uint32_t) : uleb128Size(dataSize)) + dataSize;
       break;
     }
-    case CAPS_MEMBER_TYPE_OBJECT: {
-      if (psize - off < sizeof(uint32_t))
-        throwException<domain_error>("input data may corrupted");
-      auto sz = beReadUint32(in + off);
-      if (off + sz > psize)
-        throwException<domain_error>("input data may corrupted");
-      members.push_back(make_shared<ObjectMember>(in + off, sz));
-      off += sz;
+    case CAPS_MEMBER_TYPE_OBJECT:
+      r += static_cast<ObjectMember*>(member)->value.binarySize(flags);
       break;
     }
-    case CAPS_MEMBER_TYPE_VOID:
-      members.push_back(make_shared<VoidMember>());
+  });
+  return r;
+}
+
+Caps::Projection::Projection(initializer_list<const char*> paths) {
+  for_each(paths.begin(), paths.end(), [this](const char* path) {
+    add(path);
+  });
+}
+
+void Caps::Projection::reserve(uint32_t index) {
+  if (index > CAPS_PROJECTION_MAX_INDEX)
+    throwException<invalid_argument>("projection index %u exceeds %u", index,
+        CAPS_PROJECTION_MAX_INDEX);
+  if (index >= selected.size()) {
+    selected.resize(index + 1, 0);
+    children.resize(index + 1);
+  }
+}
+
+Caps::Projection& Caps::Projection::add(uint32_t index) {
+  reserve(index);
+  selected[index] = 1;
+  children[index].reset();
+  return *this;
+}
+
+Caps::Projection& Caps::Projection::add(const char* path) {
+  if (path == nullptr)
+    throw invalid_argument("projection path is nullptr");
+  char* end;
+  if (*path < '0' || *path > '9')
+    throwException<invalid_argument>("invalid projection path '%s'", path);
+  auto index = strtoul(path, &end, 10);
+  if (index >= UINT32_MAX)
+    throwException<invalid_argument>("invalid projection path '%s'", path);
+  if (*end == '\0')
+    return add(index);
+  if (*end != '.')
+    throwException<invalid_argument>("invalid projection path '%s'", path);
+  return add(index, end + 1);
+}
+
+Caps::Projection& Caps::Projection::add(uint32_t index, const char* sub) {
+  reserve(index);
+  // 已完整选择
+  if (selected[index] == 1)
+    return *this;
+  if (children[index] == nullptr)
+    children[index] = make_shared<Projection>();
+  children[index]->add(sub);
+  selected[index] = 2;
+  return *this;
+}
+
+static void throwParseError(int32_t r, const void* in, uint32_t size,
+    uint32_t off) {
+  switch (r) {
+  case CAPS_ERR_INVALID_PARAM:
+    if (in == nullptr || size <= HEADER_SIZE)
+      throw invalid_argument("'in' is nullptr or size too small");
+    throwException<invalid_argument>("incorrect size, expect %u, actual %u",
+        Caps::getBinarySize(in, size), size);
+  case CAPS_ERR_VERSION:
+    throwException<domain_error>("incorrect caps version, expect %u, actual %u",
+        CAPS_VERSION, reinterpret_cast<const uint8_t*>(in)[off]);
+  case CAPS_ERR_TRUNCATED:
+    throwException<out_of_range>("input data size not enough, offset %u", off);
+  case CAPS_ERR_OVERFLOW:
+    throwException<length_error>("input data corrupted, offset %u", off);
+  case CAPS_ERR_CHECKSUM:
+    throw domain_error("input data crc32c checksum mismatch");
+  case CAPS_ERR_TOO_DEEP:
+    throwException<domain_error>("input data nested too deep, offset %u", off);
+  default:
+    throwException<domain_error>("input data may corrupted, offset %u", off);
+  }
+}
+
+void Caps::parse(const void* in, uint32_t size) {
+  uint32_t off{0};
+  auto r = doTryParse(in, size, nullptr, nullptr, &off);
+  if (r != CAPS_SUCCESS)
+    throwParseError(r, in, size, off);
+}
+
+void Caps::parse(const void* in, uint32_t size, const Projection& proj) {
+  uint32_t off{0};
+  auto r = doTryParse(in, size, &proj, nullptr, &off);
+  if (r != CAPS_SUCCESS)
+    throwParseError(r, in, size, off);
+}
+
+void Caps::parseBorrowed(const void* in, uint32_t size,
+    shared_ptr<const void> owner) {
+  if (owner == nullptr)
+    throw invalid_argument("owner is nullptr");
+  uint32_t off{0};
+  auto r = doTryParse(in, size, nullptr, &owner, &off);
+  if (r != CAPS_SUCCESS)
+    throwParseError(r, in, size, off);
+}
+
+int32_t Caps::tryParse(const void* in, uint32_t size, uint32_t* errOffset) {
+  return doTryParse(in, size, nullptr, nullptr, errOffset);
+}
+
+int32_t Caps::tryParse(const void* in, uint32_t size, const Projection& proj,
+    uint32_t* errOffset) {
+  return doTryParse(in, size, &proj, nullptr, errOffset);
+}
+
+int32_t Caps::tryParseBorrowed(const void* in, uint32_t size,
+    shared_ptr<const void> owner, uint32_t* errOffset) {
+  if (owner == nullptr) {
+    clearMembers();
+    if (errOffset)
+      *errOffset = 0;
+    return CAPS_ERR_INVALID_PARAM;
+  }
+  return doTryParse(in, size, nullptr, &owner, errOffset);
+}
+
+int32_t Caps::doTryParse(const void* in, uint32_t size, const Projection* proj,
+    const shared_ptr<const void>* owner, uint32_t* errOffset) {
+  CAPS_STATS_START(start);
+  uint32_t off{0};
+  auto r = doParse(reinterpret_cast<const uint8_t*>(in), size, off, proj,
+      owner);
+  CAPS_STATS_PARSE(start, size, r == CAPS_SUCCESS);
+  if (r != CAPS_SUCCESS) {
+    clearMembers();
+    if (errOffset)
+      *errOffset = off;
+  }
+  return r;
+}
+
+// leb128TryRead失败原因, 参考leb128ThrowReadError
+template <typename R>
+static int32_t leb128ReadError(uint32_t size) {
+  if (size < (sizeof(R) == 4 ? LEB128_MAX_INT32_BYTES : LEB128_MAX_INT64_BYTES))
+    return CAPS_ERR_TRUNCATED;
+  return CAPS_ERR_OVERFLOW;
+}
+
+template <typename T>
+static uint32_t fixedTryRead(const uint8_t* in, uint32_t size, T& v) {
+  if (size < sizeof(T))
+    return 0;
+  if (sizeof(T) == sizeof(uint32_t))
+    v = leReadUint32(in);
+  else
+    v = leReadUint64(in);
+  return sizeof(T);
+}
+
+template <typename T>
+static uint32_t intTryRead(const uint8_t* in, uint32_t size, T& v, bool fixed) {
+  if (fixed)
+    return fixedTryRead(in, size, v);
+  return leb128TryRead(in, size, v);
+}
+
+template <typename T>
+static uint32_t uintTryRead(const uint8_t* in, uint32_t size, T& v, bool fixed) {
+  if (fixed)
+    return fixedTryRead(in, size, v);
+  return uleb128TryRead(in, size, v);
+}
+
+template <typename R>
+static int32_t intReadError(uint32_t size, bool fixed) {
+  if (fixed)
+    return CAPS_ERR_TRUNCATED;
+  return leb128ReadError<R>(size);
+}
+
+// 复用独占且类型相同的成员(及其string容量), 否则创建新成员
+template <typename M>
+static M* recycleMember(MemberPointer& m, char type) {
+  if (m == nullptr || m.use_count() != 1 || m->type() != type)
+    m = make_shared<M>();
+  return static_cast<M*>(m.get());
+}
+
+// 投影解析未选择的成员共享同一个实例, 不分配内存
+static const MemberPointer& absentMember() {
+  static MemberPointer absent = make_shared<AbsentMember>();
+  return absent;
+}
+
+// 按长度跳过成员, 不复制数据
+static int32_t skipMember(const uint8_t* in, uint32_t size, char type,
+    bool fixed, uint32_t& off) {
+  uint32_t c;
+  switch (type) {
+  case CAPS_MEMBER_TYPE_INT32: {
+    int32_t v;
+    c = intTryRead(in + off, size - off, v, fixed);
+    if (c == 0)
+      return intReadError<int32_t>(size - off, fixed);
+    break;
+  }
+  case CAPS_MEMBER_TYPE_INT64: {
+    int64_t v;
+    c = intTryRead(in + off, size - off, v, fixed);
+    if (c == 0)
+      return intReadError<int64_t>(size - off, fixed);
+    break;
+  }
+  case CAPS_MEMBER_TYPE_UINT32: {
+    uint32_t v;
+    c = uintTryRead(in + off, size - off, v, fixed);
+    if (c == 0)
+      return intReadError<uint32_t>(size - off, fixed);
+    break;
+  }
+  case CAPS_MEMBER_TYPE_UINT64: {
+    uint64_t v;
+    c = uintTryRead(in + off, size - off, v, fixed);
+    if (c == 0)
+      return intReadError<uint64_t>(size - off, fixed);
+    break;
+  }
+  case CAPS_MEMBER_TYPE_FLOAT:
+    c = sizeof(float);
+    break;
+  case CAPS_MEMBER_TYPE_DOUBLE:
+    c = sizeof(double);
+    break;
+  case CAPS_MEMBER_TYPE_STRING:
+  case CAPS_MEMBER_TYPE_BINARY: {
+    uint32_t v;
+    c = uintTryRead(in + off, size - off, v, fixed);
+    if (c == 0)
+      return intReadError<uint32_t>(size - off, fixed);
+    if (size - off - c < v)
+      return CAPS_ERR_CORRUPTED;
+    c += v;
+    break;
+  }
+  case CAPS_MEMBER_TYPE_OBJECT:
+    if (size - off < HEADER_SIZE)
+      return CAPS_ERR_CORRUPTED;
+    c = beReadUint32(in + off);
+    if (c <= HEADER_SIZE)
+      return CAPS_ERR_CORRUPTED;
+    break;
+  case CAPS_MEMBER_TYPE_VOID:
+    return CAPS_SUCCESS;
+  default:
+    return CAPS_ERR_CORRUPTED;
+  }
+  if (size - off < c)
+    return CAPS_ERR_CORRUPTED;
+  off += c;
+  return CAPS_SUCCESS;
+}
+
+// 解析非Caps成员
+// owner不为nullptr时字符串/二进制数据引用输入buffer, 不复制
+static inline int32_t parseMember(const uint8_t* in, uint32_t size,
+    uint32_t& off, bool fixed, char type, MemberPointer& member,
+    const shared_ptr<const void>* owner) {
+  uint32_t c;
+  switch (type) {
+  case CAPS_MEMBER_TYPE_INT32: {
+    int32_t v;
+    c = intTryRead(in + off, size - off, v, fixed);
+    if (c == 0)
+      return intReadError<int32_t>(size - off, fixed);
+    recycleMember<Int32Member>(member, type)->value.number = v;
+    off += c;
+    break;
+  }
+  case CAPS_MEMBER_TYPE_INT64: {
+    int64_t v;
+    c = intTryRead(in + off, size - off, v, fixed);
+    if (c == 0)
+      return intReadError<int64_t>(size - off, fixed);
+    recycleMember<Int64Member>(member, type)->value.number = v;
+    off += c;
+    break;
+  }
+  case CAPS_MEMBER_TYPE_UINT32: {
+    uint32_t v;
+    c = uintTryRead(in + off, size - off, v, fixed);
+    if (c == 0)
+      return intReadError<uint32_t>(size - off, fixed);
+    recycleMember<Uint32Member>(member, type)->value.number = v;
+    off += c;
+    break;
+  }
+  case CAPS_MEMBER_TYPE_UINT64: {
+    uint64_t v;
+    c = uintTryRead(in + off, size - off, v, fixed);
+    if (c == 0)
+      return intReadError<uint64_t>(size - off, fixed);
+    recycleMember<Uint64Member>(member, type)->value.number = v;
+    off += c;
+    break;
+  }
+  case CAPS_MEMBER_TYPE_FLOAT: {
+    if (size - off < sizeof(float))
+      return CAPS_ERR_CORRUPTED;
+    recycleMember<FloatMember>(member, type)->value.number
+      = leReadFloat(in + off);
+    off += sizeof(float);
+    break;
+  }
+  case CAPS_MEMBER_TYPE_DOUBLE: {
+    if (size - off < sizeof(double))
+      return CAPS_ERR_CORRUPTED;
+    recycleMember<DoubleMember>(member, type)->value.number
+      = leReadDouble(in + off);
+    off += sizeof(double);
+    break;
+  }
+  case CAPS_MEMBER_TYPE_STRING:
+  case CAPS_MEMBER_TYPE_BINARY: {
+    uint32_t v;
+    c = uintTryRead(in + off, size - off, v, fixed);
+    if (c == 0)
+      return intReadError<uint32_t>(size - off, fixed);
+    off += c;
+    if (size - off < v)
+      return CAPS_ERR_CORRUPTED;
+    auto data = reinterpret_cast<const char*>(in + off);
+    BytesMember* m;
+    if (type == CAPS_MEMBER_TYPE_STRING)
+      m = recycleMember<StringMember>(member, type);
+    else
+      m = recycleMember<BinaryMember>(member, type);
+    if (owner)
+      m->borrow(data, v, *owner);
+    else
+      m->assign(data, v);
+    off += v;
+    break;
+  }
+  case CAPS_MEMBER_TYPE_VOID:
+    recycleMember<VoidMember>(member, type);
+    break;
+  default:
+    return CAPS_ERR_CORRUPTED;
+  }
+  return CAPS_SUCCESS;
+}
+
+// 解析栈中一层Caps的状态, off为相对于本层数据开头的偏移
+struct Caps::ParseFrame {
+  Caps* caps;
+  const uint8_t* in;
+  // 不含CRC32C校验数据的长度
+  uint32_t size;
+  uint32_t off;
+  const uint8_t* desc;
+  uint32_t descLen;
+  uint32_t index;
+  bool fixed;
+  const Projection* proj;
+};
+
+// 解析栈保存在函数栈上的层数, 更深的层保存在堆上
+#define PARSE_INLINE_FRAMES 16
+
+// 父层状态栈, 常见的嵌套层数不分配内存
+class ParseStack {
+public:
+  inline uint32_t size() const { return count; }
+
+  void push(const Caps::ParseFrame& f) {
+    if (count < PARSE_INLINE_FRAMES)
+      frames[count] = f;
+    else
+      spill.push_back(f);
+    ++count;
+  }
+
+  void pop(Caps::ParseFrame& f) {
+    --count;
+    if (count < PARSE_INLINE_FRAMES) {
+      f = frames[count];
+    } else {
+      f = spill.back();
+      spill.pop_back();
+    }
+  }
+
+private:
+  Caps::ParseFrame frames[PARSE_INLINE_FRAMES];
+  vector<Caps::ParseFrame> spill;
+  uint32_t count{0};
+};
+
+int32_t Caps::doParse(const uint8_t* in, uint32_t size, uint32_t& off,
+    const Projection* proj, const shared_ptr<const void>* owner) {
+  ParseFrame cur;
+  auto r = beginParse(cur, in, size, proj);
+  if (r != CAPS_SUCCESS) {
+    off = cur.off;
+    return r;
+  }
+  ParseStack stack;
+  for (;;) {
+    // 解析当前层的成员, 遇到嵌套Caps时保存当前层并进入子层
+    while (r == CAPS_SUCCESS && cur.index < cur.descLen) {
+      auto i = cur.index;
+      auto type = cur.desc[i];
+      auto& member = cur.caps->members[i];
+      const Projection* subProj{nullptr};
+      if (cur.proj) {
+        // 之后的成员都未选择, 不必再解析
+        if (i >= cur.proj->selected.size()) {
+          fill(cur.caps->members.begin() + i, cur.caps->members.end(),
+              absentMember());
+          cur.index = cur.descLen;
+          break;
+        }
+        if (cur.proj->selected[i] == 0) {
+          r = skipMember(cur.in, cur.size, type, cur.fixed, cur.off);
+          member = absentMember();
+          ++cur.index;
+          continue;
+        }
+        subProj = cur.proj->children[i].get();
+      }
+      if (type != CAPS_MEMBER_TYPE_OBJECT) {
+        r = parseMember(cur.in, cur.size, cur.off, cur.fixed, type, member,
+            owner);
+        ++cur.index;
+        continue;
+      }
+      if (cur.size - cur.off < sizeof(uint32_t)) {
+        r = CAPS_ERR_CORRUPTED;
+        break;
+      }
+      auto sz = beReadUint32(cur.in + cur.off);
+      if (sz > cur.size - cur.off) {
+        r = CAPS_ERR_CORRUPTED;
+        break;
+      }
+      if (stack.size() + 2 > parseMaxDepth) {
+        r = CAPS_ERR_TOO_DEEP;
+        break;
+      }
+      auto child = &recycleMember<ObjectMember>(member, type)->value;
+      auto childIn = cur.in + cur.off;
+      // 子层解析完成后从下一个成员继续
+      cur.off += sz;
+      ++cur.index;
+      CAPS_STATS_ENTER_OBJECT();
+      stack.push(cur);
+      r = child->beginParse(cur, childIn, sz, subProj);
+      if (r == CAPS_ERR_INVALID_PARAM)
+        r = CAPS_ERR_CORRUPTED;
+    }
+    if (r != CAPS_SUCCESS) {
+      // 未知类型的错误位置为类型描述中的位置
+      if (r == CAPS_ERR_CORRUPTED && cur.index > 0
+          && !Member::isValidType(cur.desc[cur.index - 1]))
+        cur.off = cur.desc + cur.index - 1 - cur.in;
       break;
-    default:
-      throwException<domain_error>("unknown member type %c, input data may corrupted",
-          desc[i]);
     }
+    if (stack.size() == 0) {
+      off = cur.off;
+      return CAPS_SUCCESS;
+    }
+    CAPS_STATS_LEAVE_OBJECT();
+    stack.pop(cur);
   }
+  off = cur.in - in + cur.off;
+#ifdef CAPS_STATS
+  for (auto i = stack.size(); i > 0; --i)
+    CAPS_STATS_LEAVE_OBJECT();
+#endif
+  return r;
+}
+
+int32_t Caps::beginParse(ParseFrame& f, const uint8_t* in, uint32_t size,
+    const Projection* proj) {
+  invalidateCache();
+  f.caps = this;
+  f.in = in;
+  f.off = 0;
+  f.index = 0;
+  if (in == nullptr || size <= HEADER_SIZE)
+    return CAPS_ERR_INVALID_PARAM;
+  auto flags = in[sizeof(uint32_t)] & (CAPS_FLAG_CRC32C | CAPS_FLAG_FIXED_INT);
+  if ((in[sizeof(uint32_t)] & ~flags) != CAPS_VERSION) {
+    f.off = sizeof(uint32_t);
+    return CAPS_ERR_VERSION;
+  }
+  if (beReadUint32(in) != size)
+    return CAPS_ERR_INVALID_PARAM;
+  if (flags & CAPS_FLAG_CRC32C) {
+    if (size <= HEADER_SIZE + CRC_SIZE)
+      return CAPS_ERR_CORRUPTED;
+    size -= CRC_SIZE;
+    if (crc32c(0, in, size) != leReadUint32(in + size)) {
+      f.off = size;
+      return CAPS_ERR_CHECKSUM;
+    }
+  }
+  f.off = HEADER_SIZE;
+  uint32_t descLen;
+  auto c = uleb128TryRead(in + f.off, size - f.off, descLen);
+  if (c == 0)
+    return leb128ReadError<uint32_t>(size - f.off);
+  f.off += c;
+  if (size - f.off < descLen)
+    return CAPS_ERR_CORRUPTED;
+  f.size = size;
+  f.desc = in + f.off;
+  f.descLen = descLen;
+  f.off += descLen;
+  f.fixed = flags & CAPS_FLAG_FIXED_INT;
+  f.proj = proj;
+  members.resize(descLen);
+  return CAPS_SUCCESS;
 }
 
 void Caps::clearMembers() {
   members.clear();
+  invalidateCache();
+}
+
+void Caps::invalidateCache() {
+  hashCached.store(false, memory_order_relaxed);
+  // 缓存与其他副本共享时分离, 未共享时原地清除
+  if (serializeCache == nullptr)
+    return;
+  if (serializeCache.use_count() == 1)
+    atomic_store(&serializeCache->data, shared_ptr<const string>());
+  else
+    atomic_store(&serializeCache, make_shared<SerializeCache>());
+}
+
+void Caps::copyCache(const Caps& o) {
+  auto cached = o.hashCached.load(memory_order_acquire);
+  hashValue.store(o.hashValue.load(memory_order_relaxed), memory_order_relaxed);
+  hashCheck.store(o.hashCheck.load(memory_order_relaxed), memory_order_relaxed);
+  hashCached.store(cached, memory_order_release);
+  serializeCacheLimit = o.serializeCacheLimit;
+  atomic_store(&serializeCache, atomic_load(&o.serializeCache));
 }
 
 Caps::iterator Caps::iterate(uint32_t idx) const {
@@ -393,6 +955,22 @@ Caps::Value Caps::iterator::next() const {
   throw out_of_range("no more member");
 }
 
+Caps::const_iterator Caps::begin() const {
+  const_iterator it;
+  it.cur = members.data();
+  it.last = members.data() + members.size();
+  it.aliveIndicator = aliveIndicator;
+  return it;
+}
+
+Caps::const_iterator Caps::end() const {
+  const_iterator it;
+  it.cur = members.data() + members.size();
+  it.last = it.cur;
+  it.aliveIndicator = aliveIndicator;
+  return it;
+}
+
 bool Caps::empty() const {
   return size() == 0;
 }
@@ -401,6 +979,203 @@ uint32_t Caps::size() const {
   return members.size();
 }
 
+template <typename M>
+static inline bool numberEqual(const Member* a, const Member* b) {
+  return memcmp(static_cast<const M*>(a)->value.data,
+      static_cast<const M*>(b)->value.data,
+      sizeof(static_cast<const M*>(a)->value.data)) == 0;
+}
+
+bool memberEqual(const Member* a, const Member* b) {
+  if (a == b)
+    return true;
+  auto type = a->type();
+  if (type != b->type())
+    return false;
+  return memberDataEqual(a, b, type);
+}
+
+bool memberDataEqual(const Member* a, const Member* b, char type) {
+  switch (type) {
+  case CAPS_MEMBER_TYPE_INT32:
+    return numberEqual<Int32Member>(a, b);
+  case CAPS_MEMBER_TYPE_UINT32:
+    return numberEqual<Uint32Member>(a, b);
+  case CAPS_MEMBER_TYPE_INT64:
+    return numberEqual<Int64Member>(a, b);
+  case CAPS_MEMBER_TYPE_UINT64:
+    return numberEqual<Uint64Member>(a, b);
+  case CAPS_MEMBER_TYPE_FLOAT:
+    return numberEqual<FloatMember>(a, b);
+  case CAPS_MEMBER_TYPE_DOUBLE:
+    return numberEqual<DoubleMember>(a, b);
+  case CAPS_MEMBER_TYPE_STRING:
+  case CAPS_MEMBER_TYPE_BINARY:
+    return static_cast<const BytesMember*>(a)->equals(
+        *static_cast<const BytesMember*>(b));
+  case CAPS_MEMBER_TYPE_OBJECT:
+    return static_cast<const ObjectMember*>(a)->value
+      == static_cast<const ObjectMember*>(b)->value;
+  }
+  return true;
+}
+
+bool Caps::operator == (const Caps& o) const {
+  if (this == &o)
+    return true;
+  if (members.size() != o.members.size())
+    return false;
+  // 双方都缓存了同一seed的哈希时, 哈希不同即不相等
+  if (hashCached.load(memory_order_acquire)
+      && o.hashCached.load(memory_order_acquire)) {
+    auto a = hashValue.load(memory_order_relaxed);
+    auto b = o.hashValue.load(memory_order_relaxed);
+    if (a != b && (a ^ hashCheck.load(memory_order_relaxed))
+        == (b ^ o.hashCheck.load(memory_order_relaxed)))
+      return false;
+  }
+  uint32_t i;
+  for (i = 0; i < members.size(); ++i) {
+    if (!memberEqual(members[i].get(), o.members[i].get()))
+      return false;
+  }
+  return true;
+}
+
+template <typename T>
+static inline uint64_t numberBits(T v) {
+  typename conditional<sizeof(T) == 4, uint32_t, uint64_t>::type r;
+  memcpy(&r, &v, sizeof(r));
+  return r;
+}
+
+// 成员数据转换为参与哈希的64位整数, 参考capsHashMember
+static uint64_t memberHashValue(const Member* m, uint64_t seed) {
+  switch (m->type()) {
+  case CAPS_MEMBER_TYPE_INT32:
+    return numberBits(static_cast<const Int32Member*>(m)->value.number);
+  case CAPS_MEMBER_TYPE_UINT32:
+    return static_cast<const Uint32Member*>(m)->value.number;
+  case CAPS_MEMBER_TYPE_INT64:
+    return static_cast<const Int64Member*>(m)->value.number;
+  case CAPS_MEMBER_TYPE_UINT64:
+    return static_cast<const Uint64Member*>(m)->value.number;
+  case CAPS_MEMBER_TYPE_FLOAT:
+    return numberBits(static_cast<const FloatMember*>(m)->value.number);
+  case CAPS_MEMBER_TYPE_DOUBLE:
+    return numberBits(static_cast<const DoubleMember*>(m)->value.number);
+  case CAPS_MEMBER_TYPE_STRING:
+  case CAPS_MEMBER_TYPE_BINARY: {
+    auto data = static_cast<const BytesMember*>(m);
+    return wyhash(data->ptr(), data->length(), seed);
+  }
+  case CAPS_MEMBER_TYPE_OBJECT:
+    return static_cast<const ObjectMember*>(m)->value.hash(seed);
+  }
+  return 0;
+}
+
+uint64_t Caps::hash(uint64_t seed) const {
+  if (hashCached.load(memory_order_acquire)) {
+    auto v = hashValue.load(memory_order_relaxed);
+    if ((v ^ hashCheck.load(memory_order_relaxed)) == seed)
+      return v;
+  }
+  auto h = capsHashBegin(seed, members.size());
+  for_each(members.begin(), members.end(), [&h, seed](const MemberPointer& m) {
+    h = capsHashMember(h, m->type(), memberHashValue(m.get(), seed));
+  });
+  hashValue.store(h, memory_order_relaxed);
+  hashCheck.store(h ^ seed, memory_order_relaxed);
+  hashCached.store(true, memory_order_release);
+  return h;
+}
+
+// 与Caps::hash结果相同
+class HashVisitor : public CapsVisitor {
+public:
+  explicit HashVisitor(uint64_t s) : seed{s} {
+  }
+
+  void onInt32(int32_t v) {
+    add(CAPS_MEMBER_TYPE_INT32, numberBits(v));
+  }
+
+  void onUint32(uint32_t v) {
+    add(CAPS_MEMBER_TYPE_UINT32, v);
+  }
+
+  void onInt64(int64_t v) {
+    add(CAPS_MEMBER_TYPE_INT64, v);
+  }
+
+  void onUint64(uint64_t v) {
+    add(CAPS_MEMBER_TYPE_UINT64, v);
+  }
+
+  void onFloat(float v) {
+    add(CAPS_MEMBER_TYPE_FLOAT, numberBits(v));
+  }
+
+  void onDouble(double v) {
+    add(CAPS_MEMBER_TYPE_DOUBLE, numberBits(v));
+  }
+
+  void onString(const char* data, uint32_t size) {
+    add(CAPS_MEMBER_TYPE_STRING, wyhash(data, size, seed));
+  }
+
+  void onBinary(const void* data, uint32_t size) {
+    add(CAPS_MEMBER_TYPE_BINARY, wyhash(data, size, seed));
+  }
+
+  void onVoid() {
+    add(CAPS_MEMBER_TYPE_VOID, 0);
+  }
+
+  void onBeginObject(uint32_t count) {
+    levels.push_back(capsHashBegin(seed, count));
+  }
+
+  void onEndObject() {
+    result = levels.back();
+    levels.pop_back();
+    if (!levels.empty())
+      add(CAPS_MEMBER_TYPE_OBJECT, result);
+  }
+
+public:
+  uint64_t result{0};
+
+private:
+  void add(char type, uint64_t v) {
+    levels.back() = capsHashMember(levels.back(), type, v);
+  }
+
+private:
+  uint64_t seed;
+  // 各层未完成的哈希
+  vector<uint64_t> levels;
+};
+
+int32_t Caps::tryHashBinary(const void* in, uint32_t size, uint64_t& result,
+    uint64_t seed, uint32_t* errOffset) {
+  HashVisitor visitor(seed);
+  auto r = CapsVisitor::visit(in, size, visitor, errOffset);
+  if (r == CAPS_SUCCESS)
+    result = visitor.result;
+  return r;
+}
+
+uint64_t Caps::hashBinary(const void* in, uint32_t size, uint64_t seed) {
+  uint32_t off{0};
+  uint64_t result;
+  auto r = tryHashBinary(in, size, result, seed, &off);
+  if (r != CAPS_SUCCESS)
+    throwParseError(r, in, size, off);
+  return result;
+}
+
 uint32_t Caps::dump(char* out, uint32_t size) const {
   if (out == nullptr && size != 0)
     throw invalid_argument("out is nullptr");
@@ -411,6 +1186,10 @@ void Caps::clear() {
   clearMembers();
 }
 
+FrozenCaps Caps::freeze() const {
+  return FrozenCaps(*this);
+}
+
 uint32_t Caps::getBinarySize(const void* in, uint32_t size) {
   if (in == nullptr)
     throwException<invalid_argument>("input data is nullptr");
@@ -419,6 +1198,133 @@ uint32_t Caps::getBinarySize(const void* in, uint32_t size) {
   return beReadUint32(reinterpret_cast<const uint8_t*>(in));
 }
 
+// 查找顶层第i个成员的数据位置, size不含CRC32C校验数据
+static int32_t locateMember(const uint8_t* in, uint32_t& size, uint32_t i,
+    char type, uint32_t& off, uint32_t& flags) {
+  off = 0;
+  if (in == nullptr || size <= HEADER_SIZE || beReadUint32(in) != size)
+    return CAPS_ERR_INVALID_PARAM;
+  flags = in[sizeof(uint32_t)] & (CAPS_FLAG_CRC32C | CAPS_FLAG_FIXED_INT);
+  if ((in[sizeof(uint32_t)] & ~flags) != CAPS_VERSION)
+    return CAPS_ERR_VERSION;
+  if (flags & CAPS_FLAG_CRC32C) {
+    if (size <= HEADER_SIZE + CRC_SIZE)
+      return CAPS_ERR_CORRUPTED;
+    size -= CRC_SIZE;
+  }
+  off = HEADER_SIZE;
+  uint32_t descLen;
+  auto c = uleb128TryRead(in + off, size - off, descLen);
+  if (c == 0)
+    return leb128ReadError<uint32_t>(size - off);
+  off += c;
+  if (size - off < descLen)
+    return CAPS_ERR_CORRUPTED;
+  if (i >= descLen)
+    return CAPS_ERR_OUT_OF_RANGE;
+  if (in[off + i] != type)
+    return CAPS_ERR_TYPE_MISMATCH;
+  auto desc = in + off;
+  off += descLen;
+  uint32_t j;
+  bool fixed = flags & CAPS_FLAG_FIXED_INT;
+  for (j = 0; j < i; ++j) {
+    auto r = skipMember(in, size, desc[j], fixed, off);
+    if (r != CAPS_SUCCESS)
+      return r;
+  }
+  return CAPS_SUCCESS;
+}
+
+// 按原编码长度写入, 返回写入长度, 0: 长度不足
+static uint32_t patchValue(uint8_t* p, uint32_t size, bool /*fixed*/, float v) {
+  if (size < sizeof(v))
+    return 0;
+  leWriteFloat(v, p);
+  return sizeof(v);
+}
+
+static uint32_t patchValue(uint8_t* p, uint32_t size, bool /*fixed*/, double v) {
+  if (size < sizeof(v))
+    return 0;
+  leWriteDouble(v, p);
+  return sizeof(v);
+}
+
+template <typename T>
+static uint32_t patchValue(uint8_t* p, uint32_t size, bool fixed, T v,
+    typename enable_if<is_signed<T>::value>::type* = nullptr) {
+  if (fixed)
+    return fixedTryWrite(v, p, size) ? sizeof(v) : 0;
+  T old;
+  auto c = leb128TryRead(p, size, old);
+  if (c == 0 || !leb128WritePadded(v, p, c))
+    return 0;
+  return c;
+}
+
+template <typename T>
+static uint32_t patchValue(uint8_t* p, uint32_t size, bool fixed, T v,
+    typename enable_if<is_unsigned<T>::value>::type* = nullptr) {
+  if (fixed)
+    return fixedTryWrite(v, p, size) ? sizeof(v) : 0;
+  T old;
+  auto c = uleb128TryRead(p, size, old);
+  if (c == 0 || !uleb128WritePadded(v, p, c))
+    return 0;
+  return c;
+}
+
+template <typename T>
+static int32_t patchMember(void* data, uint32_t size, uint32_t i, char type,
+    T v) {
+  auto in = reinterpret_cast<uint8_t*>(data);
+  uint32_t off, flags;
+  auto r = locateMember(in, size, i, type, off, flags);
+  if (r != CAPS_SUCCESS)
+    return r;
+  uint8_t old[LEB128_MAX_INT64_BYTES];
+  auto n = min((uint32_t)sizeof(old), size - off);
+  memcpy(old, in + off, n);
+  auto c = patchValue(in + off, size - off, flags & CAPS_FLAG_FIXED_INT, v);
+  if (c == 0) {
+    memcpy(in + off, old, n);
+    return CAPS_ERR_INSUFFICIENT_BUFFER;
+  }
+  if (flags & CAPS_FLAG_CRC32C) {
+    uint32_t j;
+    for (j = 0; j < c; ++j)
+      old[j] ^= in[off + j];
+    auto crc = crc32cPatch(leReadUint32(in + size), old, c, size - off - c);
+    leWriteUint32(crc, in + size);
+  }
+  return CAPS_SUCCESS;
+}
+
+int32_t Caps::tryPatch(void* data, uint32_t size, uint32_t i, int32_t v) {
+  return patchMember(data, size, i, CAPS_MEMBER_TYPE_INT32, v);
+}
+
+int32_t Caps::tryPatch(void* data, uint32_t size, uint32_t i, uint32_t v) {
+  return patchMember(data, size, i, CAPS_MEMBER_TYPE_UINT32, v);
+}
+
+int32_t Caps::tryPatch(void* data, uint32_t size, uint32_t i, int64_t v) {
+  return patchMember(data, size, i, CAPS_MEMBER_TYPE_INT64, v);
+}
+
+int32_t Caps::tryPatch(void* data, uint32_t size, uint32_t i, uint64_t v) {
+  return patchMember(data, size, i, CAPS_MEMBER_TYPE_UINT64, v);
+}
+
+int32_t Caps::tryPatch(void* data, uint32_t size, uint32_t i, float v) {
+  return patchMember(data, size, i, CAPS_MEMBER_TYPE_FLOAT, v);
+}
+
+int32_t Caps::tryPatch(void* data, uint32_t size, uint32_t i, double v) {
+  return patchMember(data, size, i, CAPS_MEMBER_TYPE_DOUBLE, v);
+}
+
 static uint32_t outputIndent(char* out, uint32_t size, uint32_t indent) {
   auto p = out;
   auto psize = size;
@@ -464,10 +1370,10 @@ uint32_t Caps::dump(uint32_t indent, char* out, uint32_t size) const {
       c = snprintf(p, psize, "%u: %lfL\n", idx, static_pointer_cast<DoubleMember>(m)->value.number);
       break;
     case CAPS_MEMBER_TYPE_STRING:
-      c = snprintf(p, psize, "%u: \"%s\"\n", idx, static_pointer_cast<StringMember>(m)->data.c_str());
+      c = snprintf(p, psize, "%u: \"%s\"\n", idx, static_pointer_cast<StringMember>(m)->str().c_str());
       break;
     case CAPS_MEMBER_TYPE_BINARY:
-      c = snprintf(p, psize, "%u: binary data %zd bytes\n", idx++, static_pointer_cast<BinaryMember>(m)->data.length());
+      c = snprintf(p, psize, "%u: binary data %zd bytes\n", idx, (size_t)static_pointer_cast<BinaryMember>(m)->length());
       break;
     case CAPS_MEMBER_TYPE_OBJECT:
       c = snprintf(p, psize, "%u: caps\n", idx);
@@ -480,6 +1386,9 @@ uint32_t Caps::dump(uint32_t indent, char* out, uint32_t size) const {
     case CAPS_MEMBER_TYPE_VOID:
       c = snprintf(p, psize, "%u: void\n", idx);
       break;
+    case CAPS_MEMBER_TYPE_ABSENT:
+      c = snprintf(p, psize, "%u: absent\n", idx);
+      break;
     default:
       throwException<domain_error>("unknown member type '%c', caps may corrupted", m->type());
     }
@@ -501,6 +1410,116 @@ Caps::Value Caps::at(uint32_t i) const {
   return members[i];
 }
 
+template <typename M, typename T>
+static int32_t tryGetMember(const vector<MemberPointer>& members, uint32_t i,
+    char type, T& v) {
+  if (i >= members.size())
+    return CAPS_ERR_OUT_OF_RANGE;
+  if (members[i]->type() != type)
+    return CAPS_ERR_TYPE_MISMATCH;
+  v = static_cast<const M*>(members[i].get())->value.number;
+  return CAPS_SUCCESS;
+}
+
+int32_t Caps::tryGet(uint32_t i, bool& v) const noexcept {
+  return tryGetMember<Uint32Member>(members, i, CAPS_MEMBER_TYPE_UINT32, v);
+}
+
+int32_t Caps::tryGet(uint32_t i, int8_t& v) const noexcept {
+  return tryGetMember<Int32Member>(members, i, CAPS_MEMBER_TYPE_INT32, v);
+}
+
+int32_t Caps::tryGet(uint32_t i, uint8_t& v) const noexcept {
+  return tryGetMember<Uint32Member>(members, i, CAPS_MEMBER_TYPE_UINT32, v);
+}
+
+int32_t Caps::tryGet(uint32_t i, int16_t& v) const noexcept {
+  return tryGetMember<Int32Member>(members, i, CAPS_MEMBER_TYPE_INT32, v);
+}
+
+int32_t Caps::tryGet(uint32_t i, uint16_t& v) const noexcept {
+  return tryGetMember<Uint32Member>(members, i, CAPS_MEMBER_TYPE_UINT32, v);
+}
+
+int32_t Caps::tryGet(uint32_t i, int32_t& v) const noexcept {
+  return tryGetMember<Int32Member>(members, i, CAPS_MEMBER_TYPE_INT32, v);
+}
+
+int32_t Caps::tryGet(uint32_t i, uint32_t& v) const noexcept {
+  return tryGetMember<Uint32Member>(members, i, CAPS_MEMBER_TYPE_UINT32, v);
+}
+
+int32_t Caps::tryGet(uint32_t i, int64_t& v) const noexcept {
+  return tryGetMember<Int64Member>(members, i, CAPS_MEMBER_TYPE_INT64, v);
+}
+
+int32_t Caps::tryGet(uint32_t i, uint64_t& v) const noexcept {
+  return tryGetMember<Uint64Member>(members, i, CAPS_MEMBER_TYPE_UINT64, v);
+}
+
+int32_t Caps::tryGet(uint32_t i, float& v) const noexcept {
+  return tryGetMember<FloatMember>(members, i, CAPS_MEMBER_TYPE_FLOAT, v);
+}
+
+int32_t Caps::tryGet(uint32_t i, double& v) const noexcept {
+  return tryGetMember<DoubleMember>(members, i, CAPS_MEMBER_TYPE_DOUBLE, v);
+}
+
+int32_t Caps::tryGet(uint32_t i, const string*& v) const {
+  if (i >= members.size())
+    return CAPS_ERR_OUT_OF_RANGE;
+  if (members[i]->type() != CAPS_MEMBER_TYPE_STRING)
+    return CAPS_ERR_TYPE_MISMATCH;
+  v = &static_cast<const StringMember*>(members[i].get())->str();
+  return CAPS_SUCCESS;
+}
+
+int32_t Caps::tryGet(uint32_t i, const char*& v, uint32_t& length) const noexcept {
+  if (i >= members.size())
+    return CAPS_ERR_OUT_OF_RANGE;
+  if (members[i]->type() != CAPS_MEMBER_TYPE_STRING)
+    return CAPS_ERR_TYPE_MISMATCH;
+  auto m = static_cast<const StringMember*>(members[i].get());
+  v = m->ptr();
+  length = m->length();
+  return CAPS_SUCCESS;
+}
+
+int32_t Caps::tryGet(uint32_t i, const void*& data, uint32_t& size) const noexcept {
+  if (i >= members.size())
+    return CAPS_ERR_OUT_OF_RANGE;
+  if (members[i]->type() != CAPS_MEMBER_TYPE_BINARY)
+    return CAPS_ERR_TYPE_MISMATCH;
+  auto m = static_cast<const BinaryMember*>(members[i].get());
+  data = m->ptr();
+  size = m->length();
+  return CAPS_SUCCESS;
+}
+
+int32_t Caps::tryGet(uint32_t i, const Caps*& v) const noexcept {
+  if (i >= members.size())
+    return CAPS_ERR_OUT_OF_RANGE;
+  if (members[i]->type() != CAPS_MEMBER_TYPE_OBJECT)
+    return CAPS_ERR_TYPE_MISMATCH;
+  v = &static_cast<const ObjectMember*>(members[i].get())->value;
+  return CAPS_SUCCESS;
+}
+
+const char* Caps::getOr(uint32_t i, const char* def) const {
+  const string* v;
+  return tryGet(i, v) == CAPS_SUCCESS ? v->c_str() : def;
+}
+
+const string& Caps::getOr(uint32_t i, const string& def) const {
+  const string* v;
+  return tryGet(i, v) == CAPS_SUCCESS ? *v : def;
+}
+
+const Caps& Caps::getOr(uint32_t i, const Caps& def) const noexcept {
+  const Caps* v;
+  return tryGet(i, v) == CAPS_SUCCESS ? *v : def;
+}
+
 Caps::Value::Value(MemberPointer m) : member{m} {
 }
 
@@ -564,121 +1583,301 @@ Caps::Value::Value(std::initializer_list<Value> list) {
   member = make_shared<ObjectMember>(move(Caps(list)));
 }
 
+template <typename M>
+static const M* memberCast(const Member* m, char type) {
+  if (m->type() != type)
+    throwException<Caps::type_error>("expect %s, but is %s",
+        Member::typeStr(type), Member::typeStr(m->type()));
+  return static_cast<const M*>(m);
+}
+
 Caps::Value::operator bool() const {
-  if (member->type() != CAPS_MEMBER_TYPE_UINT32)
-    throwException<type_error>("expect %s, but is %s",
-        Member::typeStr(CAPS_MEMBER_TYPE_UINT32),
-        Member::typeStr(member->type()));
-  return static_pointer_cast<Int32Member>(member)->value.number;
+  return MemberRef(member.get()).read<bool>();
 }
 
 Caps::Value::operator int8_t() const {
-  if (member->type() != CAPS_MEMBER_TYPE_INT32)
-    throwException<type_error>("expect %s, but is %s",
-        Member::typeStr(CAPS_MEMBER_TYPE_INT32),
-        Member::typeStr(member->type()));
-  return static_pointer_cast<Int32Member>(member)->value.number;
+  return MemberRef(member.get()).read<int8_t>();
 }
 
 Caps::Value::operator uint8_t() const {
-  if (member->type() != CAPS_MEMBER_TYPE_UINT32)
-    throwException<type_error>("expect %s, but is %s",
-        Member::typeStr(CAPS_MEMBER_TYPE_UINT32),
-        Member::typeStr(member->type()));
-  return static_pointer_cast<Int32Member>(member)->value.number;
+  return MemberRef(member.get()).read<uint8_t>();
 }
 
 Caps::Value::operator int16_t() const {
-  if (member->type() != CAPS_MEMBER_TYPE_INT32)
-    throwException<type_error>("expect %s, but is %s",
-        Member::typeStr(CAPS_MEMBER_TYPE_INT32),
-        Member::typeStr(member->type()));
-  return static_pointer_cast<Int32Member>(member)->value.number;
+  return MemberRef(member.get()).read<int16_t>();
 }
 
 Caps::Value::operator uint16_t() const {
-  if (member->type() != CAPS_MEMBER_TYPE_UINT32)
-    throwException<type_error>("expect %s, but is %s",
-        Member::typeStr(CAPS_MEMBER_TYPE_UINT32),
-        Member::typeStr(member->type()));
-  return static_pointer_cast<Int32Member>(member)->value.number;
+  return MemberRef(member.get()).read<uint16_t>();
 }
 
 Caps::Value::operator int32_t() const {
-  if (member->type() != CAPS_MEMBER_TYPE_INT32)
-    throwException<type_error>("expect %s, but is %s",
-        Member::typeStr(CAPS_MEMBER_TYPE_INT32),
-        Member::typeStr(member->type()));
-  return static_pointer_cast<Int32Member>(member)->value.number;
+  return MemberRef(member.get()).read<int32_t>();
 }
 
 Caps::Value::operator uint32_t() const {
-  if (member->type() != CAPS_MEMBER_TYPE_UINT32)
-    throwException<type_error>("expect %s, but is %s",
-        Member::typeStr(CAPS_MEMBER_TYPE_UINT32),
-        Member::typeStr(member->type()));
-  return static_pointer_cast<Uint32Member>(member)->value.number;
+  return MemberRef(member.get()).read<uint32_t>();
 }
 
 Caps::Value::operator int64_t() const {
-  if (member->type() != CAPS_MEMBER_TYPE_INT64)
-    throwException<type_error>("expect %s, but is %s",
-        Member::typeStr(CAPS_MEMBER_TYPE_INT64),
-        Member::typeStr(member->type()));
-  return static_pointer_cast<Int64Member>(member)->value.number;
+  return MemberRef(member.get()).read<int64_t>();
 }
 
 Caps::Value::operator uint64_t() const {
-  if (member->type() != CAPS_MEMBER_TYPE_UINT64)
-    throwException<type_error>("expect %s, but is %s",
-        Member::typeStr(CAPS_MEMBER_TYPE_UINT64),
-        Member::typeStr(member->type()));
-  return static_pointer_cast<Uint64Member>(member)->value.number;
+  return MemberRef(member.get()).read<uint64_t>();
 }
 
 Caps::Value::operator float() const {
-  if (member->type() != CAPS_MEMBER_TYPE_FLOAT)
-    throwException<type_error>("expect %s, but is %s",
-        Member::typeStr(CAPS_MEMBER_TYPE_FLOAT),
-        Member::typeStr(member->type()));
-  return static_pointer_cast<FloatMember>(member)->value.number;
+  return MemberRef(member.get()).read<float>();
 }
 
 Caps::Value::operator double() const {
-  if (member->type() != CAPS_MEMBER_TYPE_DOUBLE)
-    throwException<type_error>("expect %s, but is %s",
-        Member::typeStr(CAPS_MEMBER_TYPE_DOUBLE),
-        Member::typeStr(member->type()));
-  return static_pointer_cast<DoubleMember>(member)->value.number;
+  return MemberRef(member.get()).read<double>();
 }
 
 Caps::Value::operator const string&() const {
-  if (member->type() != CAPS_MEMBER_TYPE_STRING)
-    throwException<type_error>("expect %s, but is %s",
-        Member::typeStr(CAPS_MEMBER_TYPE_STRING),
-        Member::typeStr(member->type()));
-  return static_pointer_cast<StringMember>(member)->data;
+  return memberCast<StringMember>(member.get(), CAPS_MEMBER_TYPE_STRING)->str();
 }
 
 Caps::Value::operator Caps() const {
-  if (member->type() != CAPS_MEMBER_TYPE_OBJECT)
-    throwException<type_error>("expect %s, but is %s",
-        Member::typeStr(CAPS_MEMBER_TYPE_OBJECT),
-        Member::typeStr(member->type()));
-  return static_pointer_cast<ObjectMember>(member)->value;
+  return memberCast<ObjectMember>(member.get(), CAPS_MEMBER_TYPE_OBJECT)->value;
 }
 
 void Caps::Value::get(vector<char>& out) const {
-  if (member->type() != CAPS_MEMBER_TYPE_BINARY)
-    throwException<type_error>("expect %s, but is %s",
-        Member::typeStr(CAPS_MEMBER_TYPE_BINARY),
-        Member::typeStr(member->type()));
-  auto m = static_pointer_cast<BinaryMember>(member);
-  out.assign(m->data.begin(), m->data.end());
+  MemberRef(member.get()).read(out);
 }
 
 char Caps::Value::type() const {
   return member->type();
 }
 
+char Caps::MemberRef::type() const {
+  return member->type();
+}
+
+void Caps::MemberRef::read(bool& v) const {
+  v = memberCast<Uint32Member>(member, CAPS_MEMBER_TYPE_UINT32)->value.number;
+}
+
+void Caps::MemberRef::read(int8_t& v) const {
+  v = memberCast<Int32Member>(member, CAPS_MEMBER_TYPE_INT32)->value.number;
+}
+
+void Caps::MemberRef::read(uint8_t& v) const {
+  v = memberCast<Uint32Member>(member, CAPS_MEMBER_TYPE_UINT32)->value.number;
+}
+
+void Caps::MemberRef::read(int16_t& v) const {
+  v = memberCast<Int32Member>(member, CAPS_MEMBER_TYPE_INT32)->value.number;
+}
+
+void Caps::MemberRef::read(uint16_t& v) const {
+  v = memberCast<Uint32Member>(member, CAPS_MEMBER_TYPE_UINT32)->value.number;
+}
+
+void Caps::MemberRef::read(int32_t& v) const {
+  v = memberCast<Int32Member>(member, CAPS_MEMBER_TYPE_INT32)->value.number;
+}
+
+void Caps::MemberRef::read(uint32_t& v) const {
+  v = memberCast<Uint32Member>(member, CAPS_MEMBER_TYPE_UINT32)->value.number;
+}
+
+void Caps::MemberRef::read(int64_t& v) const {
+  v = memberCast<Int64Member>(member, CAPS_MEMBER_TYPE_INT64)->value.number;
+}
+
+void Caps::MemberRef::read(uint64_t& v) const {
+  v = memberCast<Uint64Member>(member, CAPS_MEMBER_TYPE_UINT64)->value.number;
+}
+
+void Caps::MemberRef::read(float& v) const {
+  v = memberCast<FloatMember>(member, CAPS_MEMBER_TYPE_FLOAT)->value.number;
+}
+
+void Caps::MemberRef::read(double& v) const {
+  v = memberCast<DoubleMember>(member, CAPS_MEMBER_TYPE_DOUBLE)->value.number;
+}
+
+void Caps::MemberRef::read(string& v) const {
+  auto m = memberCast<StringMember>(member, CAPS_MEMBER_TYPE_STRING);
+  v.assign(m->ptr(), m->length());
+}
+
+void Caps::MemberRef::read(vector<char>& v) const {
+  auto m = memberCast<BinaryMember>(member, CAPS_MEMBER_TYPE_BINARY);
+  v.assign(m->ptr(), m->ptr() + m->length());
+}
+
+void Caps::MemberRef::read(Caps& v) const {
+  v = memberCast<ObjectMember>(member, CAPS_MEMBER_TYPE_OBJECT)->value;
+}
+
+struct FrozenCaps::Slot {
+  char type;
+  // string/binary: index of FrozenCaps::Storage::strings
+  // object: index of first child slot
+  uint32_t first;
+  // object: count of child slots
+  uint32_t count;
+  union {
+    int32_t i32;
+    uint32_t u32;
+    int64_t i64;
+    uint64_t u64;
+    float f;
+    double d;
+  } value;
+};
+
+struct FrozenCaps::Storage {
+  vector<Slot> slots;
+  vector<string> strings;
+};
+
+FrozenCaps::FrozenCaps() : storage{nullptr}, first{0}, count{0} {
+}
+
+FrozenCaps::FrozenCaps(const Caps& caps) {
+  auto s = make_shared<Storage>();
+  s->slots.resize(caps.members.size());
+  build(*s, 0, caps.members);
+  owner = s;
+  storage = s.get();
+  first = 0;
+  count = caps.members.size();
+}
+
+// 子对象成员总是放在slots末尾, 每个对象的成员在slots中连续存放
+// 递归过程中slots可能重新分配内存, 只能通过下标访问
+void FrozenCaps::build(Storage& storage, uint32_t first,
+    const vector<MemberPointer>& members) {
+  uint32_t i;
+  for (i = 0; i < members.size(); ++i) {
+    auto& m = members[i];
+    Slot slot;
+    slot.type = m->type();
+    slot.first = 0;
+    slot.count = 0;
+    slot.value.u64 = 0;
+    switch (slot.type) {
+    case CAPS_MEMBER_TYPE_INT32:
+      slot.value.i32 = static_pointer_cast<Int32Member>(m)->value.number;
+      break;
+    case CAPS_MEMBER_TYPE_UINT32:
+      slot.value.u32 = static_pointer_cast<Uint32Member>(m)->value.number;
+      break;
+    case CAPS_MEMBER_TYPE_INT64:
+      slot.value.i64 = static_pointer_cast<Int64Member>(m)->value.number;
+      break;
+    case CAPS_MEMBER_TYPE_UINT64:
+      slot.value.u64 = static_pointer_cast<Uint64Member>(m)->value.number;
+      break;
+    case CAPS_MEMBER_TYPE_FLOAT:
+      slot.value.f = static_pointer_cast<FloatMember>(m)->value.number;
+      break;
+    case CAPS_MEMBER_TYPE_DOUBLE:
+      slot.value.d = static_pointer_cast<DoubleMember>(m)->value.number;
+      break;
+    case CAPS_MEMBER_TYPE_STRING:
+    case CAPS_MEMBER_TYPE_BINARY: {
+      auto data = static_pointer_cast<BytesMember>(m);
+      slot.first = storage.strings.size();
+      storage.strings.emplace_back(data->ptr(), data->length());
+      break;
+    }
+    case CAPS_MEMBER_TYPE_OBJECT: {
+      auto& sub = static_pointer_cast<ObjectMember>(m)->value.members;
+      slot.first = storage.slots.size();
+      slot.count = sub.size();
+      storage.slots.resize(storage.slots.size() + sub.size());
+      storage.slots[first + i] = slot;
+      build(storage, slot.first, sub);
+      continue;
+    }
+    case CAPS_MEMBER_TYPE_VOID:
+    case CAPS_MEMBER_TYPE_ABSENT:
+      break;
+    default:
+      throwException<domain_error>("unknown member type '%c', caps may corrupted", slot.type);
+    }
+    storage.slots[first + i] = slot;
+  }
+}
+
+FrozenCaps::Value FrozenCaps::at(uint32_t i) const {
+  if (i >= count)
+    throwException<out_of_range>("index %u out of range", i);
+  return Value(storage, storage->slots.data() + first + i);
+}
+
+const FrozenCaps::Slot* FrozenCaps::Value::check(char type) const {
+  if (slot->type != type)
+    throwException<Caps::type_error>("expect %s, but is %s",
+        Member::typeStr(type), Member::typeStr(slot->type));
+  return slot;
+}
+
+FrozenCaps::Value::operator bool() const {
+  return check(CAPS_MEMBER_TYPE_UINT32)->value.u32;
+}
+
+FrozenCaps::Value::operator int8_t() const {
+  return check(CAPS_MEMBER_TYPE_INT32)->value.i32;
+}
+
+FrozenCaps::Value::operator uint8_t() const {
+  return check(CAPS_MEMBER_TYPE_UINT32)->value.u32;
+}
+
+FrozenCaps::Value::operator int16_t() const {
+  return check(CAPS_MEMBER_TYPE_INT32)->value.i32;
+}
+
+FrozenCaps::Value::operator uint16_t() const {
+  return check(CAPS_MEMBER_TYPE_UINT32)->value.u32;
+}
+
+FrozenCaps::Value::operator int32_t() const {
+  return check(CAPS_MEMBER_TYPE_INT32)->value.i32;
+}
+
+FrozenCaps::Value::operator uint32_t() const {
+  return check(CAPS_MEMBER_TYPE_UINT32)->value.u32;
+}
+
+FrozenCaps::Value::operator int64_t() const {
+  return check(CAPS_MEMBER_TYPE_INT64)->value.i64;
+}
+
+FrozenCaps::Value::operator uint64_t() const {
+  return check(CAPS_MEMBER_TYPE_UINT64)->value.u64;
+}
+
+FrozenCaps::Value::operator float() const {
+  return check(CAPS_MEMBER_TYPE_FLOAT)->value.f;
+}
+
+FrozenCaps::Value::operator double() const {
+  return check(CAPS_MEMBER_TYPE_DOUBLE)->value.d;
+}
+
+FrozenCaps::Value::operator const string&() const {
+  return storage->strings[check(CAPS_MEMBER_TYPE_STRING)->first];
+}
+
+FrozenCaps::Value::operator FrozenCaps() const {
+  auto s = check(CAPS_MEMBER_TYPE_OBJECT);
+  return FrozenCaps(storage, s->first, s->count);
+}
+
+void FrozenCaps::Value::get(vector<char>& out) const {
+  auto& data = storage->strings[check(CAPS_MEMBER_TYPE_BINARY)->first];
+  out.assign(data.begin(), data.end());
+}
+
+char FrozenCaps::Value::type() const {
+  return slot->type;
+}
+
 } // namespace rokid
@@ -0,0 +1,593 @@
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
+#include "capsbatch.h"
+#include "capsvisitor.h"
+#include "defs.h"
+#include "member.h"
+#include "leb128.h"
+#include "byteorder.h"
+
+using namespace std;
+
+namespace rokid {
+
+// 列编码
+// 定长数值及string/binary/object/void列
+#define BATCH_ENCODING_PLAIN 0
+// 整数列: 与上一行的差值(按64位回绕) zigzag后uleb128编码
+#define BATCH_ENCODING_DELTA 1
+
+static uint32_t fixedWidth(char type) {
+  switch (type) {
+  case CAPS_MEMBER_TYPE_INT32:
+  case CAPS_MEMBER_TYPE_UINT32:
+  case CAPS_MEMBER_TYPE_FLOAT:
+    return 4;
+  case CAPS_MEMBER_TYPE_INT64:
+  case CAPS_MEMBER_TYPE_UINT64:
+  case CAPS_MEMBER_TYPE_DOUBLE:
+    return 8;
+  }
+  return 0;
+}
+
+static bool isIntegerType(char type) {
+  return type == CAPS_MEMBER_TYPE_INT32 || type == CAPS_MEMBER_TYPE_UINT32
+    || type == CAPS_MEMBER_TYPE_INT64 || type == CAPS_MEMBER_TYPE_UINT64;
+}
+
+static bool isDataType(char type) {
+  return type == CAPS_MEMBER_TYPE_STRING || type == CAPS_MEMBER_TYPE_BINARY
+    || type == CAPS_MEMBER_TYPE_OBJECT;
+}
+
+// 数值成员的本机字节序数据
+static const char* numberData(const Member* m) {
+  switch (m->type()) {
+  case CAPS_MEMBER_TYPE_INT32:
+    return static_cast<const Int32Member*>(m)->value.data;
+  case CAPS_MEMBER_TYPE_UINT32:
+    return static_cast<const Uint32Member*>(m)->value.data;
+  case CAPS_MEMBER_TYPE_INT64:
+    return static_cast<const Int64Member*>(m)->value.data;
+  case CAPS_MEMBER_TYPE_UINT64:
+    return static_cast<const Uint64Member*>(m)->value.data;
+  case CAPS_MEMBER_TYPE_FLOAT:
+    return static_cast<const FloatMember*>(m)->value.data;
+  case CAPS_MEMBER_TYPE_DOUBLE:
+    return static_cast<const DoubleMember*>(m)->value.data;
+  }
+  return nullptr;
+}
+
+// 整数列第i行, int32符号扩展, uint32零扩展
+static uint64_t loadInt(char type, const uint8_t* fixed, uint32_t i) {
+  switch (type) {
+  case CAPS_MEMBER_TYPE_INT32: {
+    int32_t v;
+    memcpy(&v, fixed + i * sizeof(v), sizeof(v));
+    return (int64_t)v;
+  }
+  case CAPS_MEMBER_TYPE_UINT32: {
+    uint32_t v;
+    memcpy(&v, fixed + i * sizeof(v), sizeof(v));
+    return v;
+  }
+  }
+  uint64_t v;
+  memcpy(&v, fixed + i * sizeof(v), sizeof(v));
+  return v;
+}
+
+static void storeInt(uint32_t width, uint8_t* fixed, uint32_t i, uint64_t v) {
+  if (width == sizeof(uint32_t)) {
+    uint32_t t = v;
+    memcpy(fixed + i * width, &t, width);
+  } else {
+    memcpy(fixed + i * width, &v, width);
+  }
+}
+
+static inline uint64_t zigzag(uint64_t v) {
+  return (v << 1) ^ (uint64_t)((int64_t)v >> 63);
+}
+
+static inline uint64_t unzigzag(uint64_t v) {
+  return (v >> 1) ^ (~(v & 1) + 1);
+}
+
+CapsBatch::CapsBatch() {
+}
+
+int32_t CapsBatch::tryAppend(const Caps& row) {
+  auto& members = row.members;
+  uint32_t i;
+  for (i = 0; i < members.size(); ++i) {
+    if (!Member::isValidType(members[i]->type()))
+      return CAPS_ERR_INVALID_PARAM;
+  }
+  if (rowCount == 0) {
+    cols.clear();
+    cols.resize(members.size());
+    for (i = 0; i < members.size(); ++i) {
+      cols[i].type = members[i]->type();
+      cols[i].width = fixedWidth(cols[i].type);
+      if (isDataType(cols[i].type))
+        cols[i].offsets.push_back(0);
+    }
+  } else {
+    if (members.size() != cols.size())
+      return CAPS_ERR_TYPE_MISMATCH;
+    for (i = 0; i < members.size(); ++i) {
+      if (members[i]->type() != cols[i].type)
+        return CAPS_ERR_TYPE_MISMATCH;
+    }
+  }
+  int32_t r{CAPS_SUCCESS};
+  for (i = 0; i < members.size() && r == CAPS_SUCCESS; ++i) {
+    auto member = members[i].get();
+    auto& col = cols[i];
+    switch (col.type) {
+    case CAPS_MEMBER_TYPE_STRING:
+    case CAPS_MEMBER_TYPE_BINARY: {
+      auto data = static_cast<const BytesMember*>(member);
+      col.bytes.append(data->ptr(), data->length());
+      col.offsets.push_back(col.bytes.size());
+      break;
+    }
+    case CAPS_MEMBER_TYPE_OBJECT: {
+      auto& value = static_cast<const ObjectMember*>(member)->value;
+      auto size = value.binarySize();
+      auto off = col.bytes.size();
+      col.bytes.resize(off + size);
+      uint32_t c;
+      // 嵌套Caps含有投影解析未选择的成员时失败
+      if (value.trySerialize(&col.bytes[off], size, c) != CAPS_SUCCESS) {
+        r = CAPS_ERR_INVALID_PARAM;
+        break;
+      }
+      col.offsets.push_back(col.bytes.size());
+      break;
+    }
+    case CAPS_MEMBER_TYPE_VOID:
+      break;
+    default: {
+      auto data = reinterpret_cast<const uint8_t*>(numberData(member));
+      col.fixed.insert(col.fixed.end(), data, data + col.width);
+      break;
+    }
+    }
+  }
+  if (r != CAPS_SUCCESS) {
+    // 回退已追加的部分数据
+    for_each(cols.begin(), cols.end(), [this](Column& col) {
+      col.fixed.resize(rowCount * col.width);
+      if (isDataType(col.type)) {
+        col.offsets.resize(rowCount + 1);
+        col.bytes.resize(col.offsets.back());
+      }
+    });
+    if (rowCount == 0)
+      cols.clear();
+    return r;
+  }
+  ++rowCount;
+  return CAPS_SUCCESS;
+}
+
+void CapsBatch::append(const Caps& row) {
+  switch (tryAppend(row)) {
+  case CAPS_SUCCESS:
+    break;
+  case CAPS_ERR_TYPE_MISMATCH:
+    throw invalid_argument("row members not match the first row");
+  default:
+    throw invalid_argument("row contains absent member");
+  }
+}
+
+char CapsBatch::columnType(uint32_t c) const {
+  if (c >= cols.size())
+    throw out_of_range("column index out of range");
+  return cols[c].type;
+}
+
+const CapsBatch::Column& CapsBatch::checkColumn(uint32_t c, char type) const {
+  if (c >= cols.size())
+    throw out_of_range("column index out of range");
+  if (cols[c].type != type)
+    throwException<Caps::type_error>("expect %s, but is %s",
+        Member::typeStr(type), Member::typeStr(cols[c].type));
+  return cols[c];
+}
+
+void CapsBatch::column(uint32_t c, const int32_t*& data) const {
+  data = reinterpret_cast<const int32_t*>(
+      checkColumn(c, CAPS_MEMBER_TYPE_INT32).fixed.data());
+}
+
+void CapsBatch::column(uint32_t c, const uint32_t*& data) const {
+  data = reinterpret_cast<const uint32_t*>(
+      checkColumn(c, CAPS_MEMBER_TYPE_UINT32).fixed.data());
+}
+
+void CapsBatch::column(uint32_t c, const int64_t*& data) const {
+  data = reinterpret_cast<const int64_t*>(
+      checkColumn(c, CAPS_MEMBER_TYPE_INT64).fixed.data());
+}
+
+void CapsBatch::column(uint32_t c, const uint64_t*& data) const {
+  data = reinterpret_cast<const uint64_t*>(
+      checkColumn(c, CAPS_MEMBER_TYPE_UINT64).fixed.data());
+}
+
+void CapsBatch::column(uint32_t c, const float*& data) const {
+  data = reinterpret_cast<const float*>(
+      checkColumn(c, CAPS_MEMBER_TYPE_FLOAT).fixed.data());
+}
+
+void CapsBatch::column(uint32_t c, const double*& data) const {
+  data = reinterpret_cast<const double*>(
+      checkColumn(c, CAPS_MEMBER_TYPE_DOUBLE).fixed.data());
+}
+
+void CapsBatch::cell(uint32_t c, uint32_t i, const void*& data,
+    uint32_t& size) const {
+  if (c >= cols.size())
+    throw out_of_range("column index out of range");
+  auto& col = cols[c];
+  if (!isDataType(col.type))
+    throwException<Caps::type_error>("expect string, binary or object, but is %s",
+        Member::typeStr(col.type));
+  if (i >= rowCount)
+    throw out_of_range("row index out of range");
+  data = col.bytes.data() + col.offsets[i];
+  size = col.offsets[i + 1] - col.offsets[i];
+}
+
+void CapsBatch::row(uint32_t i, Caps& out) const {
+  if (i >= rowCount)
+    throw out_of_range("row index out of range");
+  out.clear();
+  out.members.reserve(cols.size());
+  for_each(cols.begin(), cols.end(), [i, &out](const Column& col) {
+    auto data = col.fixed.data() + i * col.width;
+    const char* bytes{nullptr};
+    uint32_t size{0};
+    if (isDataType(col.type)) {
+      bytes = col.bytes.data() + col.offsets[i];
+      size = col.offsets[i + 1] - col.offsets[i];
+    }
+    MemberPointer m;
+    switch (col.type) {
+    case CAPS_MEMBER_TYPE_INT32: {
+      auto n = make_shared<Int32Member>();
+      memcpy(n->value.data, data, col.width);
+      m = n;
+      break;
+    }
+    case CAPS_MEMBER_TYPE_UINT32: {
+      auto n = make_shared<Uint32Member>();
+      memcpy(n->value.data, data, col.width);
+      m = n;
+      break;
+    }
+    case CAPS_MEMBER_TYPE_INT64: {
+      auto n = make_shared<Int64Member>();
+      memcpy(n->value.data, data, col.width);
+      m = n;
+      break;
+    }
+    case CAPS_MEMBER_TYPE_UINT64: {
+      auto n = make_shared<Uint64Member>();
+      memcpy(n->value.data, data, col.width);
+      m = n;
+      break;
+    }
+    case CAPS_MEMBER_TYPE_FLOAT: {
+      auto n = make_shared<FloatMember>();
+      memcpy(n->value.data, data, col.width);
+      m = n;
+      break;
+    }
+    case CAPS_MEMBER_TYPE_DOUBLE: {
+      auto n = make_shared<DoubleMember>();
+      memcpy(n->value.data, data, col.width);
+      m = n;
+      break;
+    }
+    case CAPS_MEMBER_TYPE_STRING:
+      m = make_shared<StringMember>(bytes, size);
+      break;
+    case CAPS_MEMBER_TYPE_BINARY:
+      m = make_shared<BinaryMember>(bytes, size);
+      break;
+    case CAPS_MEMBER_TYPE_OBJECT: {
+      auto o = make_shared<ObjectMember>();
+      o->value.parse(bytes, size);
+      m = o;
+      break;
+    }
+    default:
+      m = make_shared<VoidMember>();
+      break;
+    }
+    out.members.push_back(m);
+  });
+}
+
+Caps CapsBatch::row(uint32_t i) const {
+  Caps r;
+  row(i, r);
+  return r;
+}
+
+void CapsBatch::clear() {
+  cols.clear();
+  rowCount = 0;
+}
+
+uint32_t CapsBatch::columnSize(const Column& col, uint8_t& encoding) const {
+  encoding = BATCH_ENCODING_PLAIN;
+  if (col.width) {
+    uint32_t plain = rowCount * col.width;
+    if (!isIntegerType(col.type))
+      return plain;
+    uint32_t delta{0};
+    uint64_t prev{0};
+    uint32_t i;
+    for (i = 0; i < rowCount && delta < plain; ++i) {
+      auto v = loadInt(col.type, col.fixed.data(), i);
+      delta += uleb128Size(zigzag(v - prev));
+      prev = v;
+    }
+    if (delta < plain) {
+      encoding = BATCH_ENCODING_DELTA;
+      return delta;
+    }
+    return plain;
+  }
+  if (!isDataType(col.type))
+    return 0;
+  uint32_t r = col.bytes.size();
+  uint32_t i;
+  for (i = 0; i < rowCount; ++i)
+    r += uleb128Size(col.offsets[i + 1] - col.offsets[i]);
+  return r;
+}
+
+uint32_t CapsBatch::binarySize() const {
+  uint32_t r = HEADER_SIZE + uleb128Size(rowCount)
+    + uleb128Size((uint32_t)cols.size()) + cols.size();
+  for_each(cols.begin(), cols.end(), [this, &r](const Column& col) {
+    uint8_t encoding;
+    auto size = columnSize(col, encoding);
+    r += 1 + uleb128Size(size) + size;
+  });
+  return r;
+}
+
+uint32_t CapsBatch::serialize(void* out, uint32_t size) const {
+  if (out == nullptr)
+    throw invalid_argument("out is nullptr");
+  uint32_t r;
+  if (trySerialize(out, size, r) != CAPS_SUCCESS)
+    throw out_of_range("out buffer size too small");
+  return r;
+}
+
+int32_t CapsBatch::trySerialize(void* out, uint32_t size,
+    uint32_t& result) const {
+  result = 0;
+  if (out == nullptr)
+    return CAPS_ERR_INVALID_PARAM;
+  auto total = binarySize();
+  if (size < total)
+    return CAPS_ERR_INSUFFICIENT_BUFFER;
+  auto b = reinterpret_cast<uint8_t*>(out);
+  beWriteUint32(total, b);
+  b[sizeof(uint32_t)] = CAPS_BATCH_VERSION;
+  auto p = b + HEADER_SIZE;
+  auto end = b + total;
+  p = uleb128TryWrite(rowCount, p, end - p);
+  p = uleb128TryWrite((uint32_t)cols.size(), p, end - p);
+  for_each(cols.begin(), cols.end(), [&p](const Column& col) {
+    *p++ = col.type;
+  });
+  for_each(cols.begin(), cols.end(), [this, &p, end](const Column& col) {
+    uint8_t encoding;
+    auto colSize = columnSize(col, encoding);
+    *p++ = encoding;
+    p = uleb128TryWrite(colSize, p, end - p);
+    uint32_t i;
+    if (encoding == BATCH_ENCODING_DELTA) {
+      uint64_t prev{0};
+      for (i = 0; i < rowCount; ++i) {
+        auto v = loadInt(col.type, col.fixed.data(), i);
+        p = uleb128TryWrite(zigzag(v - prev), p, end - p);
+        prev = v;
+      }
+    } else if (col.width) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      for (i = 0; i < rowCount; ++i) {
+        auto v = col.fixed.data() + i * col.width;
+        if (col.width == sizeof(uint32_t)) {
+          uint32_t t;
+          memcpy(&t, v, sizeof(t));
+          leWriteUint32(t, p);
+        } else {
+          uint64_t t;
+          memcpy(&t, v, sizeof(t));
+          leWriteUint64(t, p);
+        }
+        p += col.width;
+      }
+#else
+      memcpy(p, col.fixed.data(), col.fixed.size());
+      p += col.fixed.size();
+#endif
+    } else if (isDataType(col.type)) {
+      for (i = 0; i < rowCount; ++i)
+        p = uleb128TryWrite(col.offsets[i + 1] - col.offsets[i], p, end - p);
+      memcpy(p, col.bytes.data(), col.bytes.size());
+      p += col.bytes.size();
+    }
+  });
+  result = p - b;
+  return CAPS_SUCCESS;
+}
+
+int32_t CapsBatch::parseColumn(Column& col, uint8_t encoding,
+    const uint8_t* in, uint32_t size) {
+  auto p = in;
+  auto end = in + size;
+  uint32_t i, c;
+  if (col.width) {
+    col.fixed.clear();
+    if (encoding == BATCH_ENCODING_DELTA) {
+      if (!isIntegerType(col.type) || size < rowCount)
+        return CAPS_ERR_CORRUPTED;
+      col.fixed.resize((size_t)rowCount * col.width);
+      uint64_t prev{0};
+      uint64_t z;
+      for (i = 0; i < rowCount; ++i) {
+        c = uleb128TryRead(p, end - p, z);
+        if (c == 0)
+          return CAPS_ERR_CORRUPTED;
+        p += c;
+        prev += unzigzag(z);
+        storeInt(col.width, col.fixed.data(), i, prev);
+      }
+      return p == end ? CAPS_SUCCESS : CAPS_ERR_CORRUPTED;
+    }
+    if (encoding != BATCH_ENCODING_PLAIN
+        || (uint64_t)rowCount * col.width != size)
+      return CAPS_ERR_CORRUPTED;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    col.fixed.resize(size);
+    for (i = 0; i < rowCount; ++i) {
+      if (col.width == sizeof(uint32_t))
+        storeInt(col.width, col.fixed.data(), i, leReadUint32(p + i * col.width));
+      else
+        storeInt(col.width, col.fixed.data(), i, leReadUint64(p + i * col.width));
+    }
+#else
+    col.fixed.assign(p, end);
+#endif
+    return CAPS_SUCCESS;
+  }
+  if (encoding != BATCH_ENCODING_PLAIN)
+    return CAPS_ERR_CORRUPTED;
+  if (!isDataType(col.type))
+    return p == end ? CAPS_SUCCESS : CAPS_ERR_CORRUPTED;
+  if (end - p < rowCount)
+    return CAPS_ERR_CORRUPTED;
+  col.offsets.resize(rowCount + 1);
+  col.offsets[0] = 0;
+  uint64_t total{0};
+  for (i = 0; i < rowCount; ++i) {
+    uint32_t len;
+    c = uleb128TryRead(p, end - p, len);
+    if (c == 0)
+      return CAPS_ERR_CORRUPTED;
+    p += c;
+    total += len;
+    if (total > (uint64_t)(end - p))
+      return CAPS_ERR_CORRUPTED;
+    col.offsets[i + 1] = total;
+  }
+  if (total != (uint64_t)(end - p))
+    return CAPS_ERR_CORRUPTED;
+  col.bytes.assign(reinterpret_cast<const char*>(p), total);
+  if (col.type == CAPS_MEMBER_TYPE_OBJECT) {
+    // 提前检查嵌套Caps, 保证row()不会失败
+    CapsVisitor visitor;
+    for (i = 0; i < rowCount; ++i) {
+      auto r = CapsVisitor::visit(col.bytes.data() + col.offsets[i],
+          col.offsets[i + 1] - col.offsets[i], visitor);
+      if (r != CAPS_SUCCESS)
+        return r == CAPS_ERR_INVALID_PARAM ? CAPS_ERR_CORRUPTED : r;
+    }
+  }
+  return CAPS_SUCCESS;
+}
+
+int32_t CapsBatch::doParse(const uint8_t* in, uint32_t size, uint32_t& off) {
+  off = 0;
+  if (in == nullptr || size <= HEADER_SIZE || beReadUint32(in) != size)
+    return CAPS_ERR_INVALID_PARAM;
+  off = sizeof(uint32_t);
+  if (in[off] != CAPS_BATCH_VERSION)
+    return CAPS_ERR_VERSION;
+  off = HEADER_SIZE;
+  uint32_t rows, count;
+  auto c = uleb128TryRead(in + off, size - off, rows);
+  if (c == 0)
+    return CAPS_ERR_TRUNCATED;
+  off += c;
+  c = uleb128TryRead(in + off, size - off, count);
+  if (c == 0)
+    return CAPS_ERR_TRUNCATED;
+  off += c;
+  if (size - off < count)
+    return CAPS_ERR_CORRUPTED;
+  rowCount = rows;
+  cols.resize(count);
+  uint32_t i;
+  for (i = 0; i < count; ++i) {
+    auto& col = cols[i];
+    col.type = in[off];
+    if (!Member::isValidType(col.type))
+      return CAPS_ERR_CORRUPTED;
+    col.width = fixedWidth(col.type);
+    ++off;
+  }
+  for (i = 0; i < count; ++i) {
+    if (size - off < 1)
+      return CAPS_ERR_TRUNCATED;
+    auto encoding = in[off++];
+    uint32_t colSize;
+    c = uleb128TryRead(in + off, size - off, colSize);
+    if (c == 0)
+      return CAPS_ERR_TRUNCATED;
+    off += c;
+    if (size - off < colSize)
+      return CAPS_ERR_TRUNCATED;
+    auto r = parseColumn(cols[i], encoding, in + off, colSize);
+    if (r != CAPS_SUCCESS)
+      return r;
+    off += colSize;
+  }
+  return off == size ? CAPS_SUCCESS : CAPS_ERR_CORRUPTED;
+}
+
+int32_t CapsBatch::tryParse(const void* in, uint32_t size, uint32_t* errOffset) {
+  uint32_t off;
+  auto r = doParse(reinterpret_cast<const uint8_t*>(in), size, off);
+  if (r != CAPS_SUCCESS) {
+    clear();
+    if (errOffset)
+      *errOffset = off;
+  }
+  return r;
+}
+
+void CapsBatch::parse(const void* in, uint32_t size) {
+  uint32_t off{0};
+  switch (tryParse(in, size, &off)) {
+  case CAPS_SUCCESS:
+    break;
+  case CAPS_ERR_INVALID_PARAM:
+    throw invalid_argument("'in' is nullptr or size incorrect");
+  case CAPS_ERR_VERSION:
+    throwException<domain_error>("incorrect caps batch version, expect %u, actual %u",
+        CAPS_BATCH_VERSION, reinterpret_cast<const uint8_t*>(in)[off]);
+  case CAPS_ERR_TRUNCATED:
+    throwException<out_of_range>("input data size not enough, offset %u", off);
+  default:
+    throwException<domain_error>("input data may corrupted, offset %u", off);
+  }
+}
+
+} // namespace rokid
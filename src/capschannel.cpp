@@ -0,0 +1,311 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <chrono>
+#include <system_error>
+#include <algorithm>
+#include "capschannel.h"
+#include "defs.h"
+#include "byteorder.h"
+
+// 发送队列chunk大小, 队列数据达到此大小时尝试写出
+#define CHANNEL_CHUNK_SIZE (64 * 1024)
+// 保留的空闲chunk数
+#define CHANNEL_FREE_CHUNKS 4
+// 单次writev最多的chunk数
+#define CHANNEL_MAX_IOV 64
+
+using namespace std;
+using namespace std::chrono;
+
+namespace rokid {
+
+static void throwSystemError(const char* what) {
+  throw system_error(errno, system_category(), what);
+}
+
+CapsChannel::CapsChannel(int fd, uint32_t maxSend, uint32_t maxRecv)
+  : sockFd{fd}, epollFd{-1}, maxSendBytes{maxSend}, maxRecvBytes{maxRecv} {
+  // 构造失败时同样关闭fd, 调用者在任何情况下都不再持有fd
+  try {
+    auto fl = fcntl(fd, F_GETFL);
+    if (fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0)
+      throwSystemError("set caps channel nonblock failed");
+    int type;
+    socklen_t len = sizeof(type);
+    isSocket = getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == 0;
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0)
+      throwSystemError("create caps channel epoll failed");
+    recvBuf.resize(min(maxRecvBytes, (uint32_t)CHANNEL_CHUNK_SIZE));
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events = EPOLLIN;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+      throwSystemError("add caps channel fd to epoll failed");
+  } catch (...) {
+    if (epollFd >= 0)
+      ::close(epollFd);
+    ::close(sockFd);
+    throw;
+  }
+}
+
+CapsChannel::~CapsChannel() {
+  ::close(epollFd);
+  ::close(sockFd);
+}
+
+uint8_t* CapsChannel::reserve(uint32_t size) {
+  if (chunks.empty() || chunks.back().data.size() - chunks.back().size < size) {
+    Chunk c;
+    if (!freeChunks.empty()) {
+      c = move(freeChunks.back());
+      freeChunks.pop_back();
+    }
+    if (c.data.size() < size)
+      c.data.resize(max(size, (uint32_t)CHANNEL_CHUNK_SIZE));
+    c.size = 0;
+    chunks.push_back(move(c));
+  }
+  auto& back = chunks.back();
+  return back.data.data() + back.size;
+}
+
+void CapsChannel::commit(uint32_t size) {
+  chunks.back().size += size;
+  sendBytes += size;
+  if (sendBytes >= CHANNEL_CHUNK_SIZE)
+    flush();
+}
+
+bool CapsChannel::trySend(const Caps& caps, uint32_t flags) {
+  if (peerClosed)
+    throw logic_error("caps channel closed");
+  auto size = caps.binarySize(flags);
+  if (sendBytes && sendBytes + size > maxSendBytes
+      && (flush(), sendBytes + size > maxSendBytes))
+    return false;
+  auto p = reserve(size);
+  caps.serialize(p, size, flags);
+  commit(size);
+  return true;
+}
+
+bool CapsChannel::trySend(const void* data, uint32_t size) {
+  if (data == nullptr || size <= HEADER_SIZE
+      || Caps::getBinarySize(data, size) != size)
+    throw invalid_argument("data is not a complete caps binary");
+  if (peerClosed)
+    throw logic_error("caps channel closed");
+  if (sendBytes && sendBytes + size > maxSendBytes
+      && (flush(), sendBytes + size > maxSendBytes))
+    return false;
+  memcpy(reserve(size), data, size);
+  commit(size);
+  return true;
+}
+
+void CapsChannel::send(const Caps& caps, uint32_t flags) {
+  while (!trySend(caps, flags))
+    poll(-1);
+}
+
+uint32_t CapsChannel::flush() {
+  while (sendBytes) {
+    struct iovec iov[CHANNEL_MAX_IOV];
+    int n{0};
+    size_t total{0};
+    for (auto it = chunks.begin(); it != chunks.end() && n < CHANNEL_MAX_IOV;
+        ++it) {
+      auto off = it == chunks.begin() ? sendOffset : 0;
+      if (it->size == off)
+        continue;
+      iov[n].iov_base = it->data.data() + off;
+      iov[n].iov_len = it->size - off;
+      total += iov[n].iov_len;
+      ++n;
+    }
+    ssize_t c;
+    if (isSocket) {
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = iov;
+      msg.msg_iovlen = n;
+      c = sendmsg(sockFd, &msg, MSG_NOSIGNAL);
+    } else {
+      c = writev(sockFd, iov, n);
+    }
+    if (c < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      if (errno == EPIPE || errno == ECONNRESET) {
+        // 对端已关闭, 丢弃未发送数据
+        peerClosed = true;
+        chunks.clear();
+        sendOffset = 0;
+        sendBytes = 0;
+        break;
+      }
+      throwSystemError("write caps channel failed");
+    }
+    sendBytes -= c;
+    size_t left = c;
+    while (!chunks.empty()) {
+      auto& front = chunks.front();
+      if (left < front.size - sendOffset) {
+        sendOffset += left;
+        break;
+      }
+      left -= front.size - sendOffset;
+      sendOffset = 0;
+      if (freeChunks.size() < CHANNEL_FREE_CHUNKS)
+        freeChunks.push_back(move(front));
+      chunks.pop_front();
+    }
+    // 未全部写出, 内核缓冲区已满
+    if ((size_t)c < total)
+      break;
+  }
+  updateEvents();
+  return sendBytes;
+}
+
+void CapsChannel::fill() {
+  for (;;) {
+    if (recvStart == recvEnd)
+      recvStart = recvEnd = 0;
+    if (recvEnd == recvBuf.size()) {
+      if (recvStart > 0) {
+        memmove(recvBuf.data(), recvBuf.data() + recvStart, recvEnd - recvStart);
+        recvEnd -= recvStart;
+        recvStart = 0;
+      } else if (recvBuf.size() < maxRecvBytes) {
+        recvBuf.resize(min((uint64_t)maxRecvBytes, (uint64_t)recvBuf.size() * 2));
+      } else {
+        break;
+      }
+    }
+    auto space = recvBuf.size() - recvEnd;
+    auto c = ::read(sockFd, recvBuf.data() + recvEnd, space);
+    if (c > 0) {
+      recvEnd += c;
+      // 未读满缓冲区, 内核中已没有更多数据
+      if ((size_t)c < space)
+        break;
+      continue;
+    }
+    if (c == 0) {
+      peerClosed = true;
+      break;
+    }
+    if (errno == EINTR)
+      continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      break;
+    if (errno == ECONNRESET) {
+      peerClosed = true;
+      break;
+    }
+    throwSystemError("read caps channel failed");
+  }
+}
+
+uint32_t CapsChannel::frameSize() const {
+  auto avail = recvEnd - recvStart;
+  if (avail < sizeof(uint32_t))
+    return 0;
+  auto size = beReadUint32(recvBuf.data() + recvStart);
+  if (size <= HEADER_SIZE)
+    throwException<domain_error>("input data may corrupted, frame size %u", size);
+  if (size > maxRecvBytes)
+    throwException<length_error>("frame size %u exceeds receive buffer", size);
+  return size <= avail ? size : 0;
+}
+
+bool CapsChannel::tryRecv(Caps& out) {
+  auto size = frameSize();
+  if (size == 0) {
+    fill();
+    size = frameSize();
+    if (size == 0) {
+      updateEvents();
+      return false;
+    }
+  }
+  auto p = recvBuf.data() + recvStart;
+  // 先移出消息, 格式错误的消息不会被重复解析
+  recvStart += size;
+  out.parse(p, size);
+  return true;
+}
+
+bool CapsChannel::recv(Caps& out, int32_t timeout) {
+  auto deadline = steady_clock::now() + milliseconds(timeout);
+  for (;;) {
+    if (tryRecv(out))
+      return true;
+    if (peerClosed)
+      return false;
+    int32_t wait{-1};
+    if (timeout >= 0) {
+      auto left = duration_cast<milliseconds>(deadline - steady_clock::now());
+      if (left.count() < 0)
+        return false;
+      wait = left.count();
+    }
+    if (poll(wait) == 0 && wait == 0)
+      return false;
+  }
+}
+
+uint32_t CapsChannel::poll(int32_t timeout) {
+  if (sendBytes)
+    flush();
+  updateEvents();
+  epoll_event ev;
+  auto n = epoll_wait(epollFd, &ev, 1, timeout);
+  if (n < 0 && errno != EINTR)
+    throwSystemError("wait caps channel events failed");
+  if (n > 0) {
+    if (ev.events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+      fill();
+    if (ev.events & EPOLLOUT)
+      flush();
+  }
+  updateEvents();
+  uint32_t r{0};
+  auto p = recvStart;
+  while (recvEnd - p >= sizeof(uint32_t)) {
+    auto size = beReadUint32(recvBuf.data() + p);
+    if (size <= HEADER_SIZE || size > recvEnd - p)
+      break;
+    p += size;
+    ++r;
+  }
+  return r;
+}
+
+void CapsChannel::updateEvents() {
+  uint32_t e{0};
+  if (!peerClosed && recvEnd - recvStart < maxRecvBytes)
+    e |= EPOLLIN;
+  if (sendBytes)
+    e |= EPOLLOUT;
+  if (e == events)
+    return;
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = e;
+  if (epoll_ctl(epollFd, EPOLL_CTL_MOD, sockFd, &ev) < 0)
+    throwSystemError("modify caps channel epoll events failed");
+  events = e;
+}
+
+} // namespace rokid
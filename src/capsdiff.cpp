@@ -0,0 +1,165 @@
+#include <stdexcept>
+#include "caps.h"
+#include "defs.h"
+#include "member.h"
+
+// 补丁修改项下标的最低位, 新值为对嵌套Caps的补丁
+#define DIFF_NESTED 1
+
+using namespace std;
+
+namespace rokid {
+
+class CapsDiff {
+public:
+  // 比较from与to, 修改项写入patch, patch须为空
+  // 发现第一个修改时才写入成员数, 没有修改时patch仍为空
+  // \return to中未被整体替换的成员数(未修改或以嵌套补丁修改)
+  static uint32_t diff(const Caps& from, const Caps& to, Caps& patch) {
+    auto& a = from.members;
+    auto& b = to.members;
+    uint32_t count = b.size();
+    uint32_t kept{0};
+    uint32_t i;
+    for (i = 0; i < count; ++i) {
+      if (i >= a.size()) {
+        add(patch, count, i, 0, b[i]);
+        continue;
+      }
+      auto ma = a[i].get();
+      auto mb = b[i].get();
+      // 共享的成员(未修改的嵌套Caps等)不必比较
+      if (ma == mb) {
+        ++kept;
+        continue;
+      }
+      auto type = ma->type();
+      if (type != mb->type()) {
+        add(patch, count, i, 0, b[i]);
+        continue;
+      }
+      // 嵌套Caps直接逐个成员比较, 不先整体比较, 修改过的子树只遍历一次
+      if (type == CAPS_MEMBER_TYPE_OBJECT) {
+        auto& va = static_cast<const ObjectMember*>(ma)->value;
+        auto& vb = static_cast<const ObjectMember*>(mb)->value;
+        Caps sub;
+        auto subKept = diff(va, vb, sub);
+        if (sub.members.empty()) {
+          ++kept;
+          continue;
+        }
+        // 所有成员都被替换时, 嵌套补丁不比整体替换小
+        if (subKept || vb.members.empty()) {
+          add(patch, count, i, DIFF_NESTED,
+              make_shared<ObjectMember>(move(sub)));
+          ++kept;
+          continue;
+        }
+      } else if (memberDataEqual(ma, mb, type)) {
+        ++kept;
+        continue;
+      }
+      add(patch, count, i, 0, b[i]);
+    }
+    // 只删除了末尾的成员
+    if (patch.members.empty() && a.size() != count)
+      patch.write(count);
+    return kept;
+  }
+
+  // 检查补丁格式, 及嵌套补丁对应的成员是否为Caps, 不修改caps
+  static bool check(const Caps& caps, const Caps& patch) {
+    auto& p = patch.members;
+    if (p.empty() || p[0]->type() != CAPS_MEMBER_TYPE_UINT32
+        || (p.size() & 1) == 0)
+      return false;
+    auto count = static_cast<const Uint32Member*>(p[0].get())->value.number;
+    auto size = caps.members.size();
+    uint32_t appended{0};
+    uint32_t next{0};
+    uint32_t i;
+    for (i = 1; i < p.size(); i += 2) {
+      if (p[i]->type() != CAPS_MEMBER_TYPE_UINT32)
+        return false;
+      auto op = static_cast<const Uint32Member*>(p[i].get())->value.number;
+      auto idx = op >> 1;
+      // 下标递增
+      if (idx < next || idx >= count)
+        return false;
+      next = idx + 1;
+      auto v = p[i + 1].get();
+      if (op & DIFF_NESTED) {
+        if (idx >= size || v->type() != CAPS_MEMBER_TYPE_OBJECT
+            || caps.members[idx]->type() != CAPS_MEMBER_TYPE_OBJECT)
+          return false;
+        if (!check(static_cast<const ObjectMember*>(caps.members[idx].get())->value,
+              static_cast<const ObjectMember*>(v)->value))
+          return false;
+      } else if (!Member::isValidType(v->type())) {
+        return false;
+      }
+      if (idx >= size)
+        ++appended;
+    }
+    // 追加的成员须全部给出
+    return count <= size || appended == count - size;
+  }
+
+  // 补丁已通过check
+  static void apply(Caps& caps, const Caps& patch) {
+    auto& p = patch.members;
+    caps.invalidateCache();
+    caps.members.resize(static_cast<const Uint32Member*>(p[0].get())->value.number);
+    uint32_t i;
+    for (i = 1; i < p.size(); i += 2) {
+      auto op = static_cast<const Uint32Member*>(p[i].get())->value.number;
+      auto& member = caps.members[op >> 1];
+      if ((op & DIFF_NESTED) == 0) {
+        member = p[i + 1];
+        continue;
+      }
+      // 与其他Caps共享的嵌套Caps复制后修改, 复制只包含成员指针
+      if (member.use_count() != 1) {
+        member = make_shared<ObjectMember>(
+            static_cast<const ObjectMember*>(member.get())->value);
+      }
+      apply(static_cast<ObjectMember*>(member.get())->value,
+          static_cast<const ObjectMember*>(p[i + 1].get())->value);
+    }
+  }
+
+private:
+  static void add(Caps& patch, uint32_t count, uint32_t index, uint32_t flags,
+      const MemberPointer& value) {
+    if (patch.members.empty()) {
+      // 补丁通常只有少量修改项, 预留空间避免逐次扩容
+      patch.members.reserve(8);
+      patch.write(count);
+    }
+    patch.write(index << 1 | flags);
+    patch.members.push_back(value);
+  }
+};
+
+Caps Caps::diff(const Caps& from, const Caps& to) {
+  Caps patch;
+  CapsDiff::diff(from, to, patch);
+  // 没有修改时补丁只包含成员数
+  if (patch.members.empty())
+    patch.write((uint32_t)to.members.size());
+  return patch;
+}
+
+void Caps::apply(const Caps& patch) {
+  if (tryApply(patch) != CAPS_SUCCESS)
+    throw domain_error("caps patch corrupted or not match");
+}
+
+int32_t Caps::tryApply(const Caps& patch) {
+  if (&patch == this || !CapsDiff::check(*this, patch))
+    return CAPS_ERR_CORRUPTED;
+  CapsDiff::apply(*this, patch);
+  return CAPS_SUCCESS;
+}
+
+} // namespace rokid
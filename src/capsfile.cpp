@@ -0,0 +1,332 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include "capsfile.h"
+#include "defs.h"
+#include "byteorder.h"
+
+#define CAPS_FILE_HEADER_SIZE 8
+#define CAPS_FILE_LOG_MAGIC "CAPSLOG\x01"
+#define CAPS_FILE_INDEX_MAGIC "CAPSIDX\x01"
+// 记录头: 8字节时间戳
+#define CAPS_FILE_RECORD_HEADER_SIZE 8
+// 索引项: 8字节偏移 + 8字节时间戳
+#define CAPS_FILE_INDEX_ENTRY_SIZE 16
+
+using namespace std;
+
+namespace rokid {
+
+static void throwSystemError(const char* what) {
+  throw system_error(errno, system_category(), what);
+}
+
+static string indexPath(const char* path) {
+  return string(path) + ".idx";
+}
+
+// 打开文件, 空文件写入文件头, 否则检查文件头
+static int openFile(const char* path, const char* magic) {
+  int fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0)
+    throwSystemError("open caps file failed");
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    ::close(fd);
+    throwSystemError("stat caps file failed");
+  }
+  char header[CAPS_FILE_HEADER_SIZE];
+  if (st.st_size == 0) {
+    memcpy(header, magic, sizeof(header));
+    if (pwrite(fd, header, sizeof(header), 0) != sizeof(header)) {
+      ::close(fd);
+      throwSystemError("write caps file failed");
+    }
+    return fd;
+  }
+  if (pread(fd, header, sizeof(header), 0) != sizeof(header)
+      || memcmp(header, magic, sizeof(header))) {
+    ::close(fd);
+    throw domain_error("not a caps file");
+  }
+  return fd;
+}
+
+CapsFileWriter::CapsFileWriter() : logFd{-1}, indexFd{-1}, logSize{0},
+    recordCount{0} {
+}
+
+CapsFileWriter::~CapsFileWriter() {
+  close();
+}
+
+void CapsFileWriter::open(const char* path) {
+  close();
+  logFd = openFile(path, CAPS_FILE_LOG_MAGIC);
+  try {
+    indexFd = openFile(indexPath(path).c_str(), CAPS_FILE_INDEX_MAGIC);
+    recover();
+  } catch (...) {
+    close();
+    throw;
+  }
+}
+
+// 找到最后一条完整的记录, 截断其后的数据, 补全缺失的索引项
+// 索引项可能先于记录数据落盘, 已索引的记录也需要从后向前检查
+void CapsFileWriter::recover() {
+  struct stat st;
+  if (fstat(logFd, &st) < 0)
+    throwSystemError("stat caps file failed");
+  uint64_t fileSize = st.st_size;
+  if (fstat(indexFd, &st) < 0)
+    throwSystemError("stat caps index file failed");
+  uint64_t entries = (st.st_size - CAPS_FILE_HEADER_SIZE) / CAPS_FILE_INDEX_ENTRY_SIZE;
+
+  uint8_t header[CAPS_FILE_RECORD_HEADER_SIZE + HEADER_SIZE];
+  Caps caps;
+  // 检查pos处的记录是否完整, 返回记录总长度, 不完整返回0
+  auto check = [&](uint64_t pos, uint64_t& ts) -> uint64_t {
+    if (fileSize - pos < sizeof(header))
+      return 0;
+    if (pread(logFd, header, sizeof(header), pos) != sizeof(header))
+      throwSystemError("read caps file failed");
+    auto size = Caps::getBinarySize(header + CAPS_FILE_RECORD_HEADER_SIZE,
+        HEADER_SIZE);
+    if (size <= HEADER_SIZE
+        || size > fileSize - pos - CAPS_FILE_RECORD_HEADER_SIZE)
+      return 0;
+    buffer.resize(size);
+    if (pread(logFd, buffer.data(), size, pos + CAPS_FILE_RECORD_HEADER_SIZE)
+        != size)
+      throwSystemError("read caps file failed");
+    if (caps.tryParse(buffer.data(), size) != CAPS_SUCCESS)
+      return 0;
+    ts = leReadUint64(header);
+    return CAPS_FILE_RECORD_HEADER_SIZE + size;
+  };
+
+  uint64_t pos = CAPS_FILE_HEADER_SIZE;
+  uint64_t ts;
+  uint8_t entry[CAPS_FILE_INDEX_ENTRY_SIZE];
+  while (entries > 0) {
+    if (pread(indexFd, entry, sizeof(entry), CAPS_FILE_HEADER_SIZE
+          + (entries - 1) * CAPS_FILE_INDEX_ENTRY_SIZE) != sizeof(entry))
+      throwSystemError("read caps index file failed");
+    auto off = leReadUint64(entry);
+    if (off >= CAPS_FILE_HEADER_SIZE && off < fileSize) {
+      auto len = check(off, ts);
+      if (len) {
+        pos = off + len;
+        break;
+      }
+    }
+    --entries;
+  }
+  recordCount = entries;
+
+  while (true) {
+    auto len = check(pos, ts);
+    if (len == 0)
+      break;
+    leWriteUint64(pos, entry);
+    leWriteUint64(ts, entry + 8);
+    writeAll(indexFd, entry, sizeof(entry), CAPS_FILE_HEADER_SIZE
+        + (uint64_t)recordCount * CAPS_FILE_INDEX_ENTRY_SIZE);
+    ++recordCount;
+    pos += len;
+  }
+  if (pos < fileSize && ftruncate(logFd, pos) < 0)
+    throwSystemError("truncate caps file failed");
+  if (ftruncate(indexFd, CAPS_FILE_HEADER_SIZE
+        + (uint64_t)recordCount * CAPS_FILE_INDEX_ENTRY_SIZE) < 0)
+    throwSystemError("truncate caps index file failed");
+  logSize = pos;
+}
+
+void CapsFileWriter::writeAll(int fd, const void* data, size_t size,
+    uint64_t off) {
+  auto p = reinterpret_cast<const uint8_t*>(data);
+  while (size) {
+    auto c = pwrite(fd, p, size, off);
+    if (c < 0) {
+      if (errno == EINTR)
+        continue;
+      throwSystemError("write caps file failed");
+    }
+    p += c;
+    off += c;
+    size -= c;
+  }
+}
+
+// buffer中已存放记录数据
+void CapsFileWriter::appendRecord(uint64_t timestamp) {
+  leWriteUint64(timestamp, buffer.data());
+  uint8_t entry[CAPS_FILE_INDEX_ENTRY_SIZE];
+  leWriteUint64(logSize, entry);
+  leWriteUint64(timestamp, entry + 8);
+  writeAll(logFd, buffer.data(), buffer.size(), logSize);
+  logSize += buffer.size();
+  writeAll(indexFd, entry, sizeof(entry), CAPS_FILE_HEADER_SIZE
+      + (uint64_t)recordCount * CAPS_FILE_INDEX_ENTRY_SIZE);
+  ++recordCount;
+}
+
+void CapsFileWriter::append(const Caps& caps, uint64_t timestamp) {
+  if (logFd < 0)
+    throw logic_error("caps file not opened");
+  auto size = caps.binarySize();
+  buffer.resize(CAPS_FILE_RECORD_HEADER_SIZE + size);
+  caps.serialize(buffer.data() + CAPS_FILE_RECORD_HEADER_SIZE, size);
+  appendRecord(timestamp);
+}
+
+void CapsFileWriter::append(const void* data, uint32_t size, uint64_t timestamp) {
+  if (logFd < 0)
+    throw logic_error("caps file not opened");
+  if (data == nullptr || size <= HEADER_SIZE
+      || Caps::getBinarySize(data, size) != size)
+    throw invalid_argument("data is not a serialized caps");
+  buffer.resize(CAPS_FILE_RECORD_HEADER_SIZE + size);
+  memcpy(buffer.data() + CAPS_FILE_RECORD_HEADER_SIZE, data, size);
+  appendRecord(timestamp);
+}
+
+void CapsFileWriter::sync() {
+  if (logFd < 0)
+    return;
+  // 先同步数据文件, 保证已落盘的索引项指向完整的记录
+  if (fdatasync(logFd) < 0)
+    throwSystemError("sync caps file failed");
+  if (fdatasync(indexFd) < 0)
+    throwSystemError("sync caps index file failed");
+}
+
+void CapsFileWriter::close() {
+  if (logFd >= 0)
+    ::close(logFd);
+  if (indexFd >= 0)
+    ::close(indexFd);
+  logFd = -1;
+  indexFd = -1;
+  logSize = 0;
+  recordCount = 0;
+}
+
+CapsFileReader::CapsFileReader() : logData{nullptr}, logSize{0},
+    indexData{nullptr}, indexSize{0}, recordCount{0} {
+}
+
+CapsFileReader::~CapsFileReader() {
+  close();
+}
+
+static const uint8_t* mapFile(const char* path, const char* magic,
+    uint64_t& size, bool sequential) {
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throwSystemError("open caps file failed");
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    ::close(fd);
+    throwSystemError("stat caps file failed");
+  }
+  size = st.st_size;
+  if (size < CAPS_FILE_HEADER_SIZE) {
+    ::close(fd);
+    throw domain_error("not a caps file");
+  }
+  auto p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED)
+    throwSystemError("mmap caps file failed");
+  if (memcmp(p, magic, CAPS_FILE_HEADER_SIZE)) {
+    munmap(p, size);
+    throw domain_error("not a caps file");
+  }
+  madvise(p, size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+  return reinterpret_cast<const uint8_t*>(p);
+}
+
+void CapsFileReader::open(const char* path, bool sequential) {
+  close();
+  logData = mapFile(path, CAPS_FILE_LOG_MAGIC, logSize, sequential);
+  try {
+    indexData = mapFile(indexPath(path).c_str(), CAPS_FILE_INDEX_MAGIC,
+        indexSize, sequential);
+  } catch (...) {
+    close();
+    throw;
+  }
+  recordCount = (indexSize - CAPS_FILE_HEADER_SIZE) / CAPS_FILE_INDEX_ENTRY_SIZE;
+}
+
+void CapsFileReader::close() {
+  if (logData)
+    munmap(const_cast<uint8_t*>(logData), logSize);
+  if (indexData)
+    munmap(const_cast<uint8_t*>(indexData), indexSize);
+  logData = nullptr;
+  logSize = 0;
+  indexData = nullptr;
+  indexSize = 0;
+  recordCount = 0;
+}
+
+int32_t CapsFileReader::record(uint32_t i, const uint8_t*& data,
+    uint32_t& size) const {
+  if (i >= recordCount)
+    return CAPS_ERR_OUT_OF_RANGE;
+  auto off = leReadUint64(indexData + CAPS_FILE_HEADER_SIZE
+      + (uint64_t)i * CAPS_FILE_INDEX_ENTRY_SIZE);
+  if (off < CAPS_FILE_HEADER_SIZE || off >= logSize
+      || logSize - off < CAPS_FILE_RECORD_HEADER_SIZE + HEADER_SIZE)
+    return CAPS_ERR_CORRUPTED;
+  data = logData + off + CAPS_FILE_RECORD_HEADER_SIZE;
+  size = Caps::getBinarySize(data, HEADER_SIZE);
+  if (size > logSize - off - CAPS_FILE_RECORD_HEADER_SIZE)
+    return CAPS_ERR_CORRUPTED;
+  return CAPS_SUCCESS;
+}
+
+const void* CapsFileReader::data(uint32_t i, uint32_t& size) const {
+  const uint8_t* p;
+  switch (record(i, p, size)) {
+  case CAPS_SUCCESS:
+    break;
+  case CAPS_ERR_OUT_OF_RANGE:
+    throwException<out_of_range>("record %u out of range", i);
+  default:
+    throwException<domain_error>("record %u corrupted", i);
+  }
+  return p;
+}
+
+uint64_t CapsFileReader::timestamp(uint32_t i) const {
+  if (i >= recordCount)
+    throwException<out_of_range>("record %u out of range", i);
+  return leReadUint64(indexData + CAPS_FILE_HEADER_SIZE
+      + (uint64_t)i * CAPS_FILE_INDEX_ENTRY_SIZE + 8);
+}
+
+void CapsFileReader::read(uint32_t i, Caps& caps) const {
+  uint32_t size;
+  auto p = data(i, size);
+  caps.parse(p, size);
+}
+
+int32_t CapsFileReader::tryRead(uint32_t i, Caps& caps) const {
+  const uint8_t* p;
+  uint32_t size;
+  auto r = record(i, p, size);
+  if (r != CAPS_SUCCESS)
+    return r;
+  return caps.tryParse(p, size);
+}
+
+} // namespace rokid
@@ -0,0 +1,338 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <system_error>
+#include "capsring.h"
+#include "defs.h"
+
+// 共享内存开头的控制区大小, 其后为数据区
+#define RING_CONTROL_SIZE 4096
+#define RING_MAGIC 0x52534143
+#define RING_MIN_CAPACITY 4096
+#define RING_MAX_CAPACITY (1U << 30)
+// 每条消息前的记录头: 4字节长度 + 4字节保留, 记录按8字节对齐
+#define RING_RECORD_HEADER 8
+// 记录长度为此值时表示跳过数据区剩余部分, 下一条记录从数据区开头开始
+#define RING_PAD 0xffffffffU
+// 多核时futex等待前自旋检查次数, 单核时自旋只会占用对方的时间片
+#define RING_SPIN 256
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 1U
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+namespace rokid {
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+    "caps ring requires lock free atomics");
+
+// head/tail为单调递增的字节位置, 分别由生产者/消费者写入, 各占一个cache line
+// xxxWaiting为futex字, 一方等待时置1, 另一方看到1时清0并唤醒
+struct CapsRing::Control {
+  uint32_t magic;
+  uint32_t capacity;
+  alignas(64) atomic<uint64_t> head;
+  alignas(64) atomic<uint64_t> tail;
+  alignas(64) atomic<uint32_t> consumerWaiting;
+  atomic<uint32_t> producerWaiting;
+};
+
+static void throwSystemError(const char* what) {
+  throw system_error(errno, system_category(), what);
+}
+
+static inline uint32_t recordSize(uint32_t size) {
+  return (RING_RECORD_HEADER + size + 7) & ~7U;
+}
+
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+static void wake(atomic<uint32_t>& waiting) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (waiting.load(memory_order_relaxed)) {
+    waiting.store(0, memory_order_relaxed);
+    syscall(SYS_futex, &waiting, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+  }
+}
+
+// 等待pos不等于seen
+// \return false 超时
+static bool waitChange(atomic<uint32_t>& waiting, const atomic<uint64_t>& pos,
+    uint64_t seen, int32_t timeout, steady_clock::time_point deadline) {
+  static const uint32_t spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? RING_SPIN : 0;
+  uint32_t i;
+  for (i = 0; i < spin; ++i) {
+    if (pos.load(memory_order_acquire) != seen)
+      return true;
+    cpuRelax();
+  }
+  for (;;) {
+    waiting.store(1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (pos.load(memory_order_relaxed) != seen)
+      break;
+    struct timespec ts;
+    struct timespec* pts{nullptr};
+    if (timeout >= 0) {
+      auto left = duration_cast<nanoseconds>(deadline - steady_clock::now()).count();
+      if (left <= 0) {
+        waiting.store(0, memory_order_relaxed);
+        return false;
+      }
+      ts.tv_sec = left / 1000000000;
+      ts.tv_nsec = left % 1000000000;
+      pts = &ts;
+    }
+    // EAGAIN: 已被清0, EINTR/ETIMEDOUT: 重新检查
+    syscall(SYS_futex, &waiting, FUTEX_WAIT, 1, pts, nullptr, 0);
+  }
+  waiting.store(0, memory_order_relaxed);
+  return true;
+}
+
+CapsRing::CapsRing() {
+}
+
+CapsRing::~CapsRing() {
+  close();
+}
+
+void CapsRing::create(uint32_t cap) {
+  uint32_t c{RING_MIN_CAPACITY};
+  while (c < cap && c < RING_MAX_CAPACITY)
+    c <<= 1;
+  int fd{-1};
+#ifdef SYS_memfd_create
+  fd = syscall(SYS_memfd_create, "caps-ring", MFD_CLOEXEC);
+#endif
+#ifndef __ANDROID__
+  if (fd < 0) {
+    // 不支持memfd时使用匿名的posix共享内存
+    char name[64];
+    snprintf(name, sizeof(name), "/caps-ring-%d-%p", getpid(), (void*)this);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd >= 0)
+      shm_unlink(name);
+  }
+#endif
+  if (fd < 0)
+    throwSystemError("create caps ring shared memory failed");
+  if (ftruncate(fd, RING_CONTROL_SIZE + (off_t)c) < 0) {
+    auto err = errno;
+    ::close(fd);
+    errno = err;
+    throwSystemError("resize caps ring shared memory failed");
+  }
+  static_assert(sizeof(Control) <= RING_CONTROL_SIZE, "caps ring control too large");
+  close();
+  map(fd, c);
+  new (control) Control();
+  control->capacity = c;
+  control->magic = RING_MAGIC;
+}
+
+void CapsRing::attach(int fd) {
+  auto nfd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (nfd < 0)
+    throwSystemError("dup caps ring fd failed");
+  struct stat st;
+  if (fstat(nfd, &st) < 0) {
+    auto err = errno;
+    ::close(nfd);
+    errno = err;
+    throwSystemError("stat caps ring shared memory failed");
+  }
+  auto c = st.st_size - RING_CONTROL_SIZE;
+  if (st.st_size <= RING_CONTROL_SIZE || c > RING_MAX_CAPACITY || (c & (c - 1))) {
+    ::close(nfd);
+    throw domain_error("fd is not a caps ring");
+  }
+  close();
+  map(nfd, c);
+  if (control->magic != RING_MAGIC || control->capacity != capacity) {
+    close();
+    throw domain_error("fd is not a caps ring");
+  }
+  writePos = cachedHead = control->head.load(memory_order_acquire);
+  readPos = cachedTail = control->tail.load(memory_order_acquire);
+}
+
+void CapsRing::map(int fd, uint32_t c) {
+  auto p = mmap(nullptr, RING_CONTROL_SIZE + (size_t)c, PROT_READ | PROT_WRITE,
+      MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    auto err = errno;
+    ::close(fd);
+    errno = err;
+    throwSystemError("map caps ring shared memory failed");
+  }
+  shmFd = fd;
+  control = reinterpret_cast<Control*>(p);
+  data = reinterpret_cast<uint8_t*>(p) + RING_CONTROL_SIZE;
+  capacity = c;
+}
+
+void CapsRing::close() {
+  if (control) {
+    munmap(control, RING_CONTROL_SIZE + (size_t)capacity);
+    ::close(shmFd);
+  }
+  shmFd = -1;
+  control = nullptr;
+  data = nullptr;
+  capacity = 0;
+  writePos = cachedTail = 0;
+  readPos = cachedHead = 0;
+  reserved = peeked = 0;
+}
+
+uint32_t CapsRing::maxMessageSize() const {
+  // 记录不超过数据区一半, 加上回绕跳过的部分不超过整个数据区
+  return capacity / 2 - RING_RECORD_HEADER;
+}
+
+uint8_t* CapsRing::tryReserve(uint32_t size) {
+  if (data == nullptr)
+    throw logic_error("caps ring not opened");
+  if (size > maxMessageSize())
+    throwException<length_error>("message size %u exceeds caps ring", size);
+  auto need = recordSize(size);
+  auto idx = (uint32_t)writePos & (capacity - 1);
+  auto contig = capacity - idx;
+  uint32_t skip = need > contig ? contig : 0;
+  if (writePos + skip + need - cachedTail > capacity) {
+    cachedTail = control->tail.load(memory_order_acquire);
+    if (writePos + skip + need - cachedTail > capacity)
+      return nullptr;
+  }
+  if (skip) {
+    // 跳过标记在commit发布head前对消费者不可见
+    *reinterpret_cast<uint32_t*>(data + idx) = RING_PAD;
+    writePos += skip;
+    idx = 0;
+  }
+  reserved = need;
+  return data + idx + RING_RECORD_HEADER;
+}
+
+void CapsRing::commit(uint32_t size) {
+  if (reserved == 0)
+    throw logic_error("caps ring commit without reserve");
+  if (recordSize(size) > reserved)
+    throwException<invalid_argument>("commit size %u exceeds reserved", size);
+  auto idx = (uint32_t)writePos & (capacity - 1);
+  *reinterpret_cast<uint32_t*>(data + idx) = size;
+  writePos += recordSize(size);
+  reserved = 0;
+  control->head.store(writePos, memory_order_release);
+  wake(control->consumerWaiting);
+}
+
+bool CapsRing::tryWrite(const Caps& caps, uint32_t flags) {
+  auto size = caps.binarySize(flags);
+  auto p = tryReserve(size);
+  if (p == nullptr)
+    return false;
+  caps.serialize(p, size, flags);
+  commit(size);
+  return true;
+}
+
+bool CapsRing::write(const Caps& caps, uint32_t flags, int32_t timeout) {
+  auto deadline = steady_clock::now() + milliseconds(timeout);
+  auto size = caps.binarySize(flags);
+  for (;;) {
+    auto p = tryReserve(size);
+    if (p) {
+      caps.serialize(p, size, flags);
+      commit(size);
+      return true;
+    }
+    if (timeout == 0 || !waitChange(control->producerWaiting, control->tail,
+          cachedTail, timeout, deadline))
+      return false;
+  }
+}
+
+const uint8_t* CapsRing::tryPeek(uint32_t& size) {
+  if (data == nullptr)
+    throw logic_error("caps ring not opened");
+  for (;;) {
+    if (readPos == cachedHead) {
+      cachedHead = control->head.load(memory_order_acquire);
+      if (readPos == cachedHead)
+        return nullptr;
+    }
+    auto idx = (uint32_t)readPos & (capacity - 1);
+    auto len = *reinterpret_cast<const uint32_t*>(data + idx);
+    if (len == RING_PAD) {
+      if (cachedHead - readPos < capacity - idx)
+        throw domain_error("caps ring data may corrupted");
+      readPos += capacity - idx;
+      continue;
+    }
+    if (len > maxMessageSize() || recordSize(len) > capacity - idx
+        || recordSize(len) > cachedHead - readPos)
+      throwException<domain_error>("caps ring data may corrupted, size %u", len);
+    peeked = recordSize(len);
+    size = len;
+    return data + idx + RING_RECORD_HEADER;
+  }
+}
+
+void CapsRing::release() {
+  if (peeked == 0)
+    return;
+  readPos += peeked;
+  peeked = 0;
+  control->tail.store(readPos, memory_order_release);
+  wake(control->producerWaiting);
+}
+
+bool CapsRing::tryRead(Caps& out) {
+  uint32_t size;
+  auto p = tryPeek(size);
+  if (p == nullptr)
+    return false;
+  try {
+    out.parse(p, size);
+  } catch (...) {
+    // 格式错误的消息同样移出, 不会被重复解析
+    release();
+    throw;
+  }
+  release();
+  return true;
+}
+
+bool CapsRing::read(Caps& out, int32_t timeout) {
+  auto deadline = steady_clock::now() + milliseconds(timeout);
+  for (;;) {
+    if (tryRead(out))
+      return true;
+    if (timeout == 0 || !waitChange(control->consumerWaiting, control->head,
+          cachedHead, timeout, deadline))
+      return false;
+  }
+}
+
+} // namespace rokid
@@ -0,0 +1,116 @@
+#include <string.h>
+#include <stdexcept>
+#include "capssignature.h"
+#include "defs.h"
+#include "member.h"
+#include "leb128.h"
+#include "byteorder.h"
+#include "wyhash.h"
+
+#define SIGNATURE_MIN_SLOTS 16
+
+using namespace std;
+
+namespace rokid {
+
+static inline uint64_t signatureHash(const void* desc, uint32_t length) {
+  return wyhash(desc, length, 0);
+}
+
+CapsSignatures::CapsSignatures() {
+  slots.resize(SIGNATURE_MIN_SLOTS);
+}
+
+void CapsSignatures::add(const char* signature, uint32_t id) {
+  if (signature == nullptr)
+    throw invalid_argument("signature is nullptr");
+  uint32_t length = strlen(signature);
+  uint32_t i;
+  for (i = 0; i < length; ++i) {
+    if (!Member::isValidType(signature[i]))
+      throwException<invalid_argument>("invalid member type '%c' in signature",
+          signature[i]);
+  }
+  auto desc = reinterpret_cast<const uint8_t*>(signature);
+  auto hash = signatureHash(desc, length);
+  if (find(desc, length, hash))
+    throwException<invalid_argument>("signature '%.32s' already added", signature);
+  if ((count + 1) * 2 > slots.size())
+    grow();
+  auto mask = slots.size() - 1;
+  for (i = hash & mask; slots[i].used; i = (i + 1) & mask);
+  auto& slot = slots[i];
+  slot.hash = hash;
+  slot.offset = pool.size();
+  slot.length = length;
+  slot.id = id;
+  slot.used = true;
+  pool.append(signature, length);
+  ++count;
+}
+
+const CapsSignatures::Slot* CapsSignatures::find(const uint8_t* desc,
+    uint32_t length, uint64_t hash) const {
+  auto mask = slots.size() - 1;
+  uint32_t i;
+  for (i = hash & mask; slots[i].used; i = (i + 1) & mask) {
+    auto& slot = slots[i];
+    if (slot.hash == hash && slot.length == length
+        && memcmp(pool.data() + slot.offset, desc, length) == 0)
+      return &slot;
+  }
+  return nullptr;
+}
+
+void CapsSignatures::grow() {
+  vector<Slot> old(slots.size() * 2);
+  old.swap(slots);
+  auto mask = slots.size() - 1;
+  for (auto& slot : old) {
+    if (!slot.used)
+      continue;
+    uint32_t i;
+    for (i = slot.hash & mask; slots[i].used; i = (i + 1) & mask);
+    slots[i] = slot;
+  }
+}
+
+void CapsSignatures::clear() {
+  pool.clear();
+  slots.assign(SIGNATURE_MIN_SLOTS, Slot());
+  count = 0;
+}
+
+int32_t CapsSignatures::tryMatch(const void* data, uint32_t size,
+    uint32_t& id) const noexcept {
+  auto in = reinterpret_cast<const uint8_t*>(data);
+  // 检查顺序与Caps::parse相同, 同一输入返回相同的错误码
+  if (in == nullptr || size <= HEADER_SIZE)
+    return CAPS_ERR_INVALID_PARAM;
+  auto flags = in[sizeof(uint32_t)] & (CAPS_FLAG_CRC32C | CAPS_FLAG_FIXED_INT);
+  if ((in[sizeof(uint32_t)] & ~flags) != CAPS_VERSION)
+    return CAPS_ERR_VERSION;
+  if (beReadUint32(in) != size)
+    return CAPS_ERR_INVALID_PARAM;
+  if (flags & CAPS_FLAG_CRC32C) {
+    if (size <= HEADER_SIZE + CRC_SIZE)
+      return CAPS_ERR_CORRUPTED;
+    size -= CRC_SIZE;
+  }
+  uint32_t length;
+  auto c = uleb128TryRead(in + HEADER_SIZE, size - HEADER_SIZE, length);
+  if (c == 0) {
+    return size - HEADER_SIZE < LEB128_MAX_INT32_BYTES ? CAPS_ERR_TRUNCATED
+      : CAPS_ERR_OVERFLOW;
+  }
+  auto desc = in + HEADER_SIZE + c;
+  if (size - HEADER_SIZE - c < length)
+    return CAPS_ERR_CORRUPTED;
+  auto slot = find(desc, length, signatureHash(desc, length));
+  if (slot == nullptr)
+    return CAPS_ERR_TYPE_MISMATCH;
+  id = slot->id;
+  return CAPS_SUCCESS;
+}
+
+} // namespace rokid
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <vector>
+#include "capsvisitor.h"
+#include "defs.h"
+#include "crc32c.h"
+
+using namespace std;
+
+namespace rokid {
+
+int32_t CapsVisitor::checkHeader(const uint8_t* in, uint32_t& size,
+    bool& fixed, uint32_t& off) {
+  off = 0;
+  if (in == nullptr || size <= HEADER_SIZE || beReadUint32(in) != size)
+    return CAPS_ERR_INVALID_PARAM;
+  auto version = in[sizeof(uint32_t)];
+  auto flags = version & (CAPS_FLAG_CRC32C | CAPS_FLAG_FIXED_INT);
+  if ((version & ~flags) != CAPS_VERSION) {
+    off = sizeof(uint32_t);
+    return CAPS_ERR_VERSION;
+  }
+  if (flags & CAPS_FLAG_CRC32C) {
+    if (size <= HEADER_SIZE + CRC_SIZE)
+      return CAPS_ERR_CORRUPTED;
+    size -= CRC_SIZE;
+    if (crc32c(0, in, size) != leReadUint32(in + size)) {
+      off = size;
+      return CAPS_ERR_CHECKSUM;
+    }
+  }
+  fixed = flags & CAPS_FLAG_FIXED_INT;
+  off = HEADER_SIZE;
+  return CAPS_SUCCESS;
+}
+
+// 与Caps::dump输出相同
+class DumpVisitor : public CapsVisitor {
+public:
+  DumpVisitor(char* o, uint32_t s) : out{o}, p{o}, psize{s} {
+  }
+
+  void onInt32(int32_t v) {
+    print("%" PRIi32, v);
+  }
+
+  void onUint32(uint32_t v) {
+    print("%" PRIu32 "u", v);
+  }
+
+  void onInt64(int64_t v) {
+    print("%" PRIi64 "l", v);
+  }
+
+  void onUint64(uint64_t v) {
+    print("%" PRIu64 "ul", v);
+  }
+
+  void onFloat(float v) {
+    print("%f", v);
+  }
+
+  void onDouble(double v) {
+    print("%lfL", v);
+  }
+
+  void onString(const char* data, uint32_t size) {
+    print("\"%.*s\"", (int)strnlen(data, size), data);
+  }
+
+  void onBinary(const void*, uint32_t size) {
+    print("binary data %u bytes", size);
+  }
+
+  void onVoid() {
+    print("void");
+  }
+
+  void onBeginObject(uint32_t) {
+    if (!indices.empty())
+      print("caps");
+    indices.push_back(0);
+  }
+
+  void onEndObject() {
+    indices.pop_back();
+  }
+
+  uint32_t length() const {
+    return p - out;
+  }
+
+private:
+  void print(const char* format, ...) {
+    uint32_t i;
+    for (i = 1; i < indices.size(); ++i)
+      output("> ");
+    output("%u: ", indices.back());
+    va_list ap;
+    va_start(ap, format);
+    auto c = vsnprintf(p, psize, format, ap);
+    va_end(ap);
+    advance(c);
+    output("\n");
+    ++indices.back();
+  }
+
+  void output(const char* format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    auto c = vsnprintf(p, psize, format, ap);
+    va_end(ap);
+    advance(c);
+  }
+
+  void advance(int32_t c) {
+    if (c < 0 || (uint32_t)c > psize)
+      throw out_of_range("out buffer too small");
+    p += c;
+    psize -= c;
+  }
+
+private:
+  char* out;
+  char* p;
+  uint32_t psize;
+  // 各层当前成员下标
+  vector<uint32_t> indices;
+};
+
+uint32_t Caps::dumpBinary(const void* in, uint32_t size, char* out,
+    uint32_t outSize) {
+  if (out == nullptr && outSize != 0)
+    throw invalid_argument("out is nullptr");
+  if (outSize == 0)
+    return 0;
+  DumpVisitor visitor(out, outSize);
+  uint32_t off;
+  if (CapsVisitor::visit(in, size, visitor, &off) != CAPS_SUCCESS)
+    throwException<domain_error>("input data may corrupted, offset %u", off);
+  auto r = visitor.length();
+  if (r == 0)
+    out[0] = '\0';
+  return r;
+}
+
+} // namespace rokid
@@ -0,0 +1,200 @@
+#include <string.h>
+#include <stdexcept>
+#include "capswriter.h"
+#include "defs.h"
+#include "leb128.h"
+#include "byteorder.h"
+#include "crc32c.h"
+
+using namespace std;
+
+namespace rokid {
+
+static uint32_t reservedSize(uint32_t memberHint) {
+  return HEADER_SIZE + uleb128Size(memberHint) + memberHint;
+}
+
+CapsWriter::CapsWriter(uint32_t f, uint32_t memberHint) : flags{f} {
+  if (flags & ~(CAPS_FLAG_CRC32C | CAPS_FLAG_FIXED_INT))
+    throwException<invalid_argument>("invalid serialize flags 0x%x", flags);
+  reset(memberHint);
+}
+
+void CapsWriter::reset(uint32_t memberHint) {
+  length = 0;
+  types.clear();
+  levels.clear();
+  finished = false;
+  beginObject(memberHint);
+}
+
+uint8_t* CapsWriter::ensure(uint32_t n) {
+  if (buffer.size() - length < n)
+    buffer.resize(max(buffer.size() * 2, (size_t)length + n));
+  return buffer.data() + length;
+}
+
+void CapsWriter::checkWritable() const {
+  if (finished)
+    throw logic_error("caps writer already finished");
+}
+
+// 记录成员类型, 返回成员数据写入位置
+// 先保证空间再记录类型, ensure抛出异常时不留下没有数据的类型
+uint8_t* CapsWriter::append(char type, uint32_t n) {
+  checkWritable();
+  auto p = ensure(n);
+  types.push_back(type);
+  return p;
+}
+
+void CapsWriter::write() {
+  checkWritable();
+  types.push_back(CAPS_MEMBER_TYPE_VOID);
+}
+
+void CapsWriter::write(int32_t v) {
+  auto p = append(CAPS_MEMBER_TYPE_INT32, LEB128_MAX_INT32_BYTES);
+  if (flags & CAPS_FLAG_FIXED_INT) {
+    leWriteUint32(v, p);
+    length += sizeof(v);
+  } else {
+    length = leb128TryWrite(v, p, LEB128_MAX_INT32_BYTES) - buffer.data();
+  }
+}
+
+void CapsWriter::write(uint32_t v) {
+  auto p = append(CAPS_MEMBER_TYPE_UINT32, LEB128_MAX_INT32_BYTES);
+  if (flags & CAPS_FLAG_FIXED_INT) {
+    leWriteUint32(v, p);
+    length += sizeof(v);
+  } else {
+    length = uleb128TryWrite(v, p, LEB128_MAX_INT32_BYTES) - buffer.data();
+  }
+}
+
+void CapsWriter::write(int64_t v) {
+  auto p = append(CAPS_MEMBER_TYPE_INT64, LEB128_MAX_INT64_BYTES);
+  if (flags & CAPS_FLAG_FIXED_INT) {
+    leWriteUint64(v, p);
+    length += sizeof(v);
+  } else {
+    length = leb128TryWrite(v, p, LEB128_MAX_INT64_BYTES) - buffer.data();
+  }
+}
+
+void CapsWriter::write(uint64_t v) {
+  auto p = append(CAPS_MEMBER_TYPE_UINT64, LEB128_MAX_INT64_BYTES);
+  if (flags & CAPS_FLAG_FIXED_INT) {
+    leWriteUint64(v, p);
+    length += sizeof(v);
+  } else {
+    length = uleb128TryWrite(v, p, LEB128_MAX_INT64_BYTES) - buffer.data();
+  }
+}
+
+void CapsWriter::write(float v) {
+  leWriteFloat(v, append(CAPS_MEMBER_TYPE_FLOAT, sizeof(v)));
+  length += sizeof(v);
+}
+
+void CapsWriter::write(double v) {
+  leWriteDouble(v, append(CAPS_MEMBER_TYPE_DOUBLE, sizeof(v)));
+  length += sizeof(v);
+}
+
+void CapsWriter::write(const char* v) {
+  uint32_t size = strlen(v);
+  auto p = append(CAPS_MEMBER_TYPE_STRING, LEB128_MAX_INT32_BYTES + size);
+  if (flags & CAPS_FLAG_FIXED_INT) {
+    leWriteUint32(size, p);
+    p += sizeof(size);
+  } else {
+    p = uleb128TryWrite(size, p, LEB128_MAX_INT32_BYTES);
+  }
+  memcpy(p, v, size);
+  length = p + size - buffer.data();
+}
+
+void CapsWriter::write(const void* data, uint32_t size) {
+  auto p = append(CAPS_MEMBER_TYPE_BINARY, LEB128_MAX_INT32_BYTES + size);
+  if (flags & CAPS_FLAG_FIXED_INT) {
+    leWriteUint32(size, p);
+    p += sizeof(size);
+  } else {
+    p = uleb128TryWrite(size, p, LEB128_MAX_INT32_BYTES);
+  }
+  memcpy(p, data, size);
+  length = p + size - buffer.data();
+}
+
+void CapsWriter::write(const Caps& v) {
+  checkWritable();
+  auto f = flags & CAPS_FLAG_FIXED_INT;
+  auto size = v.binarySize(f);
+  // 序列化成功后才记录类型, 失败时writer不变
+  length += v.serialize(ensure(size), size, f);
+  types.push_back(CAPS_MEMBER_TYPE_OBJECT);
+}
+
+void CapsWriter::beginObject(uint32_t memberHint) {
+  checkWritable();
+  Level level;
+  level.start = length;
+  level.reserved = reservedSize(memberHint);
+  ensure(level.reserved);
+  // 顶层Caps不写入类型
+  if (!levels.empty())
+    types.push_back(CAPS_MEMBER_TYPE_OBJECT);
+  level.firstType = types.size();
+  length += level.reserved;
+  levels.push_back(level);
+}
+
+void CapsWriter::endObject() {
+  checkWritable();
+  if (levels.size() <= 1)
+    throw logic_error("endObject without beginObject");
+  close(levels.back(), 0);
+  levels.pop_back();
+}
+
+uint32_t CapsWriter::finish() {
+  checkWritable();
+  if (levels.size() != 1)
+    throw logic_error("caps writer has unclosed object");
+  uint32_t trailer = flags & CAPS_FLAG_CRC32C ? CRC_SIZE : 0;
+  close(levels.back(), trailer);
+  levels.pop_back();
+  if (trailer) {
+    auto p = ensure(trailer);
+    leWriteUint32(crc32c(0, buffer.data(), length), p);
+    length += trailer;
+  }
+  finished = true;
+  return length;
+}
+
+// 写入header与成员类型描述, 预留长度不符时移动成员数据
+void CapsWriter::close(const Level& level, uint32_t trailer) {
+  uint32_t count = types.size() - level.firstType;
+  uint32_t need = reservedSize(count);
+  uint32_t body = level.start + level.reserved;
+  uint32_t bodySize = length - body;
+  if (need != level.reserved) {
+    if (need > level.reserved)
+      ensure(need - level.reserved);
+    auto b = buffer.data();
+    memmove(b + level.start + need, b + body, bodySize);
+    length = level.start + need + bodySize;
+  }
+  auto p = buffer.data() + level.start;
+  beWriteUint32(need + bodySize + trailer, p);
+  p[sizeof(uint32_t)] = CAPS_VERSION
+    | (levels.size() == 1 ? flags : flags & CAPS_FLAG_FIXED_INT);
+  p = uleb128TryWrite(count, p + HEADER_SIZE, LEB128_MAX_INT32_BYTES);
+  memcpy(p, types.data() + level.firstType, count);
+  types.resize(level.firstType);
+}
+
+} // namespace rokid
@@ -0,0 +1,204 @@
+#include <string.h>
+#include "crc32c.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_X86
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_ARM
+#endif
+
+namespace rokid {
+
+// reflected polynomial
+#define CRC32C_POLY 0x82f63b78
+
+// slicing-by-8
+class Crc32cTable {
+public:
+  Crc32cTable() {
+    uint32_t i, j, c;
+    for (i = 0; i < 256; ++i) {
+      c = i;
+      for (j = 0; j < 8; ++j)
+        c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+      table[0][i] = c;
+    }
+    for (i = 0; i < 256; ++i) {
+      for (j = 1; j < 8; ++j)
+        table[j][i] = (table[j - 1][i] >> 8) ^ table[0][table[j - 1][i] & 0xff];
+    }
+  }
+
+public:
+  uint32_t table[8][256];
+};
+
+static const Crc32cTable& crc32cTable() {
+  static Crc32cTable t;
+  return t;
+}
+
+uint32_t crc32cSoftware(uint32_t crc, const void* data, size_t size) {
+  auto& t = crc32cTable().table;
+  auto p = reinterpret_cast<const uint8_t*>(data);
+  crc = ~crc;
+  while (size >= 8) {
+    uint32_t lo, hi;
+    memcpy(&lo, p, 4);
+    memcpy(&hi, p + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    lo = __builtin_bswap32(lo);
+    hi = __builtin_bswap32(hi);
+#endif
+    lo ^= crc;
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff]
+      ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+      ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff]
+      ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    p += 8;
+    size -= 8;
+  }
+  while (size) {
+    crc = t[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+    ++p;
+    --size;
+  }
+  return ~crc;
+}
+
+#ifdef CRC32C_X86
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(uint32_t crc, const void* data, size_t size) {
+  auto p = reinterpret_cast<const uint8_t*>(data);
+  crc = ~crc;
+  // 对齐到8字节
+  while (size && (reinterpret_cast<uintptr_t>(p) & 7)) {
+    crc = _mm_crc32_u8(crc, *p);
+    ++p;
+    --size;
+  }
+#ifdef __x86_64__
+  uint64_t c = crc;
+  while (size >= 8) {
+    c = _mm_crc32_u64(c, *reinterpret_cast<const uint64_t*>(p));
+    p += 8;
+    size -= 8;
+  }
+  crc = c;
+#endif
+  while (size >= 4) {
+    crc = _mm_crc32_u32(crc, *reinterpret_cast<const uint32_t*>(p));
+    p += 4;
+    size -= 4;
+  }
+  while (size) {
+    crc = _mm_crc32_u8(crc, *p);
+    ++p;
+    --size;
+  }
+  return ~crc;
+}
+
+typedef uint32_t (*Crc32cFunc)(uint32_t, const void*, size_t);
+
+static Crc32cFunc selectCrc32c() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2"))
+    return crc32cHardware;
+  return crc32cSoftware;
+}
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t size) {
+  static const Crc32cFunc func = selectCrc32c();
+  return func(crc, data, size);
+}
+#elif defined(CRC32C_ARM)
+uint32_t crc32c(uint32_t crc, const void* data, size_t size) {
+  auto p = reinterpret_cast<const uint8_t*>(data);
+  crc = ~crc;
+  while (size >= 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    crc = __crc32cd(crc, v);
+    p += 8;
+    size -= 8;
+  }
+  while (size) {
+    crc = __crc32cb(crc, *p);
+    ++p;
+    --size;
+  }
+  return ~crc;
+}
+#else
+uint32_t crc32c(uint32_t crc, const void* data, size_t size) {
+  return crc32cSoftware(crc, data, size);
+}
+#endif
+
+// GF(2)矩阵运算, 计算原始crc状态经过若干0字节后的值
+static uint32_t gf2MatrixTimes(const uint32_t* mat, uint32_t vec) {
+  uint32_t sum{0};
+  while (vec) {
+    if (vec & 1)
+      sum ^= *mat;
+    vec >>= 1;
+    ++mat;
+  }
+  return sum;
+}
+
+static void gf2MatrixSquare(uint32_t* square, const uint32_t* mat) {
+  uint32_t i;
+  for (i = 0; i < 32; ++i)
+    square[i] = gf2MatrixTimes(mat, mat[i]);
+}
+
+// zeros[k]: 2^k个0字节对应的矩阵
+class Crc32cZeros {
+public:
+  Crc32cZeros() {
+    uint32_t tmp[32];
+    uint32_t i, row;
+    // 1个0 bit
+    tmp[0] = CRC32C_POLY;
+    row = 1;
+    for (i = 1; i < 32; ++i) {
+      tmp[i] = row;
+      row <<= 1;
+    }
+    uint32_t two[32];
+    uint32_t four[32];
+    gf2MatrixSquare(two, tmp);
+    gf2MatrixSquare(four, two);
+    gf2MatrixSquare(zeros[0], four);
+    for (i = 1; i < 64; ++i)
+      gf2MatrixSquare(zeros[i], zeros[i - 1]);
+  }
+
+public:
+  uint32_t zeros[64][32];
+};
+
+static uint32_t crc32cShiftZeros(uint32_t crc, size_t len) {
+  static Crc32cZeros t;
+  uint32_t k{0};
+  while (len && crc) {
+    if (len & 1)
+      crc = gf2MatrixTimes(t.zeros[k], crc);
+    len >>= 1;
+    ++k;
+  }
+  return crc;
+}
+
+// crc是线性的: crc(A ^ D) = crc(A) ^ raw(D), raw为不做初始/结果取反的crc
+// D只在被修改字节处非0, 前面的0字节不改变raw状态
+uint32_t crc32cPatch(uint32_t crc, const void* delta, size_t size, size_t tail) {
+  uint32_t raw = ~crc32c(0xffffffff, delta, size);
+  return crc ^ crc32cShiftZeros(raw, tail);
+}
+
+} // namespace rokid
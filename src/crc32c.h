@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace rokid {
+
+/// \brief CRC32C (Castagnoli)
+///        x86_64支持SSE4.2或arm64支持CRC扩展时使用硬件指令, 否则查表计算
+/// \param crc 上一段数据的crc, 第一段数据为0
+uint32_t crc32c(uint32_t crc, const void* data, size_t size);
+
+/// \brief 数据中一段字节被修改后, 由原crc计算新crc, 不必重新遍历数据
+/// \param crc 原数据的crc
+/// \param delta 被修改字节修改前后的异或值
+/// \param size delta长度
+/// \param tail 被修改字节之后的数据长度
+uint32_t crc32cPatch(uint32_t crc, const void* delta, size_t size, size_t tail);
+
+/// \brief 查表实现, 结果与crc32c相同
+uint32_t crc32cSoftware(uint32_t crc, const void* data, size_t size);
+
+} // namespace rokid
@@ -4,3 +4,22 @@
 /// total length: 4 bytes, bigendian byteorder
 /// caps version: 1 byte
 #define HEADER_SIZE 5
+/// \brief CAPS_FLAG_CRC32C校验数据长度
+#define CRC_SIZE 4
+
+#include <stdio.h>
+#include <stdarg.h>
+
+namespace rokid {
+
+template <typename E>
+[[noreturn]] void throwException(const char* format, ...) {
+  char msg[64];
+  va_list ap;
+  va_start(ap, format);
+  vsnprintf(msg, sizeof(msg), format, ap);
+  va_end(ap);
+  throw E(msg);
+}
+
+} // namespace rokid
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace rokid {
+
+/// \brief 浮点数的最短可还原十进制表示(Schubfach算法)
+///        Raffaello Giulietti, "The Schubfach way to render doubles"
+///        输出digits * 10^exp，digits去掉末尾的0后为可还原为v的最短十进制数，
+///        同样长度有多个时取最接近v的。末尾的0留给调用者在输出字符时去掉，
+///        按字符比较比64位除法快得多
+///        每个值只需三次128位乘法，不逐位生成数字
+/// \param v 有限的正数
+void shortestDecimal(double v, uint64_t& digits, int32_t& exp);
+void shortestDecimal(float v, uint64_t& digits, int32_t& exp);
+
+} // namespace rokid
@@ -0,0 +1,890 @@
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "caps.h"
+#include "defs.h"
+#include "member.h"
+#include "dtoa.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace rokid {
+
+// 输出缓冲区, 直接写入std::string内存, 结束时截断为实际长度
+class JsonOutput {
+public:
+  JsonOutput(string& o) : out(o), len(o.length()) {
+  }
+
+  ~JsonOutput() {
+    out.resize(len);
+  }
+
+  // 保证至少n字节可写, 返回写入位置
+  inline char* ensure(size_t n) {
+    if (len + n > out.size())
+      grow(n);
+    return &out[len];
+  }
+
+  inline void commit(char* p) {
+    len = p - &out[0];
+  }
+
+  inline void put(char c) {
+    *ensure(1) = c;
+    ++len;
+  }
+
+  inline void put(const char* s, size_t n) {
+    memcpy(ensure(n), s, n);
+    len += n;
+  }
+
+private:
+  // 容量足够时每次只扩展1KB, clear后复用的string不必将整个容量重新填0
+  void grow(size_t n) {
+    auto size = len + n + 1024;
+    if (size > out.capacity())
+      size = max(size, out.capacity() * 2);
+    out.resize(size);
+  }
+
+private:
+  string& out;
+  size_t len;
+};
+
+static const char DIGIT_PAIRS[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static inline void write2Digits(char* p, uint32_t v) {
+  memcpy(p, DIGIT_PAIRS + v * 2, 2);
+}
+
+static inline void write4Digits(char* p, uint32_t v) {
+  write2Digits(p, v / 100);
+  write2Digits(p + 2, v % 100);
+}
+
+// 写入8位数字, 不足8位补前导0
+static inline void write8Digits(char* p, uint32_t v) {
+  write4Digits(p, v / 10000);
+  write4Digits(p + 4, v % 10000);
+}
+
+// v < 10000, 不补前导0
+static inline char* writeUpTo4Digits(char* p, uint32_t v) {
+  if (v < 100) {
+    if (v < 10) {
+      *p = '0' + v;
+      return p + 1;
+    }
+    write2Digits(p, v);
+    return p + 2;
+  }
+  if (v < 1000) {
+    *p = '0' + v / 100;
+    write2Digits(p + 1, v % 100);
+    return p + 3;
+  }
+  write4Digits(p, v);
+  return p + 4;
+}
+
+// v < 10^8, 不补前导0
+static inline char* writeUpTo8Digits(char* p, uint32_t v) {
+  if (v < 10000)
+    return writeUpTo4Digits(p, v);
+  p = writeUpTo4Digits(p, v / 10000);
+  write4Digits(p, v % 10000);
+  return p + 4;
+}
+
+// 按8位一组以32位运算输出, 避免逐位64位除法
+static char* writeUint64(char* p, uint64_t v) {
+  if (v < 100000000)
+    return writeUpTo8Digits(p, v);
+  if (v < 10000000000000000ULL) {
+    p = writeUpTo8Digits(p, v / 100000000);
+    write8Digits(p, v % 100000000);
+    return p + 8;
+  }
+  auto hi = v / 100000000;
+  p = writeUpTo8Digits(p, hi / 100000000);
+  write8Digits(p, hi % 100000000);
+  write8Digits(p + 8, v % 100000000);
+  return p + 16;
+}
+
+static char* writeInt64(char* p, int64_t v) {
+  if (v < 0) {
+    *p++ = '-';
+    return writeUint64(p, 0 - (uint64_t)v);
+  }
+  return writeUint64(p, v);
+}
+
+// 输出digits * 10^decExp, 格式化为十进制或科学计数法, 返回末尾
+// 移动数字与补0按固定长度进行, 内联为整块读写, 不必按长度调用memmove,
+// 多写入的部分在返回的末尾之后, buf至少需要33字节空间
+static char* formatDecimal(char* buf, uint64_t digits, int32_t decExp) {
+  static const int32_t minExp = -4;
+  static const int32_t maxExp = 15;
+  // 短小数的digits常有十几个末尾0, 先整组去掉低8位, 剩下的输出后按字符去掉
+  if (digits % 100000000 == 0) {
+    digits /= 100000000;
+    decExp += 8;
+  }
+  auto e = writeUint64(buf, digits);
+  // digits不为0
+  while (e[-1] == '0') {
+    --e;
+    ++decExp;
+  }
+  int32_t k = e - buf;
+  int32_t n = k + decExp;
+  int32_t i;
+
+  if (k <= n && n <= maxExp) {
+    // digits[000].0
+    memset(buf + k, '0', 16);
+    buf[n] = '.';
+    buf[n + 1] = '0';
+    return buf + n + 2;
+  }
+  if (0 < n && n <= maxExp) {
+    // dig.its, 小数部分不超过16位
+    memmove(buf + n + 1, buf + n, 16);
+    buf[n] = '.';
+    return buf + k + 1;
+  }
+  if (minExp < n && n <= 0) {
+    // 0.[000]digits
+    memmove(buf + 2 - n, buf, 17);
+    buf[0] = '0';
+    buf[1] = '.';
+    for (i = 2; i < 2 - n; ++i)
+      buf[i] = '0';
+    return buf + 2 - n + k;
+  }
+  // d.igitse[-]xx
+  if (k == 1) {
+    e = buf + 1;
+  } else {
+    memmove(buf + 2, buf + 1, 16);
+    buf[1] = '.';
+    e = buf + k + 1;
+  }
+  *e++ = 'e';
+  return writeInt64(e, n - 1);
+}
+
+// p至少需要34字节空间
+template <typename F>
+static char* writeFloat(char* p, F v, bool json) {
+  if (!std::isfinite(v)) {
+    if (json) {
+      memcpy(p, "null", 4);
+      return p + 4;
+    }
+    if (std::isnan(v)) {
+      memcpy(p, "nan", 3);
+      return p + 3;
+    }
+    if (v < 0)
+      *p++ = '-';
+    memcpy(p, "inf", 3);
+    return p + 3;
+  }
+  if (std::signbit(v)) {
+    *p++ = '-';
+    v = -v;
+  }
+  if (v == 0) {
+    memcpy(p, "0.0", 3);
+    return p + 3;
+  }
+  uint64_t digits;
+  int32_t decExp;
+  shortestDecimal(v, digits, decExp);
+  return formatDecimal(p, digits, decExp);
+}
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+static char* escapeChar(char* p, uint8_t c) {
+  *p++ = '\\';
+  switch (c) {
+  case '"':
+    *p++ = '"';
+    break;
+  case '\\':
+    *p++ = '\\';
+    break;
+  case '\b':
+    *p++ = 'b';
+    break;
+  case '\f':
+    *p++ = 'f';
+    break;
+  case '\n':
+    *p++ = 'n';
+    break;
+  case '\r':
+    *p++ = 'r';
+    break;
+  case '\t':
+    *p++ = 't';
+    break;
+  default:
+    memcpy(p, "u00", 3);
+    p[3] = HEX_DIGITS[c >> 4];
+    p[4] = HEX_DIGITS[c & 0xf];
+    p += 5;
+  }
+  return p;
+}
+
+static inline bool needEscape(uint8_t c) {
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+// 返回第一个需要转义的字符('"', '\\', 控制字符)位置, 不存在则返回end
+static const char* scanPlain(const char* s, const char* end) {
+#if defined(__SSE2__)
+  auto quote = _mm_set1_epi8('"');
+  auto backslash = _mm_set1_epi8('\\');
+  auto ctrl = _mm_set1_epi8(0x1f);
+  while (end - s >= 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    auto m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+          _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl));
+    uint32_t mask = _mm_movemask_epi8(m);
+    if (mask)
+      return s + __builtin_ctz(mask);
+    s += 16;
+  }
+#endif
+  while (s < end && !needEscape(*s))
+    ++s;
+  return s;
+}
+
+static void writeString(JsonOutput& out, const char* s, size_t len) {
+  auto end = s + len;
+  // 不需转义时只检查一次缓冲区, 每个转义字符最多增加5字节
+  auto p = out.ensure(len + 2);
+  *p++ = '"';
+  while (true) {
+    auto b = s;
+    s = scanPlain(s, end);
+    memcpy(p, b, s - b);
+    p += s - b;
+    if (s == end)
+      break;
+    out.commit(p);
+    p = escapeChar(out.ensure(6 + (end - s)), *s);
+    ++s;
+  }
+  *p++ = '"';
+  out.commit(p);
+}
+
+static const char BASE64_CHARS[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void writeBase64(JsonOutput& out, const char* data, size_t len) {
+  auto in = reinterpret_cast<const uint8_t*>(data);
+  auto p = out.ensure((len + 2) / 3 * 4 + 2);
+  *p++ = '"';
+  size_t i;
+  for (i = 0; i + 3 <= len; i += 3) {
+    uint32_t v = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+    p[0] = BASE64_CHARS[v >> 18];
+    p[1] = BASE64_CHARS[(v >> 12) & 0x3f];
+    p[2] = BASE64_CHARS[(v >> 6) & 0x3f];
+    p[3] = BASE64_CHARS[v & 0x3f];
+    p += 4;
+  }
+  if (i < len) {
+    uint32_t v = in[i] << 16;
+    if (i + 1 < len)
+      v |= in[i + 1] << 8;
+    p[0] = BASE64_CHARS[v >> 18];
+    p[1] = BASE64_CHARS[(v >> 12) & 0x3f];
+    p[2] = i + 1 < len ? BASE64_CHARS[(v >> 6) & 0x3f] : '=';
+    p[3] = '=';
+    p += 4;
+  }
+  *p++ = '"';
+  out.commit(p);
+}
+
+void Caps::toJson(string& out) const {
+  JsonOutput o(out);
+  toJson(o, true);
+}
+
+void Caps::toText(string& out) const {
+  JsonOutput o(out);
+  toJson(o, false);
+}
+
+// json: true为JSON格式, false为带类型后缀的紧凑文本格式
+void Caps::toJson(JsonOutput& out, bool json) const {
+  out.put('[');
+  for (auto it = members.begin(); it != members.end(); ++it) {
+    auto& m = *it;
+    // 分隔符与数值一起写入, 浮点数格式化最多需要34字节
+    auto p = out.ensure(35);
+    if (it != members.begin())
+      *p++ = ',';
+    switch (m->type()) {
+    case CAPS_MEMBER_TYPE_INT32:
+      p = writeInt64(p, static_cast<const Int32Member*>(m.get())->value.number);
+      break;
+    case CAPS_MEMBER_TYPE_UINT32:
+      p = writeUint64(p, static_cast<const Uint32Member*>(m.get())->value.number);
+      if (!json)
+        *p++ = 'u';
+      break;
+    case CAPS_MEMBER_TYPE_INT64:
+      p = writeInt64(p, static_cast<const Int64Member*>(m.get())->value.number);
+      if (!json)
+        *p++ = 'l';
+      break;
+    case CAPS_MEMBER_TYPE_UINT64:
+      p = writeUint64(p, static_cast<const Uint64Member*>(m.get())->value.number);
+      if (!json) {
+        *p++ = 'u';
+        *p++ = 'l';
+      }
+      break;
+    case CAPS_MEMBER_TYPE_FLOAT:
+      p = writeFloat<float>(p,
+          static_cast<const FloatMember*>(m.get())->value.number, json);
+      if (!json)
+        *p++ = 'f';
+      break;
+    case CAPS_MEMBER_TYPE_DOUBLE:
+      p = writeFloat<double>(p,
+          static_cast<const DoubleMember*>(m.get())->value.number, json);
+      break;
+    case CAPS_MEMBER_TYPE_STRING: {
+      out.commit(p);
+      auto data = static_cast<const StringMember*>(m.get());
+      writeString(out, data->ptr(), data->length());
+      continue;
+    }
+    case CAPS_MEMBER_TYPE_BINARY: {
+      if (!json)
+        *p++ = 'b';
+      out.commit(p);
+      auto data = static_cast<const BinaryMember*>(m.get());
+      writeBase64(out, data->ptr(), data->length());
+      continue;
+    }
+    case CAPS_MEMBER_TYPE_OBJECT:
+      out.commit(p);
+      static_cast<const ObjectMember*>(m.get())->value.toJson(out, json);
+      continue;
+    case CAPS_MEMBER_TYPE_VOID:
+      if (json) {
+        memcpy(p, "null", 4);
+        p += 4;
+      } else {
+        memcpy(p, "void", 4);
+        p += 4;
+      }
+      break;
+    case CAPS_MEMBER_TYPE_ABSENT:
+      if (json) {
+        memcpy(p, "null", 4);
+        p += 4;
+      } else {
+        memcpy(p, "absent", 6);
+        p += 6;
+      }
+      break;
+    }
+    out.commit(p);
+  }
+  out.put(']');
+}
+
+#define JSON_MAX_DEPTH 512
+
+class JsonParser {
+public:
+  JsonParser(const char* in, uint32_t size) : begin{in}, p{in}, end{in + size} {
+  }
+
+  int32_t parse(Caps& caps) {
+    skipWhitespace();
+    if (p == end)
+      return CAPS_ERR_TRUNCATED;
+    int32_t r;
+    if (*p == '[') {
+      ++p;
+      r = parseArray(caps, 0);
+    } else if (*p == '{') {
+      ++p;
+      r = parseObject(caps, 0);
+    } else {
+      r = parseValue(caps, 0);
+    }
+    if (r != CAPS_SUCCESS)
+      return r;
+    skipWhitespace();
+    return p == end ? CAPS_SUCCESS : CAPS_ERR_CORRUPTED;
+  }
+
+  uint32_t offset() const {
+    return p - begin;
+  }
+
+private:
+  inline void skipWhitespace() {
+    // 多数情况下没有或只有少量空白
+    while (p < end && isWhitespace(*p)) {
+      ++p;
+#if defined(__SSE2__)
+      if (end - p >= 16 && isWhitespace(*p)) {
+        auto sp = _mm_set1_epi8(' ');
+        auto nl = _mm_set1_epi8('\n');
+        auto cr = _mm_set1_epi8('\r');
+        auto tab = _mm_set1_epi8('\t');
+        while (end - p >= 16) {
+          auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+          auto m = _mm_or_si128(
+              _mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, nl)),
+              _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, tab)));
+          uint32_t mask = ~_mm_movemask_epi8(m) & 0xffff;
+          if (mask) {
+            p += __builtin_ctz(mask);
+            return;
+          }
+          p += 16;
+        }
+      }
+#endif
+    }
+  }
+
+  static inline bool isWhitespace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+  }
+
+  // '['已被读取
+  int32_t parseArray(Caps& caps, uint32_t depth) {
+    if (depth >= JSON_MAX_DEPTH)
+      return CAPS_ERR_TOO_DEEP;
+    skipWhitespace();
+    if (p < end && *p == ']') {
+      ++p;
+      return CAPS_SUCCESS;
+    }
+    while (true) {
+      auto r = parseValue(caps, depth);
+      if (r != CAPS_SUCCESS)
+        return r;
+      skipWhitespace();
+      if (p == end)
+        return CAPS_ERR_TRUNCATED;
+      if (*p == ']') {
+        ++p;
+        return CAPS_SUCCESS;
+      }
+      if (*p != ',')
+        return CAPS_ERR_CORRUPTED;
+      ++p;
+      skipWhitespace();
+    }
+  }
+
+  // '{'已被读取, 每个键值对依次写入key, value两个成员
+  int32_t parseObject(Caps& caps, uint32_t depth) {
+    if (depth >= JSON_MAX_DEPTH)
+      return CAPS_ERR_TOO_DEEP;
+    skipWhitespace();
+    if (p < end && *p == '}') {
+      ++p;
+      return CAPS_SUCCESS;
+    }
+    while (true) {
+      if (p == end)
+        return CAPS_ERR_TRUNCATED;
+      if (*p != '"')
+        return CAPS_ERR_CORRUPTED;
+      ++p;
+      auto r = parseString(caps);
+      if (r != CAPS_SUCCESS)
+        return r;
+      skipWhitespace();
+      if (p == end)
+        return CAPS_ERR_TRUNCATED;
+      if (*p != ':')
+        return CAPS_ERR_CORRUPTED;
+      ++p;
+      skipWhitespace();
+      r = parseValue(caps, depth);
+      if (r != CAPS_SUCCESS)
+        return r;
+      skipWhitespace();
+      if (p == end)
+        return CAPS_ERR_TRUNCATED;
+      if (*p == '}') {
+        ++p;
+        return CAPS_SUCCESS;
+      }
+      if (*p != ',')
+        return CAPS_ERR_CORRUPTED;
+      ++p;
+      skipWhitespace();
+    }
+  }
+
+  int32_t parseValue(Caps& caps, uint32_t depth) {
+    if (p == end)
+      return CAPS_ERR_TRUNCATED;
+    switch (*p) {
+    case '[':
+    case '{': {
+      auto m = make_shared<ObjectMember>();
+      auto c = *p++;
+      auto r = c == '[' ? parseArray(m->value, depth + 1)
+        : parseObject(m->value, depth + 1);
+      if (r != CAPS_SUCCESS)
+        return r;
+      caps.members.push_back(m);
+      return CAPS_SUCCESS;
+    }
+    case '"':
+      ++p;
+      return parseString(caps);
+    case 't':
+      return parseLiteral("true", 4, [&caps]() { caps.write(true); });
+    case 'f':
+      return parseLiteral("false", 5, [&caps]() { caps.write(false); });
+    case 'n':
+      return parseLiteral("null", 4, [&caps]() { caps.write(); });
+    }
+    return parseNumber(caps);
+  }
+
+  template <typename F>
+  int32_t parseLiteral(const char* lit, uint32_t len, F f) {
+    if (end - p < len)
+      return CAPS_ERR_TRUNCATED;
+    if (memcmp(p, lit, len))
+      return CAPS_ERR_CORRUPTED;
+    p += len;
+    f();
+    return CAPS_SUCCESS;
+  }
+
+  // '"'已被读取
+  int32_t parseString(Caps& caps) {
+    auto b = p;
+    p = scanPlain(p, end);
+    if (p == end)
+      return CAPS_ERR_TRUNCATED;
+    if (*p == '"') {
+      caps.members.push_back(make_shared<StringMember>(b, p - b));
+      ++p;
+      return CAPS_SUCCESS;
+    }
+    string data(b, p - b);
+    while (true) {
+      if (p == end)
+        return CAPS_ERR_TRUNCATED;
+      if (*p == '"')
+        break;
+      if (*p != '\\')
+        return CAPS_ERR_CORRUPTED;
+      ++p;
+      if (p == end)
+        return CAPS_ERR_TRUNCATED;
+      switch (*p) {
+      case '"':
+      case '\\':
+      case '/':
+        data.push_back(*p);
+        break;
+      case 'b':
+        data.push_back('\b');
+        break;
+      case 'f':
+        data.push_back('\f');
+        break;
+      case 'n':
+        data.push_back('\n');
+        break;
+      case 'r':
+        data.push_back('\r');
+        break;
+      case 't':
+        data.push_back('\t');
+        break;
+      case 'u': {
+        ++p;
+        auto r = parseUnicode(data);
+        if (r != CAPS_SUCCESS)
+          return r;
+        --p;
+        break;
+      }
+      default:
+        return CAPS_ERR_CORRUPTED;
+      }
+      ++p;
+      b = p;
+      p = scanPlain(p, end);
+      data.append(b, p - b);
+    }
+    ++p;
+    auto m = make_shared<StringMember>();
+    m->assign(move(data));
+    caps.members.push_back(m);
+    return CAPS_SUCCESS;
+  }
+
+  int32_t parseHex4(uint32_t& v) {
+    if (end - p < 4)
+      return CAPS_ERR_TRUNCATED;
+    v = 0;
+    int32_t i;
+    for (i = 0; i < 4; ++i) {
+      auto c = p[i];
+      v <<= 4;
+      if (c >= '0' && c <= '9')
+        v |= c - '0';
+      else if (c >= 'a' && c <= 'f')
+        v |= c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F')
+        v |= c - 'A' + 10;
+      else
+        return CAPS_ERR_CORRUPTED;
+    }
+    p += 4;
+    return CAPS_SUCCESS;
+  }
+
+  // "\u"已被读取, 转换为utf8
+  int32_t parseUnicode(string& out) {
+    uint32_t cp;
+    auto r = parseHex4(cp);
+    if (r != CAPS_SUCCESS)
+      return r;
+    if (cp >= 0xd800 && cp <= 0xdbff) {
+      if (end - p < 2)
+        return CAPS_ERR_TRUNCATED;
+      if (p[0] != '\\' || p[1] != 'u')
+        return CAPS_ERR_CORRUPTED;
+      p += 2;
+      uint32_t low;
+      r = parseHex4(low);
+      if (r != CAPS_SUCCESS)
+        return r;
+      if (low < 0xdc00 || low > 0xdfff)
+        return CAPS_ERR_CORRUPTED;
+      cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+    } else if (cp >= 0xdc00 && cp <= 0xdfff) {
+      return CAPS_ERR_CORRUPTED;
+    }
+    if (cp < 0x80) {
+      out.push_back(cp);
+    } else if (cp < 0x800) {
+      out.push_back(0xc0 | (cp >> 6));
+      out.push_back(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+      out.push_back(0xe0 | (cp >> 12));
+      out.push_back(0x80 | ((cp >> 6) & 0x3f));
+      out.push_back(0x80 | (cp & 0x3f));
+    } else {
+      out.push_back(0xf0 | (cp >> 18));
+      out.push_back(0x80 | ((cp >> 12) & 0x3f));
+      out.push_back(0x80 | ((cp >> 6) & 0x3f));
+      out.push_back(0x80 | (cp & 0x3f));
+    }
+    return CAPS_SUCCESS;
+  }
+
+  static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+  }
+
+  // 整数写入可容纳的最小类型, 其余写入double
+  int32_t parseNumber(Caps& caps) {
+    static const double EXACT_POW10[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    auto b = p;
+    bool neg{false};
+    uint64_t mantissa{0};
+    // 尾数超出uint64范围, 之后的数字被舍弃
+    bool truncated{false};
+    int32_t exp10{0};
+    bool isInt{true};
+    auto accumulate = [&mantissa, &truncated](char c) -> bool {
+      uint32_t d = c - '0';
+      if (truncated || mantissa > UINT64_MAX / 10
+          || (mantissa == UINT64_MAX / 10 && d > UINT64_MAX % 10)) {
+        truncated = true;
+        return false;
+      }
+      mantissa = mantissa * 10 + d;
+      return true;
+    };
+
+    if (*p == '-') {
+      neg = true;
+      ++p;
+    }
+    if (p == end)
+      return CAPS_ERR_TRUNCATED;
+    if (!isDigit(*p))
+      return CAPS_ERR_CORRUPTED;
+    if (*p == '0') {
+      ++p;
+    } else {
+      while (p < end && isDigit(*p)) {
+        if (!accumulate(*p))
+          ++exp10;
+        ++p;
+      }
+    }
+    if (p < end && *p == '.') {
+      isInt = false;
+      ++p;
+      if (p == end || !isDigit(*p))
+        return p == end ? CAPS_ERR_TRUNCATED : CAPS_ERR_CORRUPTED;
+      while (p < end && isDigit(*p)) {
+        if (accumulate(*p))
+          --exp10;
+        ++p;
+      }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+      isInt = false;
+      ++p;
+      bool eneg{false};
+      if (p < end && (*p == '-' || *p == '+'))
+        eneg = *p++ == '-';
+      if (p == end || !isDigit(*p))
+        return p == end ? CAPS_ERR_TRUNCATED : CAPS_ERR_CORRUPTED;
+      int32_t e{0};
+      while (p < end && isDigit(*p)) {
+        if (e < 100000)
+          e = e * 10 + (*p - '0');
+        ++p;
+      }
+      exp10 += eneg ? -e : e;
+    }
+
+    if (isInt && !truncated) {
+      if (neg) {
+        if (mantissa <= (uint64_t)INT32_MAX + 1) {
+          caps.write((int32_t)(0 - mantissa));
+          return CAPS_SUCCESS;
+        }
+        if (mantissa <= (uint64_t)INT64_MAX + 1) {
+          caps.write((int64_t)(0 - mantissa));
+          return CAPS_SUCCESS;
+        }
+      } else {
+        if (mantissa <= INT32_MAX)
+          caps.write((int32_t)mantissa);
+        else if (mantissa <= UINT32_MAX)
+          caps.write((uint32_t)mantissa);
+        else if (mantissa <= INT64_MAX)
+          caps.write((int64_t)mantissa);
+        else
+          caps.write(mantissa);
+        return CAPS_SUCCESS;
+      }
+    }
+
+    double d;
+    // 尾数与10的幂都可以精确表示为double时, 一次乘除法结果即为正确舍入
+    if (!truncated && mantissa < ((uint64_t)1 << 53)
+        && exp10 >= -22 && exp10 <= 22) {
+      d = (double)mantissa;
+      d = exp10 < 0 ? d / EXACT_POW10[-exp10] : d * EXACT_POW10[exp10];
+      if (neg)
+        d = -d;
+    } else {
+      char buf[64];
+      string tmp;
+      const char* str;
+      if (p - b < (int32_t)sizeof(buf)) {
+        memcpy(buf, b, p - b);
+        buf[p - b] = '\0';
+        str = buf;
+      } else {
+        tmp.assign(b, p - b);
+        str = tmp.c_str();
+      }
+      d = strtod_l(str, nullptr, cLocale());
+    }
+    caps.write(d);
+    return CAPS_SUCCESS;
+  }
+
+  // strtod受LC_NUMERIC影响(如小数点为','的locale), JSON数值固定按"C" locale解析
+  static locale_t cLocale() {
+    static locale_t loc = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+    return loc;
+  }
+
+private:
+  const char* begin;
+  const char* p;
+  const char* end;
+};
+
+void Caps::parseJson(const char* json, uint32_t size) {
+  uint32_t off;
+  auto r = tryParseJson(json, size, &off);
+  if (r == CAPS_ERR_INVALID_PARAM)
+    throw invalid_argument("json is nullptr");
+  if (r != CAPS_SUCCESS)
+    throwException<domain_error>("invalid json, offset %u", off);
+}
+
+int32_t Caps::tryParseJson(const char* json, uint32_t size, uint32_t* errOffset) {
+  clearMembers();
+  if (json == nullptr) {
+    if (errOffset)
+      *errOffset = 0;
+    return CAPS_ERR_INVALID_PARAM;
+  }
+  JsonParser parser(json, size);
+  auto r = parser.parse(*this);
+  if (r != CAPS_SUCCESS) {
+    clearMembers();
+    if (errOffset)
+      *errOffset = parser.offset();
+  }
+  return r;
+}
+
+} // namespace rokid
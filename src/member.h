@@ -1,5 +1,11 @@
 #pragma once
 
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include "stats.h"
+
 namespace rokid {
 
 class Caps;
@@ -32,23 +38,57 @@ public:
       return "object";
     case CAPS_MEMBER_TYPE_VOID:
       return "void";
+    case CAPS_MEMBER_TYPE_ABSENT:
+      return "absent";
     }
     return "invalid";
   }
+
+  // 可序列化的成员类型
+  static bool isValidType(char type) {
+    switch (type) {
+    case CAPS_MEMBER_TYPE_INT32:
+    case CAPS_MEMBER_TYPE_UINT32:
+    case CAPS_MEMBER_TYPE_INT64:
+    case CAPS_MEMBER_TYPE_UINT64:
+    case CAPS_MEMBER_TYPE_FLOAT:
+    case CAPS_MEMBER_TYPE_DOUBLE:
+    case CAPS_MEMBER_TYPE_STRING:
+    case CAPS_MEMBER_TYPE_BINARY:
+    case CAPS_MEMBER_TYPE_OBJECT:
+    case CAPS_MEMBER_TYPE_VOID:
+      return true;
+    }
+    return false;
+  }
 };
 
 class VoidMember : public Member {
 public:
+  VoidMember() {
+    CAPS_STATS_MEMBER(CAPS_MEMBER_TYPE_VOID);
+  }
+
   char type() const { return 'V'; }
 };
 
+class AbsentMember : public Member {
+public:
+  char type() const { return CAPS_MEMBER_TYPE_ABSENT; }
+};
+
 // T: type
 // TC: type char
 // S: size
 template <typename T, char TC, int32_t S>
 class NumberMember : public Member {
 public:
+  NumberMember() {
+    CAPS_STATS_MEMBER(TC);
+  }
+
   NumberMember(T v) {
+    CAPS_STATS_MEMBER(TC);
     value.number = v;
   }
 
@@ -67,22 +107,103 @@ typedef NumberMember<int64_t, CAPS_MEMBER_TYPE_INT64, 8> Int64Member;
 typedef NumberMember<uint64_t, CAPS_MEMBER_TYPE_UINT64, 8> Uint64Member;
 typedef NumberMember<double, CAPS_MEMBER_TYPE_DOUBLE, 8> DoubleMember;
 
+// 字符串及二进制数据成员
+// 数据为ptr()/length()视图, 通常指向自身持有的own
+// 借用解析(Caps::parseBorrowed)时直接指向输入buffer, 由keepalive持有输入buffer
+class BytesMember : public Member {
+public:
+  BytesMember() = default;
+
+  BytesMember(const BytesMember&) = delete;
+  BytesMember& operator = (const BytesMember&) = delete;
+
+  ~BytesMember() {
+    delete copied.load(std::memory_order_relaxed);
+  }
+
+  inline const char* ptr() const { return view; }
+
+  inline uint32_t length() const { return len; }
+
+  inline bool borrowed() const { return keepalive != nullptr; }
+
+  // 复制数据, 释放借用的buffer
+  void assign(const void* v, uint32_t l) {
+    reset();
+    own.assign(reinterpret_cast<const char*>(v), l);
+    view = own.data();
+    len = l;
+  }
+
+  // 接管v的数据, 不复制
+  void assign(std::string&& v) {
+    reset();
+    own = std::move(v);
+    view = own.data();
+    len = own.length();
+  }
+
+  // 引用v, 不复制数据, k须持有v所指数据
+  void borrow(const void* v, uint32_t l, const std::shared_ptr<const void>& k) {
+    reset();
+    own.clear();
+    keepalive = k;
+    view = reinterpret_cast<const char*>(v);
+    len = l;
+  }
+
+  // 借用的数据在首次调用时复制为std::string, 可能抛出bad_alloc
+  // 多个线程同时首次调用时只保留一份副本
+  const std::string& str() const {
+    if (keepalive == nullptr)
+      return own;
+    auto s = copied.load(std::memory_order_acquire);
+    if (s)
+      return *s;
+    auto n = new std::string(view, len);
+    if (copied.compare_exchange_strong(s, n, std::memory_order_acq_rel))
+      return *n;
+    delete n;
+    return *s;
+  }
+
+  inline bool equals(const BytesMember& o) const {
+    return len == o.len && memcmp(view, o.view, len) == 0;
+  }
+
+private:
+  void reset() {
+    delete copied.exchange(nullptr, std::memory_order_relaxed);
+    keepalive.reset();
+  }
+
+private:
+  std::string own;
+  const char* view{own.data()};
+  uint32_t len{0};
+  std::shared_ptr<const void> keepalive;
+  mutable std::atomic<std::string*> copied{nullptr};
+};
+
 // TC: type char
 template <char TC>
-class DataMember : public Member {
+class DataMember : public BytesMember {
 public:
+  DataMember() {
+    CAPS_STATS_MEMBER(TC);
+  }
+
   DataMember(const char* v) {
-    data = v;
+    CAPS_STATS_MEMBER(TC);
+    assign(v, strlen(v));
   }
 
   DataMember(const void* v, uint32_t l) {
-    data.assign(reinterpret_cast<const char*>(v), l);
+    CAPS_STATS_MEMBER(TC);
+    assign(v, l);
   }
 
   char type() const { return TC; }
-
-public:
-  std::string data;
 };
 typedef DataMember<CAPS_MEMBER_TYPE_STRING> StringMember;
 typedef DataMember<CAPS_MEMBER_TYPE_BINARY> BinaryMember;
@@ -90,15 +211,17 @@ typedef DataMember<CAPS_MEMBER_TYPE_BINARY> BinaryMember;
 class ObjectMember : public Member {
 public:
   ObjectMember(const Caps& o) {
+    CAPS_STATS_MEMBER(CAPS_MEMBER_TYPE_OBJECT);
     value = o;
   }
 
   ObjectMember(Caps&& o) {
+    CAPS_STATS_MEMBER(CAPS_MEMBER_TYPE_OBJECT);
     value = std::move(o);
   }
 
-  ObjectMember(const uint8_t* data, uint32_t size) {
-    value.parse(data, size);
+  ObjectMember() {
+    CAPS_STATS_MEMBER(CAPS_MEMBER_TYPE_OBJECT);
   }
 
   char type() const { return CAPS_MEMBER_TYPE_OBJECT; }
@@ -107,6 +230,12 @@ public:
   Caps value;
 };
 
+// 深度比较成员类型及数据, 与Caps::operator ==一致
+bool memberEqual(const Member* a, const Member* b);
+
+// 比较同类型成员的数据, type为a与b共同的类型
+bool memberDataEqual(const Member* a, const Member* b, char type);
+
 typedef std::shared_ptr<Int32Member> Int32MemberPointer;
 typedef std::shared_ptr<Int64Member> Int64MemberPointer;
 typedef std::shared_ptr<Uint32Member> Uint32MemberPointer;
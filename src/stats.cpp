@@ -0,0 +1,149 @@
+#include <string.h>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include "capsstats.h"
+#include "stats.h"
+
+using namespace std;
+
+namespace rokid {
+
+#ifdef CAPS_STATS
+
+class StatsRegistry {
+public:
+  void add(ThreadStats* s) {
+    lock_guard<mutex> locker(mtx);
+    threads.push_back(s);
+  }
+
+  // 线程退出, 计数并入retired
+  void remove(ThreadStats* s) {
+    lock_guard<mutex> locker(mtx);
+    uint32_t i;
+    for (i = 0; i < STATS_COUNTER_NUM; ++i)
+      retired[i] += s->counters[i].load(memory_order_relaxed);
+    retiredMaxDepth = max(retiredMaxDepth,
+        s->maxDepth.load(memory_order_relaxed));
+    threads.erase(find(threads.begin(), threads.end(), s));
+  }
+
+  CapsStats snapshot() {
+    lock_guard<mutex> locker(mtx);
+    uint64_t total[STATS_COUNTER_NUM];
+    uint32_t depth;
+    collect(total, depth);
+    uint32_t i;
+    for (i = 0; i < STATS_COUNTER_NUM; ++i)
+      total[i] -= baseline[i];
+
+    CapsStats r;
+    r.serializeCalls = total[STATS_SERIALIZE_CALLS];
+    r.serializeBytes = total[STATS_SERIALIZE_BYTES];
+    r.serializeNanos = total[STATS_SERIALIZE_NANOS];
+    r.parseCalls = total[STATS_PARSE_CALLS];
+    r.parseErrors = total[STATS_PARSE_ERRORS];
+    r.parseBytes = total[STATS_PARSE_BYTES];
+    r.parseNanos = total[STATS_PARSE_NANOS];
+    r.nestedObjects = total[STATS_NESTED_OBJECTS];
+    r.maxDepth = depth;
+    r.memberAllocs = 0;
+    for (i = 0; i < CAPS_STATS_TYPE_COUNT; ++i) {
+      r.typeAllocs[i] = total[STATS_TYPE_ALLOCS + i];
+      r.memberAllocs += r.typeAllocs[i];
+    }
+    return r;
+  }
+
+  // 计数器只允许所属线程写入, 清零通过记录基准值实现
+  void reset() {
+    lock_guard<mutex> locker(mtx);
+    uint32_t depth;
+    collect(baseline, depth);
+    for_each(threads.begin(), threads.end(), [](ThreadStats* s) {
+      s->maxDepth.store(0, memory_order_relaxed);
+    });
+    retiredMaxDepth = 0;
+  }
+
+private:
+  void collect(uint64_t* total, uint32_t& depth) {
+    memcpy(total, retired, sizeof(retired));
+    depth = retiredMaxDepth;
+    for_each(threads.begin(), threads.end(), [total, &depth](ThreadStats* s) {
+      uint32_t i;
+      for (i = 0; i < STATS_COUNTER_NUM; ++i)
+        total[i] += s->counters[i].load(memory_order_relaxed);
+      depth = max(depth, s->maxDepth.load(memory_order_relaxed));
+    });
+  }
+
+private:
+  mutex mtx;
+  vector<ThreadStats*> threads;
+  uint64_t retired[STATS_COUNTER_NUM] = { 0 };
+  uint64_t baseline[STATS_COUNTER_NUM] = { 0 };
+  uint32_t retiredMaxDepth{0};
+};
+
+// 不析构, 保证晚于所有线程的ThreadStats
+static StatsRegistry* registry() {
+  static StatsRegistry* r = new StatsRegistry();
+  return r;
+}
+
+ThreadStats::ThreadStats() {
+  uint32_t i;
+  for (i = 0; i < STATS_COUNTER_NUM; ++i)
+    counters[i].store(0, memory_order_relaxed);
+  registry()->add(this);
+}
+
+ThreadStats::~ThreadStats() {
+  registry()->remove(this);
+}
+
+ThreadStats& threadStats() {
+  static thread_local ThreadStats s;
+  return s;
+}
+
+uint64_t CapsStats::memberAllocsOf(char type) const {
+  return typeAllocs[ThreadStats::typeIndex(type)];
+}
+
+bool CapsStats::enabled() {
+  return true;
+}
+
+CapsStats CapsStats::snapshot() {
+  return registry()->snapshot();
+}
+
+void CapsStats::reset() {
+  registry()->reset();
+}
+
+#else // CAPS_STATS
+
+uint64_t CapsStats::memberAllocsOf(char) const {
+  return 0;
+}
+
+bool CapsStats::enabled() {
+  return false;
+}
+
+CapsStats CapsStats::snapshot() {
+  CapsStats r;
+  memset(&r, 0, sizeof(r));
+  return r;
+}
+
+void CapsStats::reset() {
+}
+
+#endif // CAPS_STATS
+
+} // namespace rokid
@@ -0,0 +1,120 @@
+#pragma once
+
+/// \brief 内部统计计数, 未定义CAPS_STATS时所有宏为空
+
+#ifdef CAPS_STATS
+
+#include <time.h>
+#include <atomic>
+#include "caps.h"
+#include "capsstats.h"
+
+namespace rokid {
+
+enum StatsCounter {
+  STATS_SERIALIZE_CALLS,
+  STATS_SERIALIZE_BYTES,
+  STATS_SERIALIZE_NANOS,
+  STATS_PARSE_CALLS,
+  STATS_PARSE_ERRORS,
+  STATS_PARSE_BYTES,
+  STATS_PARSE_NANOS,
+  STATS_NESTED_OBJECTS,
+  STATS_TYPE_ALLOCS,
+  STATS_COUNTER_NUM = STATS_TYPE_ALLOCS + CAPS_STATS_TYPE_COUNT
+};
+
+// 每线程一份, 只有所属线程写入
+// 计数器使用relaxed load + store而不是fetch_add, 热路径上没有原子读改写,
+// 汇总线程读取时也不会产生数据竞争
+class ThreadStats {
+public:
+  ThreadStats();
+
+  ~ThreadStats();
+
+  inline void add(uint32_t i, uint64_t v) {
+    counters[i].store(counters[i].load(std::memory_order_relaxed) + v,
+        std::memory_order_relaxed);
+  }
+
+  inline void enter() {
+    add(STATS_NESTED_OBJECTS, 1);
+    if (++depth > maxDepth.load(std::memory_order_relaxed))
+      maxDepth.store(depth, std::memory_order_relaxed);
+  }
+
+  inline void leave() {
+    --depth;
+  }
+
+  static inline uint32_t typeIndex(char type) {
+    switch (type) {
+    case CAPS_MEMBER_TYPE_INT32:
+      return 0;
+    case CAPS_MEMBER_TYPE_UINT32:
+      return 1;
+    case CAPS_MEMBER_TYPE_INT64:
+      return 2;
+    case CAPS_MEMBER_TYPE_UINT64:
+      return 3;
+    case CAPS_MEMBER_TYPE_FLOAT:
+      return 4;
+    case CAPS_MEMBER_TYPE_DOUBLE:
+      return 5;
+    case CAPS_MEMBER_TYPE_STRING:
+      return 6;
+    case CAPS_MEMBER_TYPE_BINARY:
+      return 7;
+    case CAPS_MEMBER_TYPE_OBJECT:
+      return 8;
+    }
+    return 9;
+  }
+
+  static inline uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  }
+
+public:
+  std::atomic<uint64_t> counters[STATS_COUNTER_NUM];
+  std::atomic<uint32_t> maxDepth{0};
+  uint32_t depth{0};
+};
+
+ThreadStats& threadStats();
+
+} // namespace rokid
+
+#define CAPS_STATS_MEMBER(type) \
+  threadStats().add(STATS_TYPE_ALLOCS + ThreadStats::typeIndex(type), 1)
+#define CAPS_STATS_START(var) uint64_t var = ThreadStats::now()
+#define CAPS_STATS_SERIALIZE(start, bytes) do { \
+  auto& s_ = threadStats(); \
+  s_.add(STATS_SERIALIZE_CALLS, 1); \
+  s_.add(STATS_SERIALIZE_BYTES, bytes); \
+  s_.add(STATS_SERIALIZE_NANOS, ThreadStats::now() - start); \
+} while (0)
+#define CAPS_STATS_PARSE(start, bytes, ok) do { \
+  auto& s_ = threadStats(); \
+  s_.add(STATS_PARSE_CALLS, 1); \
+  s_.add(STATS_PARSE_BYTES, bytes); \
+  s_.add(STATS_PARSE_NANOS, ThreadStats::now() - start); \
+  if (!(ok)) \
+    s_.add(STATS_PARSE_ERRORS, 1); \
+} while (0)
+#define CAPS_STATS_ENTER_OBJECT() threadStats().enter()
+#define CAPS_STATS_LEAVE_OBJECT() threadStats().leave()
+
+#else // CAPS_STATS
+
+#define CAPS_STATS_MEMBER(type)
+#define CAPS_STATS_START(var)
+#define CAPS_STATS_SERIALIZE(start, bytes)
+#define CAPS_STATS_PARSE(start, bytes, ok)
+#define CAPS_STATS_ENTER_OBJECT()
+#define CAPS_STATS_LEAVE_OBJECT()
+
+#endif // CAPS_STATS
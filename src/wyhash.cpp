@@ -0,0 +1,59 @@
+#include "wyhash.h"
+#include "byteorder.h"
+
+namespace rokid {
+
+static inline uint64_t wyr8(const uint8_t* p) {
+  return leReadUint64(p);
+}
+
+static inline uint64_t wyr4(const uint8_t* p) {
+  return leReadUint32(p);
+}
+
+static inline uint64_t wyr3(const uint8_t* p, size_t k) {
+  return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+uint64_t wyhash(const void* data, size_t size, uint64_t seed) {
+  auto p = reinterpret_cast<const uint8_t*>(data);
+  uint64_t a, b;
+  seed ^= wymix(seed ^ WYHASH_P0, WYHASH_P1);
+  if (size <= 16) {
+    if (size >= 4) {
+      a = (wyr4(p) << 32) | wyr4(p + ((size >> 3) << 2));
+      b = (wyr4(p + size - 4) << 32) | wyr4(p + size - 4 - ((size >> 3) << 2));
+    } else if (size > 0) {
+      a = wyr3(p, size);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = size;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = wymix(wyr8(p) ^ WYHASH_P1, wyr8(p + 8) ^ seed);
+        see1 = wymix(wyr8(p + 16) ^ WYHASH_P2, wyr8(p + 24) ^ see1);
+        see2 = wymix(wyr8(p + 32) ^ WYHASH_P3, wyr8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = wymix(wyr8(p) ^ WYHASH_P1, wyr8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = wyr8(p + i - 16);
+    b = wyr8(p + i - 8);
+  }
+  a ^= WYHASH_P1;
+  b ^= seed;
+  wymum(a, b);
+  return wymix(a ^ WYHASH_P0 ^ size, b ^ WYHASH_P1);
+}
+
+} // namespace rokid
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace rokid {
+
+#define WYHASH_P0 0xa0761d6478bd642fULL
+#define WYHASH_P1 0xe7037ed1a0b428dbULL
+#define WYHASH_P2 0x8ebc6af09c88c6e3ULL
+#define WYHASH_P3 0x589965cc75374cc3ULL
+
+// 64x64位乘法, a, b分别输出128位结果的低, 高64位
+static inline void wymum(uint64_t& a, uint64_t& b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)a * b;
+  a = (uint64_t)r;
+  b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  a = lo;
+  b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+// 128位乘积高低64位异或
+static inline uint64_t wymix(uint64_t a, uint64_t b) {
+  wymum(a, b);
+  return a ^ b;
+}
+
+/// \brief wyhash (final4) 字节串哈希
+///        每轮并行处理48字节(三路独立乘法), 结果与字节序无关
+uint64_t wyhash(const void* data, size_t size, uint64_t seed);
+
+// Caps结构哈希, Caps::hash与Caps::hashBinary共用, 保证两者结果一致
+// 成员值按类型转换为64位整数: 整数零扩展, 浮点数取位模式,
+// string/binary为数据的wyhash, object为嵌套Caps的哈希, void/absent为0
+static inline uint64_t capsHashBegin(uint64_t seed, uint32_t count) {
+  return wymix(seed ^ WYHASH_P0, count ^ WYHASH_P1);
+}
+
+static inline uint64_t capsHashMember(uint64_t h, char type, uint64_t v) {
+  return wymix(v ^ WYHASH_P3, h ^ (uint8_t)type ^ WYHASH_P2);
+}
+
+} // namespace rokid
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include "gtest/gtest.h"
+#include "caps.h"
+
+using namespace std;
+using namespace rokid;
+
+// 替换全局operator new统计内存分配次数
+// 只链接到caps-alloc-tests, 不影响caps-tests中的其它测试
+static atomic<uint64_t> allocCount{0};
+
+void* operator new(size_t size) {
+  ++allocCount;
+  auto p = malloc(size ? size : 1);
+  if (p == nullptr)
+    throw bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+TEST(TestCapsAllocs, recycleMembers) {
+  auto build = [](int32_t i, const char* str) {
+    Caps inner;
+    inner.write(str);
+    inner.write((uint64_t)i * 3);
+    Caps caps;
+    caps.write(i);
+    caps.write(i * 0.5);
+    caps.write(str);
+    caps.write(str, strlen(str));
+    caps.write(inner);
+    caps.write();
+    return caps;
+  };
+  vector<vector<uint8_t> > frames;
+  int32_t i;
+  for (i = 0; i < 10; ++i) {
+    auto caps = build(i, i % 2 ? "a string longer than sso buffer"
+        : "short");
+    vector<uint8_t> buf(caps.binarySize());
+    caps.serialize(buf.data(), buf.size());
+    frames.push_back(move(buf));
+  }
+
+  // 结构相同时复用成员, 不分配内存
+  Caps caps;
+  caps.parse(frames[1].data(), frames[1].size());
+  uint64_t allocs = 0;
+  for (i = 0; i < 10; ++i) {
+    auto before = allocCount.load();
+    caps.parse(frames[i].data(), frames[i].size());
+    allocs += allocCount.load() - before;
+    EXPECT_EQ((int32_t)caps[0], i);
+  }
+  EXPECT_EQ(allocs, 0);
+}
+
+TEST(TestCapsAllocs, serializeCache) {
+  Caps config;
+  uint32_t i;
+  for (i = 0; i < 32; ++i) {
+    config.write((int32_t)i);
+    config.write("config value");
+  }
+  Caps plain = config;
+  config.setSerializeCache(4096);
+  Caps msg;
+  msg.write(1);
+  msg.write(config);
+
+  // 命中缓存时不分配内存
+  vector<uint8_t> buf(msg.binarySize());
+  msg.serialize(buf.data(), buf.size());
+  config.serialize(buf.data(), buf.size());
+  auto before = allocCount.load();
+  msg.serialize(buf.data(), buf.size());
+  config.serialize(buf.data(), buf.size());
+  EXPECT_EQ(allocCount.load(), before);
+
+  // 超过maxSize不缓存, 也不分配内存
+  Caps big = plain;
+  big.setSerializeCache(8);
+  buf.resize(big.binarySize());
+  big.serialize(buf.data(), buf.size());
+  before = allocCount.load();
+  big.serialize(buf.data(), buf.size());
+  EXPECT_EQ(allocCount.load(), before);
+}
@@ -0,0 +1,201 @@
+#include <string.h>
+#include <inttypes.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "caps.h"
+#include "capsbatch.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace rokid;
+
+static Caps record(uint32_t i) {
+  Caps inner;
+  inner.write((int32_t)i);
+  Caps caps;
+  caps.write((int32_t)(1000 - i));
+  caps.write(i * 3);
+  caps.write((int64_t)i << 40);
+  caps.write((uint64_t)1700000000000ULL + i);
+  caps.write(i * 0.5f);
+  caps.write(i * 0.25);
+  caps.write(("name-" + to_string(i)).c_str());
+  caps.write("\0bin", i % 5);
+  caps.write(inner);
+  caps.write();
+  return caps;
+}
+
+TEST(TestCapsBatch, roundTrip) {
+  CapsBatch batch;
+  const uint32_t count = 1000;
+  uint32_t i;
+  for (i = 0; i < count; ++i)
+    batch.append(record(i));
+  EXPECT_EQ(batch.rows(), count);
+  EXPECT_EQ(batch.columns(), 10);
+  EXPECT_EQ(batch.columnType(6), CAPS_MEMBER_TYPE_STRING);
+  for (i = 0; i < count; i += 37)
+    EXPECT_EQ(batch.row(i), record(i));
+
+  vector<uint8_t> buf(batch.binarySize());
+  EXPECT_EQ(batch.serialize(buf.data(), buf.size()), buf.size());
+  CapsBatch parsed;
+  parsed.parse(buf.data(), buf.size());
+  EXPECT_EQ(parsed.rows(), count);
+  Caps row;
+  for (i = 0; i < count; ++i) {
+    parsed.row(i, row);
+    EXPECT_EQ(row, record(i));
+  }
+
+  // 整列读取
+  const int32_t* c0;
+  const uint64_t* c3;
+  const double* c5;
+  parsed.column(0, c0);
+  parsed.column(3, c3);
+  parsed.column(5, c5);
+  for (i = 0; i < count; ++i) {
+    EXPECT_EQ(c0[i], (int32_t)(1000 - i));
+    EXPECT_EQ(c3[i], 1700000000000ULL + i);
+    EXPECT_EQ(c5[i], i * 0.25);
+  }
+  const void* data;
+  uint32_t size;
+  parsed.cell(6, 12, data, size);
+  EXPECT_EQ(string((const char*)data, size), "name-12");
+  parsed.cell(7, 3, data, size);
+  EXPECT_EQ(size, 3);
+  EXPECT_EQ(memcmp(data, "\0bi", 3), 0);
+  EXPECT_THROW(parsed.column(1, c0), Caps::type_error);
+  EXPECT_THROW(parsed.column(10, c0), out_of_range);
+  EXPECT_THROW(parsed.cell(0, 0, data, size), Caps::type_error);
+  EXPECT_THROW(parsed.cell(6, count, data, size), out_of_range);
+  EXPECT_THROW(parsed.row(count), out_of_range);
+
+  // 空batch
+  CapsBatch empty;
+  buf.resize(empty.binarySize());
+  empty.serialize(buf.data(), buf.size());
+  parsed.parse(buf.data(), buf.size());
+  EXPECT_EQ(parsed.rows(), 0);
+  EXPECT_EQ(parsed.columns(), 0);
+}
+
+TEST(TestCapsBatch, append) {
+  CapsBatch batch;
+  batch.append(record(0));
+  Caps other;
+  other.write(1);
+  EXPECT_EQ(batch.tryAppend(other), CAPS_ERR_TYPE_MISMATCH);
+  EXPECT_THROW(batch.append(other), invalid_argument);
+  Caps wrongType;
+  uint32_t i;
+  for (i = 0; i < batch.columns(); ++i)
+    wrongType.write((int32_t)i);
+  EXPECT_EQ(batch.tryAppend(wrongType), CAPS_ERR_TYPE_MISMATCH);
+
+  // 嵌套Caps不可序列化时回退整行
+  vector<uint8_t> buf(record(1).binarySize());
+  record(1).serialize(buf.data(), buf.size());
+  Caps projected;
+  projected.parse(buf.data(), buf.size(), Caps::Projection{ "0" });
+  EXPECT_EQ(batch.tryAppend(projected), CAPS_ERR_INVALID_PARAM);
+  projected.parse(buf.data(), buf.size(), Caps::Projection{ "1" });
+  Caps nested;
+  nested.write(-1);
+  nested.write(1u);
+  nested.write((int64_t)1);
+  nested.write((uint64_t)1);
+  nested.write(1.0f);
+  nested.write(1.0);
+  nested.write("s");
+  nested.write("b", 1);
+  nested.write(projected);
+  nested.write();
+  EXPECT_EQ(batch.tryAppend(nested), CAPS_ERR_INVALID_PARAM);
+  EXPECT_EQ(batch.rows(), 1);
+  batch.append(record(1));
+  EXPECT_EQ(batch.rows(), 2);
+  EXPECT_EQ(batch.row(1), record(1));
+
+  batch.clear();
+  EXPECT_EQ(batch.rows(), 0);
+  batch.append(other);
+  EXPECT_EQ(batch.columns(), 1);
+}
+
+TEST(TestCapsBatch, corrupted) {
+  CapsBatch batch;
+  uint32_t i;
+  for (i = 0; i < 16; ++i)
+    batch.append(record(i));
+  vector<uint8_t> buf(batch.binarySize());
+  batch.serialize(buf.data(), buf.size());
+  CapsBatch parsed;
+  EXPECT_EQ(parsed.tryParse(buf.data(), buf.size() - 1), CAPS_ERR_INVALID_PARAM);
+  auto bad = buf;
+  bad[4] = CAPS_VERSION;
+  EXPECT_EQ(parsed.tryParse(bad.data(), bad.size()), CAPS_ERR_VERSION);
+  EXPECT_THROW(parsed.parse(bad.data(), bad.size()), domain_error);
+  // 截断的数据均返回错误
+  for (i = 6; i < buf.size(); ++i) {
+    bad.assign(buf.begin(), buf.begin() + i);
+    bad[0] = i >> 24;
+    bad[1] = i >> 16;
+    bad[2] = i >> 8;
+    bad[3] = i;
+    EXPECT_NE(parsed.tryParse(bad.data(), i), CAPS_SUCCESS);
+    EXPECT_EQ(parsed.rows(), 0);
+  }
+  // Caps数据不是batch
+  auto caps = record(0);
+  bad.resize(caps.binarySize());
+  caps.serialize(bad.data(), bad.size());
+  EXPECT_EQ(parsed.tryParse(bad.data(), bad.size()), CAPS_ERR_VERSION);
+}
+
+TEST(TestCapsBatch, benchmark) {
+  const uint32_t count = 10000;
+  CapsBatch batch;
+  uint32_t i;
+  uint32_t rowBytes{0};
+  vector<vector<uint8_t>> frames(count);
+  for (i = 0; i < count; ++i) {
+    Caps caps;
+    caps.write(i);
+    caps.write((uint64_t)1700000000000ULL + i * 10);
+    caps.write(i * 0.5);
+    caps.write((int32_t)(i % 100));
+    batch.append(caps);
+    frames[i].resize(caps.binarySize());
+    caps.serialize(frames[i].data(), frames[i].size());
+    rowBytes += frames[i].size();
+  }
+  vector<uint8_t> buf(batch.binarySize());
+  batch.serialize(buf.data(), buf.size());
+
+  // 求第2列之和: 逐行parse与列式读取
+  double sum{0};
+  auto tp = steady_clock::now();
+  Caps caps;
+  for (i = 0; i < count; ++i) {
+    caps.parse(frames[i].data(), frames[i].size());
+    sum += (double)caps[2];
+  }
+  auto rowTime = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  tp = steady_clock::now();
+  CapsBatch parsed;
+  parsed.parse(buf.data(), buf.size());
+  const double* col;
+  parsed.column(2, col);
+  for (i = 0; i < parsed.rows(); ++i)
+    sum += col[i];
+  auto colTime = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  printf("rows: %u bytes, %" PRId64 "us; batch: %u bytes, %" PRId64 "us (%f)\n",
+      rowBytes, (int64_t)rowTime, (uint32_t)buf.size(), (int64_t)colTime, sum);
+  EXPECT_LT(buf.size(), rowBytes / 2);
+}
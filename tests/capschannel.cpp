@@ -0,0 +1,208 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include "gtest/gtest.h"
+#include "capschannel.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace rokid;
+
+static Caps message(uint32_t i) {
+  Caps caps;
+  caps.write(i);
+  caps.write(string(i % 300, 'a' + i % 26));
+  return caps;
+}
+
+class TestCapsChannel : public testing::Test {
+protected:
+  void SetUp() {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+    a.reset(new CapsChannel(fds[0], 256 * 1024));
+    b.reset(new CapsChannel(fds[1], 256 * 1024));
+  }
+
+  unique_ptr<CapsChannel> a;
+  unique_ptr<CapsChannel> b;
+};
+
+TEST_F(TestCapsChannel, sendRecv) {
+  const uint32_t count = 10000;
+  uint32_t sent{0};
+  uint32_t received{0};
+  Caps caps;
+  // 单线程交替发送与接收
+  while (received < count) {
+    while (sent < count && a->trySend(message(sent)))
+      ++sent;
+    a->flush();
+    while (b->tryRecv(caps)) {
+      EXPECT_EQ(caps, message(received));
+      ++received;
+    }
+  }
+  EXPECT_EQ(sent, count);
+  EXPECT_FALSE(b->tryRecv(caps));
+
+  // 已序列化数据与双向通信
+  auto m = message(7);
+  vector<uint8_t> buf(m.binarySize());
+  m.serialize(buf.data(), buf.size());
+  EXPECT_TRUE(b->trySend(buf.data(), buf.size()));
+  EXPECT_THROW(b->trySend(buf.data(), buf.size() - 1), invalid_argument);
+  b->flush();
+  ASSERT_TRUE(a->recv(caps, 1000));
+  EXPECT_EQ(caps, m);
+}
+
+TEST_F(TestCapsChannel, largeMessage) {
+  string big(200 * 1024, 'x');
+  Caps caps;
+  caps.write(big.data(), big.size());
+  thread t([this, &caps]() {
+    a->send(caps, CAPS_FLAG_CRC32C);
+    while (a->flush())
+      a->poll(-1);
+  });
+  Caps r;
+  ASSERT_TRUE(b->recv(r, 5000));
+  t.join();
+  EXPECT_EQ(r, caps);
+}
+
+TEST_F(TestCapsChannel, backpressure) {
+  // 接收端不读取, 内核缓冲区及发送队列满后trySend失败
+  uint32_t sent{0};
+  while (a->trySend(message(sent)))
+    ++sent;
+  EXPECT_GT(sent, 0);
+  EXPECT_GT(a->pendingSend(), 0);
+  EXPECT_LE(a->pendingSend(), 256 * 1024);
+  uint32_t received{0};
+  Caps caps;
+  while (received < sent) {
+    a->poll(0);
+    while (b->tryRecv(caps)) {
+      EXPECT_EQ(caps, message(received));
+      ++received;
+    }
+  }
+  EXPECT_EQ(a->pendingSend(), 0);
+}
+
+TEST_F(TestCapsChannel, closed) {
+  a->send(message(1));
+  a->flush();
+  a.reset();
+  Caps caps;
+  // 对端关闭前发送的消息仍可读取
+  EXPECT_TRUE(b->recv(caps, 1000));
+  EXPECT_EQ(caps, message(1));
+  EXPECT_FALSE(b->recv(caps, 1000));
+  EXPECT_TRUE(b->closed());
+  EXPECT_THROW(b->trySend(message(2)), logic_error);
+}
+
+TEST_F(TestCapsChannel, corrupted) {
+  uint8_t garbage[] = { 0, 0, 0, 8, 1, 2, 3, 4 };
+  ASSERT_EQ(write(a->fd(), garbage, sizeof(garbage)), sizeof(garbage));
+  Caps caps;
+  EXPECT_THROW(b->recv(caps, 1000), domain_error);
+  // 格式错误的消息已被丢弃
+  a->send(message(3));
+  a->flush();
+  EXPECT_TRUE(b->recv(caps, 1000));
+  EXPECT_EQ(caps, message(3));
+
+  uint8_t tooBig[] = { 0x10, 0, 0, 0 };
+  ASSERT_EQ(write(a->fd(), tooBig, sizeof(tooBig)), sizeof(tooBig));
+  EXPECT_THROW(b->recv(caps, 1000), length_error);
+}
+
+TEST_F(TestCapsChannel, timeout) {
+  Caps caps;
+  auto tp = steady_clock::now();
+  EXPECT_FALSE(b->recv(caps, 50));
+  EXPECT_GE(duration_cast<milliseconds>(steady_clock::now() - tp).count(), 45);
+  EXPECT_FALSE(b->recv(caps, 0));
+  EXPECT_EQ(b->poll(0), 0);
+}
+
+TEST(TestCapsChannelPipe, badFd) {
+  // 普通文件不支持epoll, 构造失败时fd被关闭
+  int fd = open("/dev/null", O_RDONLY);
+  ASSERT_GE(fd, 0);
+  EXPECT_THROW(CapsChannel{ fd }, system_error);
+  EXPECT_EQ(fcntl(fd, F_GETFD), -1);
+  EXPECT_EQ(errno, EBADF);
+}
+
+TEST(TestCapsChannelPipe, pipe) {
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  CapsChannel reader(fds[0]);
+  CapsChannel writer(fds[1]);
+  uint32_t i;
+  for (i = 0; i < 100; ++i)
+    writer.send(message(i));
+  writer.flush();
+  Caps caps;
+  for (i = 0; i < 100; ++i) {
+    ASSERT_TRUE(reader.recv(caps, 1000));
+    EXPECT_EQ(caps, message(i));
+  }
+}
+
+TEST_F(TestCapsChannel, benchmark) {
+  const uint32_t count = 200000;
+  Caps m;
+  m.write(1);
+  m.write("a short payload string");
+  m.write(3.5);
+  // 吞吐: 发送线程连续发送, 接收线程连续接收
+  auto tp = steady_clock::now();
+  thread t([this, &m]() {
+    uint32_t i;
+    for (i = 0; i < count; ++i)
+      a->send(m);
+    while (a->flush())
+      a->poll(-1);
+  });
+  Caps caps;
+  uint32_t i;
+  for (i = 0; i < count; ++i)
+    ASSERT_TRUE(b->recv(caps));
+  t.join();
+  auto us = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  printf("throughput: %u messages in %" PRId64 "us, %.0f messages/s\n",
+      count, (int64_t)us, count * 1000000.0 / us);
+
+  // 延迟: ping-pong往返
+  const uint32_t rounds = 10000;
+  thread echo([this]() {
+    Caps c;
+    uint32_t j;
+    for (j = 0; j < rounds; ++j) {
+      b->recv(c);
+      b->send(c);
+      b->flush();
+    }
+  });
+  tp = steady_clock::now();
+  for (i = 0; i < rounds; ++i) {
+    a->send(m);
+    a->flush();
+    ASSERT_TRUE(a->recv(caps));
+  }
+  echo.join();
+  us = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  printf("latency: %.2fus per round trip\n", (double)us / rounds);
+}
@@ -0,0 +1,223 @@
+#include <inttypes.h>
+#include <chrono>
+#include "gtest/gtest.h"
+#include "caps.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace rokid;
+
+// 模拟设备状态: 若干标量字段及嵌套的子模块状态
+static Caps deviceState(uint32_t seq, uint32_t volume, const char* mode) {
+  Caps wifi;
+  wifi.write("ssid-of-home-network");
+  wifi.write(-47);
+  wifi.write(true);
+  Caps audio;
+  audio.write(volume);
+  audio.write(mode);
+  audio.write(0.5f);
+  Caps state;
+  state.write(seq);
+  state.write("device serial 0123456789");
+  state.write(wifi);
+  state.write(audio);
+  uint32_t i;
+  for (i = 0; i < 64; ++i)
+    state.write((int32_t)i * 100);
+  return state;
+}
+
+static Caps roundTrip(const Caps& caps) {
+  vector<uint8_t> buf(caps.binarySize());
+  caps.serialize(buf.data(), buf.size());
+  Caps r;
+  r.parse(buf.data(), buf.size());
+  return r;
+}
+
+TEST(TestCapsDiff, simple) {
+  auto a = deviceState(1, 30, "normal");
+  auto b = deviceState(1, 30, "normal");
+  // 相等时补丁只有成员数量
+  auto patch = Caps::diff(a, b);
+  EXPECT_EQ(patch.size(), 1);
+  EXPECT_EQ((uint32_t)patch[0], b.size());
+
+  // 修改标量及嵌套Caps中的成员
+  b = deviceState(2, 40, "normal");
+  patch = Caps::diff(a, b);
+  ASSERT_EQ(patch.size(), 5);
+  EXPECT_EQ((uint32_t)patch[1], 0 << 1);
+  EXPECT_EQ((uint32_t)patch[2], 2);
+  EXPECT_EQ((uint32_t)patch[3], 3 << 1 | 1);
+  Caps sub = patch[4];
+  ASSERT_EQ(sub.size(), 3);
+  EXPECT_EQ((uint32_t)sub[1], 0 << 1);
+  EXPECT_EQ((uint32_t)sub[2], 40);
+
+  // 补丁序列化传输后应用
+  auto c = roundTrip(a);
+  c.apply(roundTrip(patch));
+  EXPECT_EQ(c, b);
+  a.apply(patch);
+  EXPECT_EQ(a, b);
+}
+
+TEST(TestCapsDiff, appendRemove) {
+  Caps a;
+  a.write(1);
+  a.write("two");
+  Caps b = a;
+  b.write(3.0);
+  b.write();
+  auto patch = Caps::diff(a, b);
+  EXPECT_EQ(patch.size(), 5);
+  Caps c = a;
+  c.apply(patch);
+  EXPECT_EQ(c, b);
+
+  // 删除末尾成员
+  patch = Caps::diff(b, a);
+  EXPECT_EQ(patch.size(), 1);
+  c.apply(patch);
+  EXPECT_EQ(c, a);
+
+  // 类型改变及删除全部成员
+  Caps d;
+  d.write("one");
+  patch = Caps::diff(a, d);
+  c.apply(patch);
+  EXPECT_EQ(c, d);
+  c.apply(Caps::diff(d, Caps()));
+  EXPECT_TRUE(c.empty());
+
+  // 嵌套Caps全部成员被替换时整体替换
+  Caps x;
+  x.write(Caps{ 1, 2 });
+  Caps y;
+  y.write(Caps{ 3, 4 });
+  patch = Caps::diff(x, y);
+  ASSERT_EQ(patch.size(), 3);
+  EXPECT_EQ((uint32_t)patch[1], 0);
+  x.apply(patch);
+  EXPECT_EQ(x, y);
+}
+
+TEST(TestCapsDiff, copyOnWrite) {
+  auto a = deviceState(1, 30, "normal");
+  auto b = deviceState(1, 30, "mute");
+  Caps snapshot = a;
+  Caps audio = a[3];
+  auto patch = Caps::diff(a, b);
+  a.apply(patch);
+  EXPECT_EQ(a, b);
+  // 共享的嵌套Caps未被修改
+  EXPECT_EQ(snapshot, deviceState(1, 30, "normal"));
+  EXPECT_EQ((const string&)audio[1], "normal");
+  // 未修改的成员不复制
+  const Caps* before;
+  const Caps* after;
+  ASSERT_EQ(snapshot.tryGet(2, before), CAPS_SUCCESS);
+  ASSERT_EQ(a.tryGet(2, after), CAPS_SUCCESS);
+  EXPECT_EQ(before, after);
+  EXPECT_EQ(a.hash(), b.hash());
+}
+
+TEST(TestCapsDiff, corrupted) {
+  auto a = deviceState(1, 30, "normal");
+  auto b = deviceState(2, 40, "normal");
+  auto copy = a;
+  auto patch = Caps::diff(a, b);
+
+  EXPECT_EQ(a.tryApply(Caps()), CAPS_ERR_CORRUPTED);
+  EXPECT_EQ(a.tryApply(Caps{ "x" }), CAPS_ERR_CORRUPTED);
+  EXPECT_EQ(a.tryApply(Caps{ a.size(), 0u }), CAPS_ERR_CORRUPTED);
+  // 下标越界或非递增
+  EXPECT_EQ(a.tryApply(Caps{ a.size(), a.size() << 1, 1 }), CAPS_ERR_CORRUPTED);
+  EXPECT_EQ(a.tryApply(Caps{ a.size(), 4u << 1, 1, 2u << 1, 1 }),
+      CAPS_ERR_CORRUPTED);
+  // 追加的成员不完整
+  EXPECT_EQ(a.tryApply(Caps{ a.size() + 2, a.size() << 1, 1 }),
+      CAPS_ERR_CORRUPTED);
+  // 嵌套补丁对应的成员不是Caps
+  Caps nested;
+  nested.write(a.size());
+  nested.write(0u << 1 | 1);
+  nested.write(Caps{ 1u });
+  EXPECT_EQ(a.tryApply(nested), CAPS_ERR_CORRUPTED);
+  // 嵌套补丁本身格式错误, 已检查的修改项不生效
+  Caps bad;
+  bad.write(a.size());
+  bad.write(0u << 1);
+  bad.write(99u);
+  bad.write(3u << 1 | 1);
+  bad.write(Caps{ 3u, 7u << 1, 1 });
+  EXPECT_EQ(a.tryApply(bad), CAPS_ERR_CORRUPTED);
+  EXPECT_THROW(a.apply(bad), domain_error);
+  EXPECT_EQ(a.tryApply(a), CAPS_ERR_CORRUPTED);
+  EXPECT_EQ(a, copy);
+
+  EXPECT_EQ(a.tryApply(patch), CAPS_SUCCESS);
+  EXPECT_EQ(a, b);
+}
+
+TEST(TestCapsDiff, benchmark) {
+  // 每秒同步一次状态, 只有序号及音量变化, 状态在计时之外构造
+  const uint32_t rounds = 2000;
+  vector<Caps> states;
+  uint32_t i;
+  for (i = 0; i <= rounds; ++i)
+    states.push_back(deviceState(i, 30 + i % 10, "normal"));
+  vector<uint8_t> buf(states[0].binarySize() * 2);
+  vector<vector<uint8_t> > fullFrames;
+  vector<vector<uint8_t> > patchFrames;
+  uint64_t fullBytes{0};
+  uint64_t patchBytes{0};
+
+  // 发送端: 序列化完整状态 / 比较后序列化补丁
+  auto tp = steady_clock::now();
+  for (i = 1; i <= rounds; ++i)
+    fullBytes += states[i].serialize(buf.data(), buf.size());
+  auto sendFull = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  tp = steady_clock::now();
+  for (i = 1; i <= rounds; ++i) {
+    auto patch = Caps::diff(states[i - 1], states[i]);
+    patchBytes += patch.serialize(buf.data(), buf.size());
+  }
+  auto sendPatch = duration_cast<microseconds>(
+      steady_clock::now() - tp).count();
+  EXPECT_LT(patchBytes * 5, fullBytes);
+
+  for (i = 1; i <= rounds; ++i) {
+    auto n = states[i].serialize(buf.data(), buf.size());
+    fullFrames.emplace_back(buf.data(), buf.data() + n);
+    n = Caps::diff(states[i - 1], states[i]).serialize(buf.data(), buf.size());
+    patchFrames.emplace_back(buf.data(), buf.data() + n);
+  }
+
+  // 接收端: 解析完整状态 / 解析补丁后应用
+  Caps full;
+  tp = steady_clock::now();
+  for (i = 0; i < rounds; ++i)
+    full.parse(fullFrames[i].data(), fullFrames[i].size());
+  auto recvFull = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  Caps remote = states[0];
+  Caps patch;
+  tp = steady_clock::now();
+  for (i = 0; i < rounds; ++i) {
+    patch.parse(patchFrames[i].data(), patchFrames[i].size());
+    remote.apply(patch);
+  }
+  auto recvPatch = duration_cast<microseconds>(
+      steady_clock::now() - tp).count();
+  // 接收端逐个应用补丁, 结果与最后的状态相同
+  EXPECT_EQ(remote, states[rounds]);
+  EXPECT_EQ(full, states[rounds]);
+
+  printf("%u rounds: full %" PRIu64 " bytes, patch %" PRIu64 " bytes\n"
+      "send: serialize %" PRId64 "us, diff+serialize %" PRId64 "us\n"
+      "recv: parse %" PRId64 "us, parse+apply %" PRId64 "us\n",
+      rounds, fullBytes, patchBytes, (int64_t)sendFull, (int64_t)sendPatch,
+      (int64_t)recvFull, (int64_t)recvPatch);
+}
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "gtest/gtest.h"
+#include "capsfile.h"
+
+using namespace std;
+using namespace rokid;
+
+class TestCapsFile : public testing::Test {
+protected:
+  void SetUp() {
+    char tmpl[] = "/tmp/caps-file-test-XXXXXX";
+    int fd = mkstemp(tmpl);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    unlink(tmpl);
+    path = tmpl;
+  }
+
+  void TearDown() {
+    unlink(path.c_str());
+    unlink((path + ".idx").c_str());
+  }
+
+  void writeRecords(uint32_t n) {
+    CapsFileWriter writer;
+    writer.open(path.c_str());
+    uint32_t i;
+    for (i = 0; i < n; ++i) {
+      Caps caps;
+      caps << (int32_t)i;
+      caps << string(i % 50, 'x');
+      writer.append(caps, 1000 + i);
+    }
+    writer.sync();
+  }
+
+  void checkRecords(uint32_t n) {
+    CapsFileReader reader;
+    reader.open(path.c_str(), true);
+    ASSERT_EQ(reader.count(), n);
+    uint32_t i;
+    for (i = 0; i < n; ++i) {
+      Caps caps;
+      EXPECT_EQ(reader.tryRead(i, caps), CAPS_SUCCESS);
+      EXPECT_EQ((int32_t)caps[0], (int32_t)i);
+      EXPECT_EQ(((const string&)caps[1]).length(), i % 50);
+      EXPECT_EQ(reader.timestamp(i), 1000 + i);
+    }
+    Caps caps;
+    EXPECT_EQ(reader.tryRead(n, caps), CAPS_ERR_OUT_OF_RANGE);
+    EXPECT_THROW(reader.read(n, caps), out_of_range);
+  }
+
+  off_t fileSize(const string& p) {
+    struct stat st;
+    stat(p.c_str(), &st);
+    return st.st_size;
+  }
+
+  string path;
+};
+
+TEST_F(TestCapsFile, appendAndRead) {
+  writeRecords(100);
+  checkRecords(100);
+  // 再次打开追加
+  writeRecords(10);
+  CapsFileReader reader;
+  reader.open(path.c_str());
+  EXPECT_EQ(reader.count(), 110);
+
+  uint32_t size;
+  auto data = reader.data(3, size);
+  CapsFileWriter writer;
+  writer.open(path.c_str());
+  writer.append(data, size, 7);
+  EXPECT_EQ(writer.count(), 111);
+  EXPECT_THROW(writer.append(data, size - 1, 7), invalid_argument);
+}
+
+TEST_F(TestCapsFile, tornRecord) {
+  writeRecords(20);
+  auto logSize = fileSize(path);
+  auto indexSize = fileSize(path + ".idx");
+
+  // 末尾写入不完整的记录
+  int fd = open(path.c_str(), O_WRONLY | O_APPEND);
+  char garbage[11] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 100 };
+  write(fd, garbage, sizeof(garbage));
+  close(fd);
+  // 索引项不完整
+  fd = open((path + ".idx").c_str(), O_WRONLY | O_APPEND);
+  write(fd, garbage, 5);
+  close(fd);
+
+  CapsFileWriter writer;
+  writer.open(path.c_str());
+  EXPECT_EQ(writer.count(), 20);
+  writer.close();
+  EXPECT_EQ(fileSize(path), logSize);
+  EXPECT_EQ(fileSize(path + ".idx"), indexSize);
+  checkRecords(20);
+}
+
+TEST_F(TestCapsFile, missingIndex) {
+  writeRecords(20);
+  // 丢失最后5个索引项, 以及最后一条记录的一部分数据
+  truncate((path + ".idx").c_str(), fileSize(path + ".idx") - 5 * 16);
+  truncate(path.c_str(), fileSize(path) - 3);
+
+  CapsFileWriter writer;
+  writer.open(path.c_str());
+  EXPECT_EQ(writer.count(), 19);
+  writer.close();
+  checkRecords(19);
+}
+
+TEST_F(TestCapsFile, notCapsFile) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+  write(fd, "hello world", 11);
+  close(fd);
+  CapsFileWriter writer;
+  EXPECT_THROW(writer.open(path.c_str()), domain_error);
+  CapsFileReader reader;
+  EXPECT_THROW(reader.open(path.c_str()), domain_error);
+}
@@ -0,0 +1,217 @@
+#include <unistd.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <thread>
+#include "gtest/gtest.h"
+#include "capsring.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace rokid;
+
+static Caps message(uint32_t i) {
+  Caps caps;
+  caps.write(i);
+  caps.write(string(i % 300, 'a' + i % 26));
+  return caps;
+}
+
+// 子进程中执行fn, 返回子进程退出码
+template <typename F>
+static pid_t forkRun(F fn) {
+  auto pid = fork();
+  if (pid == 0)
+    _exit(fn());
+  return pid;
+}
+
+static int waitExit(pid_t pid) {
+  int status;
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+    return -1;
+  return WEXITSTATUS(status);
+}
+
+TEST(TestCapsRing, forkProducer) {
+  CapsRing ring;
+  ring.create(16 * 1024);
+  const uint32_t count = 100000;
+  // 子进程写入, 数据总量远大于缓冲区, 生产者需等待消费者
+  auto pid = forkRun([&ring]() {
+    uint32_t i;
+    for (i = 0; i < count; ++i) {
+      if (!ring.write(message(i), i % 2 ? CAPS_FLAG_CRC32C : 0, 5000))
+        return 1;
+    }
+    return 0;
+  });
+  ASSERT_GT(pid, 0);
+  Caps caps;
+  uint32_t i;
+  for (i = 0; i < count; ++i) {
+    ASSERT_TRUE(ring.read(caps, 5000));
+    ASSERT_EQ(caps, message(i));
+  }
+  EXPECT_EQ(waitExit(pid), 0);
+  EXPECT_FALSE(ring.tryRead(caps));
+}
+
+TEST(TestCapsRing, forkConsumer) {
+  CapsRing ring;
+  ring.create(4096);
+  const uint32_t count = 20000;
+  // 子进程在共享内存中原地读取, 不解析
+  auto pid = forkRun([&ring]() {
+    uint32_t i;
+    uint32_t size;
+    for (i = 0; i < count; ++i) {
+      const uint8_t* p;
+      while ((p = ring.tryPeek(size)) == nullptr)
+        this_thread::yield();
+      auto m = message(i);
+      vector<uint8_t> expect(m.binarySize());
+      m.serialize(expect.data(), expect.size());
+      if (size != expect.size() || memcmp(p, expect.data(), size))
+        return 1;
+      ring.release();
+    }
+    return 0;
+  });
+  ASSERT_GT(pid, 0);
+  uint32_t i;
+  for (i = 0; i < count; ++i) {
+    auto m = message(i);
+    if (i % 2) {
+      ASSERT_TRUE(ring.write(m, 0, 5000));
+      continue;
+    }
+    // 直接序列化到预留空间
+    auto size = m.binarySize();
+    uint8_t* p;
+    while ((p = ring.tryReserve(size)) == nullptr)
+      this_thread::yield();
+    m.serialize(p, size);
+    ring.commit(size);
+  }
+  EXPECT_EQ(waitExit(pid), 0);
+}
+
+TEST(TestCapsRing, attach) {
+  CapsRing producer;
+  producer.create(8192);
+  EXPECT_EQ(producer.maxMessageSize(), 4096 - 8);
+  CapsRing consumer;
+  consumer.attach(producer.fd());
+  EXPECT_NE(consumer.fd(), producer.fd());
+  EXPECT_EQ(consumer.maxMessageSize(), producer.maxMessageSize());
+  thread t([&producer]() {
+    uint32_t i;
+    for (i = 0; i < 10000; ++i)
+      producer.write(message(i));
+  });
+  Caps caps;
+  uint32_t i;
+  for (i = 0; i < 10000; ++i) {
+    ASSERT_TRUE(consumer.read(caps, 5000));
+    EXPECT_EQ(caps, message(i));
+  }
+  t.join();
+
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  EXPECT_THROW(consumer.attach(fds[0]), domain_error);
+  close(fds[0]);
+  close(fds[1]);
+  consumer.close();
+  EXPECT_THROW(consumer.tryRead(caps), logic_error);
+}
+
+TEST(TestCapsRing, full) {
+  CapsRing ring;
+  ring.create(4096);
+  Caps big;
+  big.write(string(ring.maxMessageSize() / 2, 'x').c_str());
+  EXPECT_THROW(ring.tryReserve(ring.maxMessageSize() + 1), length_error);
+  uint32_t n{0};
+  while (ring.tryWrite(big))
+    ++n;
+  EXPECT_EQ(n, 3);
+  auto tp = steady_clock::now();
+  EXPECT_FALSE(ring.write(big, 0, 50));
+  EXPECT_GE(duration_cast<milliseconds>(steady_clock::now() - tp).count(), 45);
+
+  Caps caps;
+  while (n--) {
+    EXPECT_TRUE(ring.read(caps, 0));
+    EXPECT_EQ(caps, big);
+  }
+  tp = steady_clock::now();
+  EXPECT_FALSE(ring.read(caps, 50));
+  EXPECT_GE(duration_cast<milliseconds>(steady_clock::now() - tp).count(), 45);
+
+  // 格式错误的消息被移出, 不影响后续消息
+  auto p = ring.tryReserve(8);
+  memset(p, 0xff, 8);
+  EXPECT_THROW(ring.commit(9), invalid_argument);
+  ring.commit(8);
+  EXPECT_TRUE(ring.tryWrite(message(1)));
+  EXPECT_THROW(ring.tryRead(caps), exception);
+  EXPECT_TRUE(ring.tryRead(caps));
+  EXPECT_EQ(caps, message(1));
+  EXPECT_THROW(ring.commit(8), logic_error);
+}
+
+TEST(TestCapsRing, benchmark) {
+  const uint32_t count = 1000000;
+  CapsRing ring;
+  ring.create(1024 * 1024);
+  Caps m;
+  m.write(1);
+  m.write("a short payload string");
+  m.write(3.5);
+  // 吞吐: 子进程连续写入, 父进程连续解析
+  auto tp = steady_clock::now();
+  auto pid = forkRun([&ring, &m]() {
+    uint32_t i;
+    for (i = 0; i < count; ++i)
+      ring.write(m);
+    return 0;
+  });
+  ASSERT_GT(pid, 0);
+  Caps caps;
+  uint32_t i;
+  for (i = 0; i < count; ++i)
+    ASSERT_TRUE(ring.read(caps));
+  auto us = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  EXPECT_EQ(waitExit(pid), 0);
+  printf("throughput: %u messages in %" PRId64 "us, %.0f messages/s\n",
+      count, (int64_t)us, count * 1000000.0 / us);
+
+  // 延迟: 两个ring之间ping-pong往返
+  // 生产者位置保存在写入进程本地, ring不能再由父进程写入
+  const uint32_t rounds = 100000;
+  CapsRing forth;
+  CapsRing back;
+  forth.create(4096);
+  back.create(4096);
+  pid = forkRun([&forth, &back]() {
+    Caps c;
+    uint32_t j;
+    for (j = 0; j < rounds; ++j) {
+      if (!forth.read(c, 5000) || !back.write(c, 0, 5000))
+        return 1;
+    }
+    return 0;
+  });
+  ASSERT_GT(pid, 0);
+  tp = steady_clock::now();
+  for (i = 0; i < rounds; ++i) {
+    forth.write(m);
+    ASSERT_TRUE(back.read(caps, 5000));
+  }
+  us = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  EXPECT_EQ(waitExit(pid), 0);
+  printf("latency: %.2fus per round trip\n", (double)us / rounds);
+}
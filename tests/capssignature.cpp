@@ -0,0 +1,177 @@
+#include <string.h>
+#include <inttypes.h>
+#include <chrono>
+#include <algorithm>
+#include "gtest/gtest.h"
+#include "capssignature.h"
+#include "defs.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace rokid;
+
+static vector<uint8_t> serialize(const Caps& caps, uint32_t flags = 0) {
+  vector<uint8_t> buf(caps.binarySize(flags));
+  caps.serialize(buf.data(), buf.size(), flags);
+  return buf;
+}
+
+TEST(TestCapsSignatures, match) {
+  CapsSignatures sigs;
+  sigs.add("iSSO", 1);
+  sigs.add("iSS", 2);
+  sigs.add("", 3);
+  sigs.add("dB", 4);
+  EXPECT_EQ(sigs.size(), 4);
+
+  Caps msg;
+  msg.write(1);
+  msg.write("a");
+  msg.write("b");
+  msg.write(Caps{ 1, 2.0 });
+  uint32_t id;
+  auto buf = serialize(msg);
+  ASSERT_EQ(sigs.tryMatch(buf.data(), buf.size(), id), CAPS_SUCCESS);
+  EXPECT_EQ(id, 1);
+  // 序列化选项不影响匹配, 嵌套Caps不检查内部结构
+  buf = serialize(msg, CAPS_FLAG_CRC32C | CAPS_FLAG_FIXED_INT);
+  ASSERT_EQ(sigs.tryMatch(buf.data(), buf.size(), id), CAPS_SUCCESS);
+  EXPECT_EQ(id, 1);
+
+  buf = serialize(Caps{ 1, "a", "b" });
+  ASSERT_EQ(sigs.tryMatch(buf.data(), buf.size(), id), CAPS_SUCCESS);
+  EXPECT_EQ(id, 2);
+  buf = serialize(Caps());
+  ASSERT_EQ(sigs.tryMatch(buf.data(), buf.size(), id), CAPS_SUCCESS);
+  EXPECT_EQ(id, 3);
+  Caps bin;
+  bin.write(0.5);
+  bin.write("data", 4);
+  buf = serialize(bin);
+  ASSERT_EQ(sigs.tryMatch(buf.data(), buf.size(), id), CAPS_SUCCESS);
+  EXPECT_EQ(id, 4);
+
+  // 前缀或类型不同不匹配
+  id = 100;
+  buf = serialize(Caps{ 1, "a" });
+  EXPECT_EQ(sigs.tryMatch(buf.data(), buf.size(), id), CAPS_ERR_TYPE_MISMATCH);
+  buf = serialize(Caps{ 1u, "a", "b" });
+  EXPECT_EQ(sigs.tryMatch(buf.data(), buf.size(), id), CAPS_ERR_TYPE_MISMATCH);
+  EXPECT_EQ(id, 100);
+
+  sigs.clear();
+  EXPECT_EQ(sigs.size(), 0);
+  buf = serialize(Caps());
+  EXPECT_EQ(sigs.tryMatch(buf.data(), buf.size(), id), CAPS_ERR_TYPE_MISMATCH);
+}
+
+TEST(TestCapsSignatures, invalid) {
+  CapsSignatures sigs;
+  EXPECT_THROW(sigs.add(nullptr, 1), invalid_argument);
+  EXPECT_THROW(sigs.add("iX", 1), invalid_argument);
+  // 投影解析未选择的成员不可序列化
+  EXPECT_THROW(sigs.add("A", 1), invalid_argument);
+  sigs.add("iS", 1);
+  EXPECT_THROW(sigs.add("iS", 2), invalid_argument);
+  EXPECT_EQ(sigs.size(), 1);
+
+  uint32_t id;
+  auto buf = serialize(Caps{ 1, "a" }, CAPS_FLAG_CRC32C);
+  EXPECT_EQ(sigs.tryMatch(nullptr, 10, id), CAPS_ERR_INVALID_PARAM);
+  EXPECT_EQ(sigs.tryMatch(buf.data(), buf.size() - 1, id),
+      CAPS_ERR_INVALID_PARAM);
+  auto bad = buf;
+  bad[4] = CAPS_VERSION + 1;
+  EXPECT_EQ(sigs.tryMatch(bad.data(), bad.size(), id), CAPS_ERR_VERSION);
+  // 版本与长度都不正确时与tryParse返回相同错误
+  Caps parsed;
+  EXPECT_EQ(sigs.tryMatch(bad.data(), bad.size() - 1, id), CAPS_ERR_VERSION);
+  EXPECT_EQ(parsed.tryParse(bad.data(), bad.size() - 1), CAPS_ERR_VERSION);
+  // 类型描述长度超出数据
+  bad = buf;
+  bad[5] = 100;
+  EXPECT_EQ(sigs.tryMatch(bad.data(), bad.size(), id), CAPS_ERR_CORRUPTED);
+  // 只校验header及类型描述, 不校验CRC32C
+  bad = buf;
+  bad[bad.size() - 1] ^= 0xff;
+  ASSERT_EQ(sigs.tryMatch(bad.data(), bad.size(), id), CAPS_SUCCESS);
+  EXPECT_EQ(id, 1);
+}
+
+TEST(TestCapsSignatures, many) {
+  const char types[] = "iulkfdSBOV";
+  CapsSignatures sigs;
+  vector<string> all;
+  uint32_t i;
+  // 不同长度的所有组合, 触发多次扩容
+  for (i = 0; i < 1000; ++i) {
+    string sig;
+    uint32_t v = i;
+    do {
+      sig.push_back(types[v % 10]);
+      v /= 10;
+    } while (v);
+    sig.append(all.size() % 3, 'V');
+    if (find(all.begin(), all.end(), sig) != all.end())
+      continue;
+    sigs.add(sig.c_str(), all.size());
+    all.push_back(sig);
+  }
+  EXPECT_EQ(sigs.size(), all.size());
+  for (i = 0; i < all.size(); ++i) {
+    // 按签名构造序列化数据: 只写入header及类型描述, 成员数据不被读取
+    vector<uint8_t> buf(HEADER_SIZE + 2 + all[i].size());
+    buf[0] = 0;
+    buf[1] = 0;
+    buf[2] = buf.size() >> 8;
+    buf[3] = buf.size() & 0xff;
+    buf[4] = CAPS_VERSION;
+    buf[5] = all[i].size();
+    memcpy(buf.data() + 6, all[i].data(), all[i].size());
+    uint32_t id;
+    ASSERT_EQ(sigs.tryMatch(buf.data(), buf.size(), id), CAPS_SUCCESS);
+    EXPECT_EQ(id, i);
+  }
+}
+
+TEST(TestCapsSignatures, benchmark) {
+  CapsSignatures sigs;
+  sigs.add("iSSO", 1);
+  sigs.add("iSS", 2);
+  sigs.add("iSB", 3);
+  sigs.add("idd", 4);
+  Caps msg;
+  msg.write(3);
+  msg.write("request name");
+  msg.write("some argument string");
+  msg.write(Caps{ 1, 2, 3 });
+  auto buf = serialize(msg);
+  const uint32_t count = 1000000;
+  uint32_t i;
+  uint64_t sum{0};
+  uint32_t id{0};
+  auto tp = steady_clock::now();
+  for (i = 0; i < count; ++i) {
+    sigs.tryMatch(buf.data(), buf.size(), id);
+    sum += id;
+  }
+  auto matchUs = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  EXPECT_EQ(sum, count);
+
+  // 对比: 解析后逐个检查成员类型
+  Caps caps;
+  sum = 0;
+  tp = steady_clock::now();
+  for (i = 0; i < count; ++i) {
+    caps.parse(buf.data(), buf.size());
+    if (caps.size() == 4 && caps[0].type() == CAPS_MEMBER_TYPE_INT32
+        && caps[1].type() == CAPS_MEMBER_TYPE_STRING
+        && caps[2].type() == CAPS_MEMBER_TYPE_STRING
+        && caps[3].type() == CAPS_MEMBER_TYPE_OBJECT)
+      ++sum;
+  }
+  auto parseUs = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  EXPECT_EQ(sum, count);
+  printf("match: %" PRId64 "us, parse and check: %" PRId64 "us\n",
+      (int64_t)matchUs, (int64_t)parseUs);
+}
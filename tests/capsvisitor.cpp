@@ -0,0 +1,152 @@
+#include <string.h>
+#include <inttypes.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "caps.h"
+#include "capsvisitor.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace rokid;
+
+// 记录回调序列
+class RecordVisitor : public CapsVisitor {
+public:
+  void onInt32(int32_t v) { out += "i" + to_string(v) + ","; }
+  void onUint32(uint32_t v) { out += "u" + to_string(v) + ","; }
+  void onInt64(int64_t v) { out += "l" + to_string(v) + ","; }
+  void onUint64(uint64_t v) { out += "k" + to_string(v) + ","; }
+  void onFloat(float v) { out += "f" + to_string(v) + ","; }
+  void onDouble(double v) { out += "d" + to_string(v) + ","; }
+  void onString(const char* d, uint32_t s) { out += "S" + string(d, s) + ","; }
+  void onBinary(const void*, uint32_t s) { out += "B" + to_string(s) + ","; }
+  void onVoid() { out += "V,"; }
+  void onBeginObject(uint32_t c) { out += "[" + to_string(c) + ","; }
+  void onEndObject() { out += "],"; }
+
+  string out;
+};
+
+// 只关心部分回调
+class SumVisitor : public CapsVisitor {
+public:
+  void onInt32(int32_t v) { sum += v; }
+
+  int64_t sum{0};
+};
+
+static Caps sample() {
+  Caps inner;
+  inner.write((int64_t)-7);
+  inner.write("x");
+  Caps caps;
+  caps.write((int32_t)-1);
+  caps.write((uint32_t)2);
+  caps.write((uint64_t)3);
+  caps.write(1.5f);
+  caps.write(2.5);
+  caps.write("str");
+  caps.write("bin", 3);
+  caps.write(inner);
+  caps.write();
+  caps.write(Caps());
+  return caps;
+}
+
+TEST(TestCapsVisitor, events) {
+  auto caps = sample();
+  uint32_t modes[] = { 0, CAPS_FLAG_FIXED_INT, CAPS_FLAG_CRC32C };
+  for (auto f : modes) {
+    vector<uint8_t> buf(caps.binarySize(f));
+    caps.serialize(buf.data(), buf.size(), f);
+    RecordVisitor v;
+    EXPECT_EQ(CapsVisitor::visit(buf.data(), buf.size(), v), CAPS_SUCCESS);
+    EXPECT_EQ(v.out, "[10,i-1,u2,k3,f1.500000,d2.500000,Sstr,B3,"
+        "[2,l-7,Sx,],V,[0,],],");
+
+    SumVisitor sum;
+    EXPECT_EQ(CapsVisitor::visit(buf.data(), buf.size(), sum), CAPS_SUCCESS);
+    EXPECT_EQ(sum.sum, -1);
+
+    // 截断数据返回错误, 与tryParse一致
+    uint32_t i;
+    Caps parsed;
+    for (i = 6; i < buf.size(); ++i) {
+      auto bad = buf;
+      bad[0] = i >> 24;
+      bad[1] = i >> 16;
+      bad[2] = i >> 8;
+      bad[3] = i;
+      RecordVisitor rv;
+      uint32_t off1, off2;
+      auto r = CapsVisitor::visit(bad.data(), i, rv, &off1);
+      EXPECT_EQ(r, parsed.tryParse(bad.data(), i, &off2));
+      EXPECT_NE(r, CAPS_SUCCESS);
+      EXPECT_EQ(off1, off2);
+    }
+  }
+}
+
+TEST(TestCapsVisitor, dumpBinary) {
+  auto caps = sample();
+  vector<uint8_t> buf(caps.binarySize());
+  caps.serialize(buf.data(), buf.size());
+  char expect[1024];
+  char actual[1024];
+  auto len = caps.dump(expect, sizeof(expect));
+  EXPECT_EQ(Caps::dumpBinary(buf.data(), buf.size(), actual, sizeof(actual)),
+      len);
+  EXPECT_STREQ(actual, expect);
+  EXPECT_THROW(Caps::dumpBinary(buf.data(), buf.size(), actual, 10),
+      out_of_range);
+  EXPECT_THROW(Caps::dumpBinary(buf.data(), buf.size() - 1, actual,
+        sizeof(actual)), domain_error);
+}
+
+TEST(TestCapsVisitor, tooDeep) {
+  Caps caps;
+  uint32_t i;
+  for (i = 0; i < CAPS_VISIT_MAX_DEPTH; ++i) {
+    Caps outer;
+    outer.write(caps);
+    caps = outer;
+  }
+  vector<uint8_t> buf(caps.binarySize());
+  caps.serialize(buf.data(), buf.size());
+  CapsVisitor v;
+  EXPECT_EQ(CapsVisitor::visit(buf.data(), buf.size(), v), CAPS_ERR_TOO_DEEP);
+}
+
+TEST(TestCapsVisitor, benchmark) {
+  Caps caps;
+  uint32_t i;
+  for (i = 0; i < 64; ++i) {
+    caps.write((int32_t)i);
+    caps.write("some string value");
+  }
+  vector<uint8_t> buf(caps.binarySize());
+  caps.serialize(buf.data(), buf.size());
+  const uint32_t count = 100000;
+  int64_t total{0};
+  auto tp = steady_clock::now();
+  for (i = 0; i < count; ++i) {
+    Caps parsed;
+    parsed.parse(buf.data(), buf.size());
+    for (auto it = parsed.begin(); it != parsed.end(); ++it) {
+      if ((*it).type() == CAPS_MEMBER_TYPE_INT32)
+        total += (*it).read<int32_t>();
+    }
+  }
+  auto parseTime = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  tp = steady_clock::now();
+  for (i = 0; i < count; ++i) {
+    SumVisitor v;
+    CapsVisitor::visit(buf.data(), buf.size(), v);
+    total += v.sum;
+  }
+  auto visitTime = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  printf("parse + iterate: %" PRId64 "us, visit: %" PRId64 "us (%" PRId64 ")\n",
+      (int64_t)parseTime, (int64_t)visitTime, total);
+}
@@ -0,0 +1,161 @@
+#include <string.h>
+#include <inttypes.h>
+#include <chrono>
+#include <vector>
+#include "gtest/gtest.h"
+#include "caps.h"
+#include "capswriter.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace rokid;
+
+static vector<uint8_t> serialize(const Caps& caps, uint32_t flags) {
+  vector<uint8_t> buf(caps.binarySize(flags));
+  caps.serialize(buf.data(), buf.size(), flags);
+  return buf;
+}
+
+static void expectSame(const Caps& caps, const CapsWriter& writer,
+    uint32_t flags) {
+  auto buf = serialize(caps, flags);
+  ASSERT_EQ(writer.size(), buf.size());
+  EXPECT_EQ(memcmp(writer.data(), buf.data(), buf.size()), 0);
+}
+
+TEST(TestCapsWriter, identical) {
+  uint32_t modes[] = { 0, CAPS_FLAG_FIXED_INT, CAPS_FLAG_CRC32C,
+    CAPS_FLAG_FIXED_INT | CAPS_FLAG_CRC32C };
+  uint32_t hints[] = { 0, 3, 9, 200 };
+  for (auto f : modes) {
+    for (auto hint : hints) {
+      Caps leaf;
+      leaf.write("leaf");
+      leaf.write((int64_t)-1);
+      Caps inner;
+      inner.write((uint32_t)300);
+      inner.write(leaf);
+      inner.write();
+      Caps caps;
+      caps.write(true);
+      caps.write((int8_t)-3);
+      caps.write((int32_t)-123456);
+      caps.write((uint64_t)UINT64_MAX);
+      caps.write(1.25f);
+      caps.write(-2.5);
+      caps.write(string("embedded\0nul", 12));
+      caps.write("bin\0ary", 7);
+      caps.write(inner);
+      caps.write(Caps());
+
+      CapsWriter writer(f, hint);
+      writer.write(true);
+      writer.write((int8_t)-3);
+      writer.write((int32_t)-123456);
+      writer.write((uint64_t)UINT64_MAX);
+      writer.write(1.25f);
+      writer.write(-2.5);
+      writer.write(string("embedded\0nul", 12));
+      writer.write("bin\0ary", 7);
+      writer.beginObject(hint);
+      writer.write((uint32_t)300);
+      writer.write(leaf);
+      writer.write();
+      writer.endObject();
+      writer.beginObject();
+      writer.endObject();
+      EXPECT_EQ(writer.finish(), caps.binarySize(f));
+      expectSame(caps, writer, f);
+
+      Caps parsed;
+      EXPECT_EQ(parsed.tryParse(writer.data(), writer.size()), CAPS_SUCCESS);
+    }
+  }
+}
+
+TEST(TestCapsWriter, manyMembers) {
+  Caps caps;
+  CapsWriter writer;
+  uint32_t i;
+  // 成员数超过127, 成员数编码为2字节
+  for (i = 0; i < 1000; ++i) {
+    caps.write(i);
+    writer.write(i);
+  }
+  writer.finish();
+  expectSame(caps, writer, 0);
+
+  // reset后重用
+  writer.reset(1000);
+  for (i = 0; i < 1000; ++i)
+    writer.write(i);
+  writer.finish();
+  expectSame(caps, writer, 0);
+
+  writer.reset();
+  writer.finish();
+  expectSame(Caps(), writer, 0);
+}
+
+TEST(TestCapsWriter, errors) {
+  EXPECT_THROW(CapsWriter(0x1), invalid_argument);
+  CapsWriter writer;
+  EXPECT_THROW(writer.endObject(), logic_error);
+  writer.beginObject();
+  EXPECT_THROW(writer.finish(), logic_error);
+  writer.endObject();
+  writer.finish();
+  EXPECT_THROW(writer.write(1), logic_error);
+  EXPECT_THROW(writer.finish(), logic_error);
+
+  // 写入失败不留下成员类型
+  Caps src{ 1, 2 };
+  vector<uint8_t> buf(src.binarySize());
+  src.serialize(buf.data(), buf.size());
+  Caps absent;
+  absent.parse(buf.data(), buf.size(), Caps::Projection{ "1" });
+  CapsWriter w;
+  w.write(1);
+  EXPECT_THROW(absent.serialize(buf.data(), buf.size()), range_error);
+  EXPECT_THROW(w.write(absent), range_error);
+  w.write(Caps{ 2 });
+  w.finish();
+  Caps expected;
+  expected.write(1);
+  expected.write(Caps{ 2 });
+  expectSame(expected, w, 0);
+}
+
+TEST(TestCapsWriter, benchmark) {
+  const uint32_t count = 100000;
+  vector<uint8_t> buf;
+  uint64_t total{0};
+  uint32_t i, j;
+  auto tp = steady_clock::now();
+  for (i = 0; i < count; ++i) {
+    Caps caps;
+    for (j = 0; j < 8; ++j) {
+      caps.write(i + j);
+      caps.write("message body");
+      caps.write((double)j);
+    }
+    buf.resize(caps.binarySize());
+    total += caps.serialize(buf.data(), buf.size());
+  }
+  auto capsTime = duration_cast<microseconds>(steady_clock::now() - tp).count();
+
+  CapsWriter writer;
+  tp = steady_clock::now();
+  for (i = 0; i < count; ++i) {
+    writer.reset();
+    for (j = 0; j < 8; ++j) {
+      writer.write(i + j);
+      writer.write("message body");
+      writer.write((double)j);
+    }
+    total += writer.finish();
+  }
+  auto writerTime = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  printf("Caps + serialize: %" PRId64 "us, CapsWriter: %" PRId64 "us (%" PRIu64 ")\n",
+      (int64_t)capsTime, (int64_t)writerTime, total);
+}
@@ -0,0 +1,78 @@
+#include <string.h>
+#include <inttypes.h>
+#include <chrono>
+#include <vector>
+#include "gtest/gtest.h"
+#include "crc32c.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace rokid;
+
+TEST(TestCrc32c, vectors) {
+  EXPECT_EQ(crc32c(0, "", 0), 0);
+  EXPECT_EQ(crc32c(0, "123456789", 9), 0xe3069283);
+  EXPECT_EQ(crc32cSoftware(0, "123456789", 9), 0xe3069283);
+  uint8_t buf[32];
+  memset(buf, 0, sizeof(buf));
+  EXPECT_EQ(crc32c(0, buf, sizeof(buf)), 0x8a9136aa);
+  memset(buf, 0xff, sizeof(buf));
+  EXPECT_EQ(crc32c(0, buf, sizeof(buf)), 0x62a8ab43);
+  uint32_t i;
+  for (i = 0; i < sizeof(buf); ++i)
+    buf[i] = i;
+  EXPECT_EQ(crc32c(0, buf, sizeof(buf)), 0x46dd794e);
+}
+
+TEST(TestCrc32c, consistency) {
+  vector<uint8_t> buf(1024);
+  uint32_t i;
+  for (i = 0; i < buf.size(); ++i)
+    buf[i] = i * 131 + 7;
+  uint32_t off, len;
+  // 不同对齐与长度
+  for (off = 0; off < 8; ++off) {
+    for (len = 0; len < 100; ++len) {
+      EXPECT_EQ(crc32c(0, buf.data() + off, len),
+          crc32cSoftware(0, buf.data() + off, len));
+    }
+  }
+  // 分段计算
+  auto whole = crc32c(0, buf.data(), buf.size());
+  EXPECT_EQ(crc32c(crc32c(0, buf.data(), 333), buf.data() + 333,
+        buf.size() - 333), whole);
+}
+
+TEST(TestCrc32c, benchmark) {
+  vector<uint8_t> buf(64 * 1024);
+  uint32_t i;
+  for (i = 0; i < buf.size(); ++i)
+    buf[i] = i;
+  uint32_t r = 0;
+  auto tp = steady_clock::now();
+  for (i = 0; i < 1000; ++i)
+    r += crc32c(0, buf.data(), buf.size());
+  auto hw = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  tp = steady_clock::now();
+  for (i = 0; i < 1000; ++i)
+    r += crc32cSoftware(0, buf.data(), buf.size());
+  auto sw = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  printf("crc32c 64MB: %" PRId64 "us, table: %" PRId64 "us (%u)\n",
+      (int64_t)hw, (int64_t)sw, r);
+}
+
+TEST(TestCrc32c, patch) {
+  vector<uint8_t> buf(5000);
+  uint32_t i;
+  for (i = 0; i < buf.size(); ++i)
+    buf[i] = i * 7 + 3;
+  size_t offs[] = { 0, 1, 100, 4990, 4996 };
+  for (auto off : offs) {
+    auto crc = crc32c(0, buf.data(), buf.size());
+    uint8_t delta[4] = { 0x12, 0, 0xff, 0x80 };
+    for (i = 0; i < 4; ++i)
+      buf[off + i] ^= delta[i];
+    EXPECT_EQ(crc32cPatch(crc, delta, 4, buf.size() - off - 4),
+        crc32c(0, buf.data(), buf.size()));
+  }
+}
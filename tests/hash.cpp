@@ -0,0 +1,207 @@
+#include <math.h>
+#include <string.h>
+#include <inttypes.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include "gtest/gtest.h"
+#include "caps.h"
+#include "crc32c.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace rokid;
+
+static Caps sample(int32_t v) {
+  Caps inner;
+  inner.write((int64_t)-7);
+  inner.write("inner string");
+  inner.write("bin", 3);
+  Caps caps;
+  caps.write(v);
+  caps.write((uint32_t)2);
+  caps.write((uint64_t)3);
+  caps.write(1.5f);
+  caps.write(2.5);
+  caps.write("a longer string that crosses the 48 bytes block boundary");
+  caps.write(inner);
+  caps.write();
+  return caps;
+}
+
+TEST(TestCapsHash, equality) {
+  auto a = sample(1);
+  auto b = sample(1);
+  EXPECT_TRUE(a == b);
+  EXPECT_FALSE(a != b);
+  EXPECT_EQ(a.hash(), b.hash());
+  EXPECT_NE(a, sample(2));
+  EXPECT_NE(a.hash(), sample(2).hash());
+
+  // 类型不同, 值相同
+  Caps i32, u32;
+  i32.write((int32_t)1);
+  u32.write((uint32_t)1);
+  EXPECT_NE(i32, u32);
+  EXPECT_NE(i32.hash(), u32.hash());
+
+  // string与binary
+  Caps s, bin;
+  s.write("ab");
+  bin.write("ab", 2);
+  EXPECT_NE(s, bin);
+  EXPECT_NE(s.hash(), bin.hash());
+
+  // 浮点数按位比较
+  Caps nan1, nan2, zero, negZero;
+  nan1.write((double)NAN);
+  nan2.write((double)NAN);
+  zero.write(0.0);
+  negZero.write(-0.0);
+  EXPECT_EQ(nan1, nan2);
+  EXPECT_NE(zero, negZero);
+
+  // 成员数不同
+  Caps empty;
+  Caps one;
+  one.write();
+  EXPECT_NE(empty, one);
+  EXPECT_NE(empty.hash(), one.hash());
+  EXPECT_EQ(empty, Caps());
+
+  // 嵌套结构不同, 展开后成员相同
+  Caps flat, nested, inner;
+  flat.write((int32_t)1);
+  flat.write((int32_t)2);
+  inner.write((int32_t)2);
+  nested.write((int32_t)1);
+  nested.write(inner);
+  EXPECT_NE(flat, nested);
+  EXPECT_NE(flat.hash(), nested.hash());
+}
+
+TEST(TestCapsHash, seed) {
+  auto a = sample(1);
+  auto h0 = a.hash();
+  auto h1 = a.hash(1);
+  EXPECT_NE(h0, h1);
+  EXPECT_EQ(a.hash(), h0);
+  EXPECT_EQ(a.hash(1), h1);
+  EXPECT_EQ(sample(1).hash(1), h1);
+}
+
+TEST(TestCapsHash, invalidate) {
+  auto a = sample(1);
+  auto h = a.hash();
+  a.write((int32_t)0);
+  EXPECT_NE(a.hash(), h);
+  a.clear();
+  EXPECT_EQ(a.hash(), Caps().hash());
+
+  auto b = sample(1);
+  h = b.hash();
+  b = sample(2);
+  EXPECT_EQ(b.hash(), sample(2).hash());
+
+  // parse时复用的嵌套Caps
+  auto c = sample(1);
+  h = c.hash();
+  auto d = sample(2);
+  vector<uint8_t> buf(d.binarySize());
+  d.serialize(buf.data(), buf.size());
+  c.parse(buf.data(), buf.size());
+  EXPECT_EQ(c.hash(), d.hash());
+  EXPECT_EQ(c, d);
+
+  // 移动后源对象为空
+  auto e = sample(1);
+  e.hash();
+  Caps f(move(e));
+  EXPECT_EQ(f, sample(1));
+  EXPECT_EQ(e.hash(), Caps().hash());
+}
+
+TEST(TestCapsHash, hashBinary) {
+  auto caps = sample(1);
+  uint32_t modes[] = { 0, CAPS_FLAG_FIXED_INT, CAPS_FLAG_CRC32C,
+    CAPS_FLAG_CRC32C | CAPS_FLAG_FIXED_INT };
+  for (auto f : modes) {
+    vector<uint8_t> buf(caps.binarySize(f));
+    caps.serialize(buf.data(), buf.size(), f);
+    EXPECT_EQ(Caps::hashBinary(buf.data(), buf.size()), caps.hash());
+    EXPECT_EQ(Caps::hashBinary(buf.data(), buf.size(), 7), caps.hash(7));
+    uint64_t h;
+    EXPECT_EQ(Caps::tryHashBinary(buf.data(), buf.size() - 1, h),
+        CAPS_ERR_INVALID_PARAM);
+    EXPECT_THROW(Caps::hashBinary(buf.data(), buf.size() - 1),
+        invalid_argument);
+  }
+}
+
+TEST(TestCapsHash, unorderedSet) {
+  unordered_set<Caps> set;
+  int32_t i;
+  for (i = 0; i < 1000; ++i)
+    set.insert(sample(i % 100));
+  EXPECT_EQ(set.size(), 100);
+  EXPECT_EQ(set.count(sample(5)), 1);
+  EXPECT_EQ(set.count(sample(100)), 0);
+}
+
+TEST(TestCapsHash, distribution) {
+  // 相邻整数及少量字节不同的字符串, 哈希低16位分布大致均匀
+  vector<uint32_t> buckets(256);
+  uint32_t i;
+  for (i = 0; i < 65536; ++i) {
+    Caps caps;
+    caps.write(i);
+    ++buckets[caps.hash() & 0xff];
+    Caps str;
+    string s(40, 'x');
+    memcpy(&s[i % 37], &i, 3);
+    str.write(s);
+    ++buckets[(str.hash() >> 8) & 0xff];
+  }
+  for (auto c : buckets) {
+    EXPECT_GT(c, 384);
+    EXPECT_LT(c, 640);
+  }
+}
+
+TEST(TestCapsHash, benchmark) {
+  Caps inner;
+  uint32_t i;
+  for (i = 0; i < 64; ++i) {
+    inner.write((int32_t)i);
+    inner.write("some string value in the nested object");
+  }
+  Caps caps;
+  for (i = 0; i < 16; ++i)
+    caps.write(inner);
+  const uint32_t count = 10000;
+  vector<uint8_t> buf;
+  uint64_t total{0};
+  auto tp = steady_clock::now();
+  for (i = 0; i < count; ++i) {
+    buf.resize(caps.binarySize());
+    caps.serialize(buf.data(), buf.size());
+    total += crc32c(0, buf.data(), buf.size());
+  }
+  auto serializeTime = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  tp = steady_clock::now();
+  for (i = 0; i < count; ++i) {
+    Caps copy = caps;
+    total += copy.hash(i);
+  }
+  auto hashTime = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  tp = steady_clock::now();
+  for (i = 0; i < count; ++i) {
+    Caps copy = caps;
+    total += copy.hash();
+  }
+  auto cachedTime = duration_cast<microseconds>(steady_clock::now() - tp).count();
+  printf("serialize + crc32c: %" PRId64 "us, hash: %" PRId64
+      "us, hash with nested cache: %" PRId64 "us (%" PRIu64 ")\n",
+      (int64_t)serializeTime, (int64_t)hashTime, (int64_t)cachedTime, total);
+}
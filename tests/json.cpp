@@ -0,0 +1,257 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <locale.h>
+#include <cmath>
+#include <chrono>
+#include "gtest/gtest.h"
+#include "caps.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace rokid;
+
+static void writeJsonCaps(Caps& caps) {
+  caps << 1;
+  caps << true;
+  caps << "hello \"world\"\n";
+  caps << (float)0.1;
+  caps << (int64_t)-10000LL;
+  caps << (uint64_t)18446744073709551615ULL;
+  caps << (double)1.1;
+  caps << vector<char>{ 'f', 'o', 'o', 'b' };
+  Caps sub;
+  sub.write();
+  sub << 1e21;
+  caps << sub;
+}
+
+TEST(TestJson, toJson) {
+  Caps caps;
+  writeJsonCaps(caps);
+  string out;
+  caps.toJson(out);
+  EXPECT_EQ(out, "[1,1,\"hello \\\"world\\\"\\n\",0.1,-10000,"
+      "18446744073709551615,1.1,\"Zm9vYg==\",[null,1e21]]");
+  out.clear();
+  caps.toText(out);
+  EXPECT_EQ(out, "[1,1u,\"hello \\\"world\\\"\\n\",0.1f,-10000l,"
+      "18446744073709551615ul,1.1,b\"Zm9vYg==\",[void,1e21]]");
+
+  Caps empty;
+  out = "x";
+  empty.toJson(out);
+  EXPECT_EQ(out, "x[]");
+}
+
+TEST(TestJson, escape) {
+  string s;
+  int32_t i;
+  for (i = 0; i < 40; ++i)
+    s.push_back(i % 3 == 0 ? '\x01' : 'a' + (i % 26));
+  s += "\\\"/\xe4\xbd\xa0";
+  Caps caps;
+  caps << s;
+  string out;
+  caps.toJson(out);
+  string expect = "[\"";
+  for (i = 0; i < 40; ++i)
+    expect += i % 3 == 0 ? string("\\u0001") : string(1, 'a' + (i % 26));
+  expect += "\\\\\\\"/\xe4\xbd\xa0\"]";
+  EXPECT_EQ(out, expect);
+}
+
+TEST(TestJson, shortestDouble) {
+  const double values[] = { 0.0, -0.0, 1.0, 0.3, 0.1 + 0.2, 1e-7, 123456.789,
+    5e-324, 1.7976931348623157e308, 2.2250738585072014e-308, 1e14, 1e15 };
+  const char* expects[] = { "0.0", "-0.0", "1.0", "0.3", "0.30000000000000004",
+    "1e-7", "123456.789", "5e-324", "1.7976931348623157e308",
+    "2.2250738585072014e-308", "100000000000000.0", "1e15" };
+  uint32_t i;
+  for (i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+    Caps caps;
+    caps << values[i];
+    string out;
+    caps.toJson(out);
+    EXPECT_EQ(out, string("[") + expects[i] + "]");
+  }
+
+  srand(duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count());
+  for (i = 0; i < 100000; ++i) {
+    uint64_t bits = ((uint64_t)rand() << 33) ^ ((uint64_t)rand() << 10) ^ rand();
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    float f = (float)rand() / rand();
+    if (!std::isfinite(d))
+      continue;
+    Caps caps;
+    caps << d;
+    caps << f;
+    string out;
+    caps.toJson(out);
+    auto p = out.c_str() + 1;
+    char* e;
+    EXPECT_EQ(strtod(p, &e), d) << out;
+    EXPECT_EQ(strtof(e + 1, nullptr), f) << out;
+  }
+}
+
+TEST(TestJson, benchmark) {
+  auto bench = [](const char* name, const Caps& caps) {
+    char buf[8192];
+    string out;
+    int32_t i;
+    int32_t loops{10000};
+
+    auto start = steady_clock::now();
+    for (i = 0; i < loops; ++i)
+      caps.dump(buf, sizeof(buf));
+    auto t1 = duration_cast<microseconds>(steady_clock::now() - start).count();
+
+    start = steady_clock::now();
+    for (i = 0; i < loops; ++i) {
+      out.clear();
+      caps.toJson(out);
+    }
+    auto t2 = duration_cast<microseconds>(steady_clock::now() - start).count();
+    printf("%s %d loops: dump %" PRId64 "us, toJson %" PRId64 "us\n",
+        name, loops, (int64_t)t1, (int64_t)t2);
+  };
+  Caps caps;
+  Caps doubles;
+  int32_t i;
+  for (i = 0; i < 20; ++i) {
+    caps << i * 12345;
+    caps << (int64_t)(i * 1234567890123LL);
+    caps << (double)i / 7;
+    caps << "some log message";
+    doubles << (double)i / 7;
+    doubles << i * 0.1 + 100;
+    doubles << (double)i * 1e-5;
+    doubles << (double)i * 1234.5;
+  }
+  Caps sub = caps;
+  caps << sub;
+  bench("mixed", caps);
+  bench("double", doubles);
+}
+
+TEST(TestJson, parseJson) {
+  const char* json = " [1, -2147483648, 4294967295, 4294967296, -2147483649,\n"
+    "\t18446744073709551615, 0.5, -1.25e2, 1e400, true, false, null,\n"
+    "\"a\\\"b\\u00e9\\ud83d\\ude00\", [], {\"k\": [1]}] ";
+  Caps caps;
+  caps.parseJson(json, strlen(json));
+  EXPECT_EQ(caps.size(), 15);
+  EXPECT_EQ((int32_t)caps[0], 1);
+  EXPECT_EQ((int32_t)caps[1], INT32_MIN);
+  EXPECT_EQ((uint32_t)caps[2], UINT32_MAX);
+  EXPECT_EQ((int64_t)caps[3], 4294967296LL);
+  EXPECT_EQ((int64_t)caps[4], -2147483649LL);
+  EXPECT_EQ((uint64_t)caps[5], UINT64_MAX);
+  EXPECT_EQ((double)caps[6], 0.5);
+  EXPECT_EQ((double)caps[7], -125.0);
+  EXPECT_TRUE(std::isinf((double)caps[8]));
+  EXPECT_EQ((bool)caps[9], true);
+  EXPECT_EQ((bool)caps[10], false);
+  EXPECT_TRUE(caps[11].isVoid());
+  EXPECT_EQ((const string&)caps[12], "a\"b\xc3\xa9\xf0\x9f\x98\x80");
+  Caps sub = caps[13];
+  EXPECT_TRUE(sub.empty());
+  sub = caps[14];
+  EXPECT_EQ(sub.size(), 2);
+  EXPECT_EQ((const string&)sub[0], "k");
+  Caps arr = sub[1];
+  EXPECT_EQ((int32_t)arr[0], 1);
+
+  // toJson结果可还原
+  Caps a;
+  writeJsonCaps(a);
+  string out;
+  a.toJson(out);
+  Caps b;
+  EXPECT_EQ(b.tryParseJson(out.data(), out.length()), CAPS_SUCCESS);
+  string out2;
+  b.toJson(out2);
+  EXPECT_EQ(out, out2);
+
+  const char* bad[] = { "[1,]", "[1 2]", "{\"a\" 1}", "[\"abc", "[01x]",
+    "[tru]", "[\"\\x\"]", "[1] x", "", "[-]", "[\"\\ud800\"]" };
+  for (auto s : bad) {
+    uint32_t off;
+    EXPECT_NE(caps.tryParseJson(s, strlen(s), &off), CAPS_SUCCESS) << s;
+    EXPECT_TRUE(caps.empty());
+    EXPECT_LE(off, strlen(s));
+  }
+  EXPECT_THROW(caps.parseJson("[1,]", 4), domain_error);
+  string deep(1000, '[');
+  EXPECT_EQ(caps.tryParseJson(deep.data(), deep.length()), CAPS_ERR_TOO_DEEP);
+}
+
+TEST(TestJson, parseDouble) {
+  srand(duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count());
+  char buf[64];
+  int32_t i;
+  for (i = 0; i < 100000; ++i) {
+    double d = (double)rand() / rand() * (rand() % 2 ? 1e-10 : 1e10);
+    snprintf(buf, sizeof(buf), i % 2 ? "[%.17g]" : "[%.6e]", d);
+    Caps caps;
+    ASSERT_EQ(caps.tryParseJson(buf, strlen(buf)), CAPS_SUCCESS) << buf;
+    double v;
+    if (caps.tryGet(0, v) != CAPS_SUCCESS)
+      continue;
+    EXPECT_EQ(v, strtod(buf + 1, nullptr)) << buf;
+  }
+}
+
+TEST(TestJson, parseDoubleLocale) {
+  // 尾数超过19位或指数超出[-22, 22], 走strtod慢路径
+  const char* json = "[1.5e300, 0.1000000000000000055511151231257827, 2.5e-30]";
+  auto check = [json]() {
+    Caps caps;
+    caps.parseJson(json, strlen(json));
+    ASSERT_EQ(caps.size(), 3);
+    EXPECT_EQ((double)caps[0], 1.5e300);
+    EXPECT_EQ((double)caps[1], 0.1);
+    EXPECT_EQ((double)caps[2], 2.5e-30);
+  };
+  check();
+
+  // 小数点为','的locale下结果不变
+  const char* locales[] = { "de_DE.UTF-8", "de_DE", "fr_FR.UTF-8", "ru_RU.UTF-8" };
+  string saved = setlocale(LC_NUMERIC, nullptr);
+  bool found = false;
+  for (auto l : locales) {
+    if (setlocale(LC_NUMERIC, l) && localeconv()->decimal_point[0] == ',') {
+      found = true;
+      break;
+    }
+  }
+  if (found)
+    check();
+  setlocale(LC_NUMERIC, saved.c_str());
+  if (!found)
+    GTEST_SKIP() << "no locale with ',' as decimal point";
+}
+
+TEST(TestJson, parseBenchmark) {
+  Caps caps;
+  int32_t i;
+  for (i = 0; i < 10000; ++i) {
+    Caps row;
+    row << i;
+    row << (double)i / 3;
+    row << "some string value";
+    row << (int64_t)(i * 1000000000LL);
+    caps << row;
+  }
+  string json;
+  caps.toJson(json);
+  Caps out;
+  auto start = steady_clock::now();
+  out.parseJson(json.data(), json.length());
+  auto t = duration_cast<microseconds>(steady_clock::now() - start).count();
+  EXPECT_EQ(out.size(), caps.size());
+  printf("parse %zu bytes json: %" PRId64 "us\n", json.length(), (int64_t)t);
+}
@@ -1,11 +1,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
 #include <chrono>
 #include <deque>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 #include "gtest/gtest.h"
 #include "caps.h"
 #include "leb128.h"
+#include "defs.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -33,7 +38,7 @@ void testLeb128(uint8_t* buf, uint32_t size) {
   p = buf;
   T v;
   while (p - buf < size) {
-    p = leb128Read(p, v);
+    p += leb128Read(p, size - (p - buf), v);
     EXPECT_EQ(v, nums.front());
     nums.pop_front();
   }
@@ -62,7 +67,7 @@ void testULeb128(uint8_t* buf, uint32_t size) {
   p = buf;
   T v;
   while (p - buf < size) {
-    p = uleb128Read(p, v);
+    p += uleb128Read(p, size - (p - buf), v);
     EXPECT_EQ(v, nums.front());
     nums.pop_front();
   }
@@ -298,3 +303,853 @@ TEST(TestCaps, initializer_list) {
   EXPECT_EQ((int32_t)it.next(), 233);
   EXPECT_EQ(it.hasNext(), false);
 }
+
+static void readFrozenCaps(const FrozenCaps& caps) {
+  EXPECT_EQ(caps.size(), 9);
+  EXPECT_EQ((int32_t)caps[0], 1);
+  EXPECT_EQ((bool)caps[1], true);
+  EXPECT_EQ((const string&)caps[2], "hello");
+  EXPECT_EQ((const string&)caps[3], "world");
+  EXPECT_EQ((float)caps[4], (float)0.1);
+  EXPECT_EQ((int64_t)caps[5], 10000LL);
+  EXPECT_EQ((double)caps[6], (double)1.1);
+  vector<char> bin;
+  caps[7].get(bin);
+  EXPECT_EQ(bin.size(), 3);
+  EXPECT_EQ(memcmp(bin.data(), "foo", 3), 0);
+  FrozenCaps sub = caps[8];
+  EXPECT_EQ(sub.size(), 1);
+  EXPECT_EQ(sub[0].isVoid(), true);
+  EXPECT_THROW((int32_t)caps[2], Caps::type_error);
+  EXPECT_THROW(caps.at(9), out_of_range);
+}
+
+TEST(TestCaps, freeze) {
+  Caps caps;
+  writeCaps(caps);
+  auto frozen = caps.freeze();
+  caps.clear();
+  readFrozenCaps(frozen);
+
+  vector<thread> threads;
+  int32_t i;
+  for (i = 0; i < 8; ++i) {
+    threads.emplace_back([&frozen]() {
+      int32_t j;
+      for (j = 0; j < 1000; ++j)
+        readFrozenCaps(frozen);
+    });
+  }
+  for_each(threads.begin(), threads.end(), [](thread& t) { t.join(); });
+}
+
+TEST(TestCaps, constIterator) {
+  Caps caps;
+  writeCaps(caps);
+  int32_t i;
+  bool b;
+  string s1, s2;
+  float f;
+  int64_t l;
+  double d;
+  vector<char> bin;
+  Caps sub;
+
+  auto it = caps.begin();
+  it >> i >> b >> s1 >> s2 >> f >> l >> d >> bin >> sub;
+  EXPECT_EQ(it == caps.end(), true);
+  EXPECT_EQ(i, 1);
+  EXPECT_EQ(b, true);
+  EXPECT_EQ(s1, "hello");
+  EXPECT_EQ(s2, "world");
+  EXPECT_EQ(f, (float)0.1);
+  EXPECT_EQ(l, 10000LL);
+  EXPECT_EQ(d, (double)1.1);
+  EXPECT_EQ(bin.size(), 3);
+  EXPECT_EQ(sub.size(), 1);
+  EXPECT_THROW(caps.begin().read(s1), Caps::type_error);
+
+  uint32_t count{0};
+  for (auto m : caps) {
+    EXPECT_EQ(m.type(), caps[count].type());
+    ++count;
+  }
+  EXPECT_EQ(count, caps.size());
+  EXPECT_EQ((*caps.begin()).read<int32_t>(), 1);
+}
+
+TEST(TestCaps, iterateBenchmark) {
+  Caps caps;
+  int32_t i;
+  for (i = 0; i < 1000; ++i)
+    caps << i;
+  int32_t loops{1000};
+  int64_t sum1{0}, sum2{0};
+  int32_t v;
+
+  auto start = steady_clock::now();
+  for (i = 0; i < loops; ++i) {
+    auto it = caps.iterate();
+    while (it.hasNext()) {
+      it >> v;
+      sum1 += v;
+    }
+  }
+  auto t1 = duration_cast<microseconds>(steady_clock::now() - start).count();
+
+  start = steady_clock::now();
+  for (i = 0; i < loops; ++i) {
+    for (auto m : caps) {
+      m.read(v);
+      sum2 += v;
+    }
+  }
+  auto t2 = duration_cast<microseconds>(steady_clock::now() - start).count();
+  EXPECT_EQ(sum1, sum2);
+  printf("iterate %d x %u members: iterator %" PRId64 "us, const_iterator %" PRId64 "us\n",
+      loops, caps.size(), (int64_t)t1, (int64_t)t2);
+}
+
+TEST(TestCaps, tryGet) {
+  Caps caps;
+  writeCaps(caps);
+  int32_t i{0};
+  bool b{false};
+  float f{0};
+  int64_t l{0};
+  double d{0};
+  const string* s{nullptr};
+  const void* data{nullptr};
+  uint32_t size{0};
+  const Caps* sub{nullptr};
+
+  EXPECT_EQ(caps.tryGet(0, i), CAPS_SUCCESS);
+  EXPECT_EQ(i, 1);
+  EXPECT_EQ(caps.tryGet(1, b), CAPS_SUCCESS);
+  EXPECT_EQ(b, true);
+  EXPECT_EQ(caps.tryGet(2, s), CAPS_SUCCESS);
+  EXPECT_EQ(*s, "hello");
+  EXPECT_EQ(caps.tryGet(4, f), CAPS_SUCCESS);
+  EXPECT_EQ(f, (float)0.1);
+  EXPECT_EQ(caps.tryGet(5, l), CAPS_SUCCESS);
+  EXPECT_EQ(l, 10000LL);
+  EXPECT_EQ(caps.tryGet(6, d), CAPS_SUCCESS);
+  EXPECT_EQ(d, (double)1.1);
+  EXPECT_EQ(caps.tryGet(7, data, size), CAPS_SUCCESS);
+  EXPECT_EQ(size, 3);
+  EXPECT_EQ(memcmp(data, "foo", 3), 0);
+  EXPECT_EQ(caps.tryGet(8, sub), CAPS_SUCCESS);
+  EXPECT_EQ(sub->size(), 1);
+
+  i = 2;
+  EXPECT_EQ(caps.tryGet(2, i), CAPS_ERR_TYPE_MISMATCH);
+  EXPECT_EQ(i, 2);
+  EXPECT_EQ(caps.tryGet(9, i), CAPS_ERR_OUT_OF_RANGE);
+  EXPECT_EQ(caps.tryGet(0, s), CAPS_ERR_TYPE_MISMATCH);
+
+  EXPECT_EQ(caps.getOr(0, 5), 1);
+  EXPECT_EQ(caps.getOr(2, 5), 5);
+  EXPECT_EQ(caps.getOr(9, (int64_t)7), 7);
+  EXPECT_EQ(caps.getOr(5, (int64_t)7), 10000LL);
+  string foo("foo");
+  EXPECT_EQ(caps.getOr(3, foo), "world");
+  EXPECT_EQ(&caps.getOr(0, foo), &foo);
+  EXPECT_EQ(strcmp(caps.getOr(2, "foo"), "hello"), 0);
+  Caps empty;
+  EXPECT_EQ(caps.getOr(8, empty).size(), 1);
+  EXPECT_EQ(&caps.getOr(0, empty), &empty);
+}
+
+TEST(TestCaps, tryParse) {
+  Caps caps, ncaps;
+  writeCaps(caps);
+  uint8_t buf[256];
+  uint32_t sz;
+  uint32_t off;
+
+  EXPECT_EQ(caps.trySerialize(buf, sizeof(buf), sz), CAPS_SUCCESS);
+  EXPECT_EQ(sz, caps.binarySize());
+  EXPECT_EQ(ncaps.tryParse(buf, sz), CAPS_SUCCESS);
+  readCaps(ncaps);
+
+  EXPECT_EQ(caps.trySerialize(buf, sz - 1, off), CAPS_ERR_INSUFFICIENT_BUFFER);
+  EXPECT_EQ(caps.trySerialize(buf, 4, off), CAPS_ERR_INSUFFICIENT_BUFFER);
+  EXPECT_EQ(caps.trySerialize(nullptr, sz, off), CAPS_ERR_INVALID_PARAM);
+  EXPECT_EQ(caps.trySerialize(buf, sz, off), CAPS_SUCCESS);
+
+  EXPECT_EQ(ncaps.tryParse(nullptr, sz), CAPS_ERR_INVALID_PARAM);
+  EXPECT_EQ(ncaps.tryParse(buf, sz - 1), CAPS_ERR_INVALID_PARAM);
+  EXPECT_TRUE(ncaps.empty());
+  buf[4] = CAPS_VERSION + 1;
+  EXPECT_EQ(ncaps.tryParse(buf, sz, &off), CAPS_ERR_VERSION);
+  EXPECT_EQ(off, 4);
+  EXPECT_THROW(ncaps.parse(buf, sz), domain_error);
+  buf[4] = CAPS_VERSION;
+  // 第一个成员类型改为未知类型
+  buf[6] = 'x';
+  EXPECT_EQ(ncaps.tryParse(buf, sz, &off), CAPS_ERR_CORRUPTED);
+  EXPECT_EQ(off, 6);
+  EXPECT_THROW(ncaps.parse(buf, sz), domain_error);
+
+  // 随机损坏数据不会抛出异常
+  int32_t i;
+  for (i = 0; i < 10000; ++i) {
+    caps.serialize(buf, sizeof(buf));
+    buf[HEADER_SIZE + rand() % (sz - HEADER_SIZE)] = rand();
+    auto r = ncaps.tryParse(buf, sz, &off);
+    if (r != CAPS_SUCCESS) {
+      EXPECT_LE(off, sz);
+      EXPECT_TRUE(ncaps.empty());
+    }
+  }
+}
+
+// levels层嵌套的Caps序列化数据, 每层只有一个嵌套Caps成员
+static vector<uint8_t> nestedBinary(uint32_t levels) {
+  vector<uint8_t> buf;
+  uint32_t size = HEADER_SIZE + 1 + (levels - 1) * (HEADER_SIZE + 2);
+  uint32_t i;
+  for (i = 0; i < levels; ++i) {
+    buf.push_back(size >> 24);
+    buf.push_back(size >> 16);
+    buf.push_back(size >> 8);
+    buf.push_back(size);
+    buf.push_back(CAPS_VERSION);
+    if (i + 1 == levels) {
+      buf.push_back(0);
+    } else {
+      buf.push_back(1);
+      buf.push_back(CAPS_MEMBER_TYPE_OBJECT);
+    }
+    size -= HEADER_SIZE + 2;
+  }
+  return buf;
+}
+
+TEST(TestCaps, deepNesting) {
+  Caps caps;
+  uint32_t off;
+  // 远超线程栈可容纳的递归层数
+  auto buf = nestedBinary(100000);
+  EXPECT_EQ(caps.tryParse(buf.data(), buf.size(), &off), CAPS_ERR_TOO_DEEP);
+  EXPECT_EQ(off, CAPS_PARSE_MAX_DEPTH * (HEADER_SIZE + 2));
+  EXPECT_TRUE(caps.empty());
+  EXPECT_THROW(caps.parse(buf.data(), buf.size()), domain_error);
+
+  buf = nestedBinary(CAPS_PARSE_MAX_DEPTH);
+  ASSERT_EQ(caps.tryParse(buf.data(), buf.size()), CAPS_SUCCESS);
+  const Caps* p = &caps;
+  uint32_t depth{1};
+  while (p->size() == 1) {
+    ASSERT_EQ(p->tryGet(0, p), CAPS_SUCCESS);
+    ++depth;
+  }
+  EXPECT_EQ(depth, CAPS_PARSE_MAX_DEPTH);
+  buf = nestedBinary(CAPS_PARSE_MAX_DEPTH + 1);
+  EXPECT_EQ(caps.tryParse(buf.data(), buf.size()), CAPS_ERR_TOO_DEEP);
+
+  caps.setParseMaxDepth(2000);
+  buf = nestedBinary(2000);
+  EXPECT_EQ(caps.tryParse(buf.data(), buf.size()), CAPS_SUCCESS);
+  caps.setParseMaxDepth(1);
+  buf = nestedBinary(1);
+  EXPECT_EQ(caps.tryParse(buf.data(), buf.size()), CAPS_SUCCESS);
+  buf = nestedBinary(2);
+  EXPECT_EQ(caps.tryParse(buf.data(), buf.size(), &off), CAPS_ERR_TOO_DEEP);
+  EXPECT_EQ(off, HEADER_SIZE + 2);
+
+  // 嵌套Caps中的错误位置为在顶层数据中的偏移
+  Caps inner;
+  inner.write(1);
+  inner.write("nested");
+  Caps outer;
+  outer.write(7);
+  outer.write(inner);
+  outer.write(8);
+  buf.resize(outer.binarySize());
+  outer.serialize(buf.data(), buf.size());
+  Caps parsed;
+  ASSERT_EQ(parsed.tryParse(buf.data(), buf.size()), CAPS_SUCCESS);
+  EXPECT_EQ(parsed, outer);
+  // header, 成员类型描述长度, 3个类型, 整数7之后为嵌套Caps
+  uint32_t innerOff = HEADER_SIZE + 1 + 3 + 1;
+  buf[innerOff + HEADER_SIZE + 1] = 'x';
+  EXPECT_EQ(parsed.tryParse(buf.data(), buf.size(), &off), CAPS_ERR_CORRUPTED);
+  EXPECT_EQ(off, innerOff + HEADER_SIZE + 1);
+  outer.serialize(buf.data(), buf.size());
+  buf[innerOff + 4] = CAPS_VERSION + 1;
+  EXPECT_EQ(parsed.tryParse(buf.data(), buf.size(), &off), CAPS_ERR_VERSION);
+  EXPECT_EQ(off, innerOff + 4);
+  outer.serialize(buf.data(), buf.size());
+  // 嵌套Caps长度超出外层数据
+  buf[innerOff + 3] += 100;
+  EXPECT_EQ(parsed.tryParse(buf.data(), buf.size(), &off), CAPS_ERR_CORRUPTED);
+  EXPECT_EQ(off, innerOff);
+}
+
+TEST(TestCaps, recycleMembers) {
+  auto build = [](int32_t i, const char* str) {
+    Caps inner;
+    inner.write(str);
+    inner.write((uint64_t)i * 3);
+    Caps caps;
+    caps.write(i);
+    caps.write(i * 0.5);
+    caps.write(str);
+    caps.write(str, strlen(str));
+    caps.write(inner);
+    caps.write();
+    return caps;
+  };
+  vector<vector<uint8_t> > frames;
+  int32_t i;
+  for (i = 0; i < 10; ++i) {
+    auto caps = build(i, i % 2 ? "a string longer than sso buffer"
+        : "short");
+    vector<uint8_t> buf(caps.binarySize());
+    caps.serialize(buf.data(), buf.size());
+    frames.push_back(move(buf));
+  }
+
+  // 复用时不分配内存由caps-alloc-tests检查
+  Caps caps;
+  caps.parse(frames[1].data(), frames[1].size());
+  for (i = 0; i < 10; ++i) {
+    caps.parse(frames[i].data(), frames[i].size());
+    EXPECT_EQ((int32_t)caps[0], i);
+    EXPECT_EQ((double)caps[1], i * 0.5);
+    EXPECT_EQ((uint64_t)((Caps)caps[4])[1], (uint64_t)i * 3);
+    EXPECT_TRUE(caps[5].isVoid());
+  }
+
+  // 被引用的成员不可复用
+  Caps copy = caps;
+  caps.parse(frames[0].data(), frames[0].size());
+  EXPECT_EQ((int32_t)caps[0], 0);
+  EXPECT_EQ((int32_t)copy[0], 9);
+  EXPECT_EQ((const string&)((Caps)copy[4])[0], "a string longer than sso buffer");
+  EXPECT_EQ((const string&)((Caps)caps[4])[0], "short");
+
+  // 结构不同
+  Caps other;
+  other.write("first");
+  other.write(1.0f);
+  vector<uint8_t> buf(other.binarySize());
+  other.serialize(buf.data(), buf.size());
+  caps.parse(buf.data(), buf.size());
+  EXPECT_EQ(caps.size(), 2);
+  EXPECT_EQ((const string&)caps[0], "first");
+  EXPECT_EQ((float)caps[1], 1.0f);
+}
+
+// 数据指针是否位于buf中
+static bool inBuffer(const void* p, const vector<uint8_t>& buf) {
+  auto b = reinterpret_cast<const uint8_t*>(p);
+  return b >= buf.data() && b < buf.data() + buf.size();
+}
+
+TEST(TestCaps, parseBorrowed) {
+  string blob(4096, 'x');
+  Caps inner;
+  inner.write("nested string");
+  inner.write(blob.data(), blob.size());
+  Caps src;
+  src.write(1);
+  src.write("a string longer than sso buffer");
+  src.write(blob.data(), blob.size());
+  src.write(inner);
+  auto buf = make_shared<vector<uint8_t> >(src.binarySize(CAPS_FLAG_CRC32C));
+  src.serialize(buf->data(), buf->size(), CAPS_FLAG_CRC32C);
+  weak_ptr<vector<uint8_t> > weak = buf;
+
+  Caps caps;
+  caps.parseBorrowed(buf->data(), buf->size(),
+      shared_ptr<const void>(buf, buf->data()));
+  EXPECT_EQ(caps, src);
+  EXPECT_EQ(caps.hash(), src.hash());
+  // 字符串/二进制数据直接引用输入数据
+  const char* str;
+  uint32_t len;
+  ASSERT_EQ(caps.tryGet(1, str, len), CAPS_SUCCESS);
+  EXPECT_EQ(string(str, len), "a string longer than sso buffer");
+  EXPECT_TRUE(inBuffer(str, *buf));
+  const void* data;
+  uint32_t size;
+  ASSERT_EQ(caps.tryGet(2, data, size), CAPS_SUCCESS);
+  EXPECT_EQ(size, blob.size());
+  EXPECT_TRUE(inBuffer(data, *buf));
+  const Caps* nested;
+  ASSERT_EQ(caps.tryGet(3, nested), CAPS_SUCCESS);
+  ASSERT_EQ(nested->tryGet(1, data, size), CAPS_SUCCESS);
+  EXPECT_TRUE(inBuffer(data, *buf));
+  EXPECT_EQ(caps.tryGet(2, str, len), CAPS_ERR_TYPE_MISMATCH);
+
+  // std::string接口首次访问时复制
+  auto& s = (const string&)caps[1];
+  EXPECT_EQ(s, "a string longer than sso buffer");
+  EXPECT_FALSE(inBuffer(s.data(), *buf));
+  EXPECT_EQ(&(const string&)caps[1], &s);
+  EXPECT_STREQ(caps.getOr(1, ""), "a string longer than sso buffer");
+
+  // 序列化结果与原数据相同
+  vector<uint8_t> out(caps.binarySize(CAPS_FLAG_CRC32C));
+  caps.serialize(out.data(), out.size(), CAPS_FLAG_CRC32C);
+  EXPECT_EQ(out, *buf);
+  string json;
+  caps.toJson(json);
+  string srcJson;
+  src.toJson(srcJson);
+  EXPECT_EQ(json, srcJson);
+
+  // 成员持有输入数据, 所有引用的成员释放后输入数据才被释放
+  buf.reset();
+  EXPECT_FALSE(weak.expired());
+  Caps copy = caps;
+  Caps sub = (Caps)caps[3];
+  caps.clear();
+  copy.clear();
+  EXPECT_FALSE(weak.expired());
+  EXPECT_EQ((const string&)sub[0], "nested string");
+  sub.clear();
+  EXPECT_TRUE(weak.expired());
+
+  // 复用借用的成员时释放输入数据
+  buf = make_shared<vector<uint8_t> >(out);
+  weak = buf;
+  caps.parseBorrowed(buf->data(), buf->size(),
+      shared_ptr<const void>(buf, buf->data()));
+  buf.reset();
+  caps.parse(out.data(), out.size());
+  EXPECT_TRUE(weak.expired());
+  ASSERT_EQ(caps.tryGet(1, str, len), CAPS_SUCCESS);
+  EXPECT_FALSE(inBuffer(str, out));
+  EXPECT_EQ(caps, src);
+
+  EXPECT_THROW(caps.parseBorrowed(out.data(), out.size(), nullptr),
+      invalid_argument);
+  EXPECT_EQ(caps.tryParseBorrowed(out.data(), out.size(), nullptr),
+      CAPS_ERR_INVALID_PARAM);
+  uint32_t off;
+  auto owner = make_shared<vector<uint8_t> >(out);
+  (*owner)[HEADER_SIZE + 3] = 'X';
+  EXPECT_EQ(caps.tryParseBorrowed(owner->data(), owner->size(), owner, &off),
+      CAPS_ERR_CHECKSUM);
+  EXPECT_TRUE(caps.empty());
+}
+
+TEST(TestCaps, parseBorrowedBenchmark) {
+  Caps msg;
+  msg.write(1);
+  msg.write(vector<char>(256 * 1024, 'x'));
+  msg.write(string(256 * 1024, 'y'));
+  auto buf = make_shared<vector<uint8_t> >(msg.binarySize());
+  msg.serialize(buf->data(), buf->size());
+  shared_ptr<const void> owner(buf, buf->data());
+  Caps caps;
+  uint32_t i;
+  for (auto borrowed : { false, true }) {
+    auto tp = steady_clock::now();
+    for (i = 0; i < 2000; ++i) {
+      if (borrowed)
+        caps.parseBorrowed(buf->data(), buf->size(), owner);
+      else
+        caps.parse(buf->data(), buf->size());
+    }
+    auto us = duration_cast<microseconds>(steady_clock::now() - tp).count();
+    printf("%s: %" PRId64 "us\n", borrowed ? "borrowed" : "copied",
+        (int64_t)us);
+  }
+  EXPECT_EQ(caps, msg);
+}
+
+TEST(TestCaps, crc32c) {
+  Caps inner;
+  inner.write("nested");
+  Caps caps;
+  caps.write(100);
+  caps.write("hello");
+  caps.write(1.5);
+  caps.write(inner);
+  auto size = caps.binarySize(CAPS_FLAG_CRC32C);
+  EXPECT_EQ(size, caps.binarySize() + 4);
+  vector<uint8_t> buf(size);
+  EXPECT_EQ(caps.serialize(buf.data(), size, CAPS_FLAG_CRC32C), size);
+  EXPECT_EQ(buf[4], CAPS_VERSION | CAPS_FLAG_CRC32C);
+  EXPECT_EQ(Caps::getBinarySize(buf.data(), size), size);
+  uint32_t r;
+  EXPECT_EQ(caps.trySerialize(buf.data(), size - 1, r, CAPS_FLAG_CRC32C),
+      CAPS_ERR_INSUFFICIENT_BUFFER);
+  EXPECT_EQ(caps.trySerialize(buf.data(), size, r, 0x1), CAPS_ERR_INVALID_PARAM);
+  EXPECT_THROW(caps.serialize(buf.data(), size, 0x1), invalid_argument);
+  EXPECT_EQ(caps.trySerialize(buf.data(), size, r, CAPS_FLAG_CRC32C),
+      CAPS_SUCCESS);
+
+  Caps parsed;
+  parsed.parse(buf.data(), size);
+  EXPECT_EQ((int32_t)parsed[0], 100);
+  EXPECT_EQ((const string&)parsed[1], "hello");
+  EXPECT_EQ((double)parsed[2], 1.5);
+  EXPECT_EQ((const string&)((Caps)parsed[3])[0], "nested");
+
+  // 任意单字节损坏都被检出
+  uint32_t i;
+  for (i = HEADER_SIZE; i < size; ++i) {
+    auto bad = buf;
+    bad[i] ^= 0x10;
+    EXPECT_NE(parsed.tryParse(bad.data(), size), CAPS_SUCCESS);
+  }
+  auto bad = buf;
+  bad[10] ^= 1;
+  uint32_t off;
+  EXPECT_EQ(parsed.tryParse(bad.data(), size, &off), CAPS_ERR_CHECKSUM);
+  EXPECT_EQ(off, size - 4);
+  EXPECT_THROW(parsed.parse(bad.data(), size), domain_error);
+  // 未知flag
+  bad = buf;
+  bad[4] |= 0x20;
+  EXPECT_EQ(parsed.tryParse(bad.data(), size), CAPS_ERR_VERSION);
+}
+
+TEST(TestCaps, fixedInt) {
+  Caps inner;
+  inner.write((int64_t)INT64_MIN);
+  inner.write("nested");
+  Caps caps;
+  caps.write((int32_t)-1);
+  caps.write((uint32_t)UINT32_MAX);
+  caps.write((int64_t)INT64_MAX);
+  caps.write((uint64_t)1);
+  caps.write(2.5f);
+  caps.write("hello");
+  caps.write("bin", 3);
+  caps.write(inner);
+  caps.write();
+
+  uint32_t flags[] = { CAPS_FLAG_FIXED_INT,
+    CAPS_FLAG_FIXED_INT | CAPS_FLAG_CRC32C };
+  for (auto f : flags) {
+    auto size = caps.binarySize(f);
+    vector<uint8_t> buf(size);
+    EXPECT_EQ(caps.serialize(buf.data(), size, f), size);
+    EXPECT_EQ(buf[4], CAPS_VERSION | f);
+    Caps parsed;
+    parsed.parse(buf.data(), size);
+    EXPECT_EQ((int32_t)parsed[0], -1);
+    EXPECT_EQ((uint32_t)parsed[1], UINT32_MAX);
+    EXPECT_EQ((int64_t)parsed[2], INT64_MAX);
+    EXPECT_EQ((uint64_t)parsed[3], 1);
+    EXPECT_EQ((float)parsed[4], 2.5f);
+    EXPECT_EQ((const string&)parsed[5], "hello");
+    vector<char> bin;
+    parsed[6].get(bin);
+    EXPECT_EQ(bin.size(), 3);
+    Caps sub = parsed[7];
+    EXPECT_EQ((int64_t)sub[0], INT64_MIN);
+    EXPECT_EQ((const string&)sub[1], "nested");
+    EXPECT_TRUE(parsed[8].isVoid());
+    // 截断数据
+    uint32_t i;
+    for (i = HEADER_SIZE + 1; i < size; ++i) {
+      buf[0] = i >> 24;
+      buf[1] = i >> 16;
+      buf[2] = i >> 8;
+      buf[3] = i;
+      EXPECT_NE(parsed.tryParse(buf.data(), i), CAPS_SUCCESS);
+    }
+  }
+  // 数据长度: 头5 + 成员数1 + 类型9 + 4 + 4 + 8 + 8 + 4 + (4 + 5) + (4 + 3)
+  // + 嵌套(5 + 1 + 2 + 8 + 4 + 6)
+  EXPECT_EQ(caps.binarySize(CAPS_FLAG_FIXED_INT), 15 + 24 + 4 + 9 + 7 + 26);
+}
+
+TEST(TestCaps, fixedIntBenchmark) {
+  Caps caps;
+  uint32_t i;
+  for (i = 0; i < 64; ++i) {
+    caps.write((int32_t)(i * 123457));
+    caps.write((uint64_t)(i * 0x123456789ULL));
+  }
+  uint32_t modes[] = { 0, CAPS_FLAG_FIXED_INT };
+  for (auto f : modes) {
+    auto size = caps.binarySize(f);
+    vector<uint8_t> buf(size);
+    Caps parsed;
+    auto tp = steady_clock::now();
+    for (i = 0; i < 100000; ++i)
+      caps.serialize(buf.data(), size, f);
+    auto ser = duration_cast<microseconds>(steady_clock::now() - tp).count();
+    tp = steady_clock::now();
+    for (i = 0; i < 100000; ++i)
+      parsed.parse(buf.data(), size);
+    auto par = duration_cast<microseconds>(steady_clock::now() - tp).count();
+    printf("%s: %u bytes, serialize %" PRId64 "us, parse %" PRId64 "us\n",
+        f ? "fixed" : "leb128", size, (int64_t)ser, (int64_t)par);
+  }
+}
+
+TEST(TestCaps, projection) {
+  Caps leaf;
+  leaf.write(10);
+  leaf.write("leaf");
+  leaf.write(12.5);
+  Caps mid;
+  mid.write(leaf);
+  mid.write("mid");
+  Caps caps;
+  caps.write(0);
+  caps.write("skipped string");
+  caps.write((uint64_t)2);
+  caps.write(mid);
+  caps.write("skipped bin", 11);
+  caps.write(5.0f);
+  caps.write();
+  caps.write("tail");
+
+  uint32_t modes[] = { 0, CAPS_FLAG_FIXED_INT, CAPS_FLAG_CRC32C };
+  for (auto f : modes) {
+    auto size = caps.binarySize(f);
+    vector<uint8_t> buf(size);
+    caps.serialize(buf.data(), size, f);
+
+    Caps parsed;
+    parsed.parse(buf.data(), size, Caps::Projection{ "2", "3.0.1", "5" });
+    ASSERT_EQ(parsed.size(), caps.size());
+    EXPECT_TRUE(parsed[0].isAbsent());
+    EXPECT_TRUE(parsed[1].isAbsent());
+    EXPECT_EQ((uint64_t)parsed[2], 2);
+    EXPECT_TRUE(parsed[4].isAbsent());
+    EXPECT_EQ((float)parsed[5], 5.0f);
+    EXPECT_TRUE(parsed[6].isAbsent());
+    EXPECT_TRUE(parsed[7].isAbsent());
+    EXPECT_THROW((int32_t)parsed[0], Caps::type_error);
+    Caps m = parsed[3];
+    ASSERT_EQ(m.size(), 2);
+    EXPECT_TRUE(m[1].isAbsent());
+    Caps l = m[0];
+    ASSERT_EQ(l.size(), 3);
+    EXPECT_TRUE(l[0].isAbsent());
+    EXPECT_EQ((const string&)l[1], "leaf");
+    EXPECT_TRUE(l[2].isAbsent());
+
+    // 完整选择覆盖路径选择
+    Caps::Projection proj;
+    proj.add("3.1").add(3).add("3.0");
+    parsed.parse(buf.data(), size, proj);
+    m = parsed[3];
+    EXPECT_EQ((const string&)m[1], "mid");
+    EXPECT_EQ((double)((Caps)m[0])[2], 12.5);
+
+    // 未选择任何成员
+    EXPECT_EQ(parsed.tryParse(buf.data(), size, Caps::Projection()),
+        CAPS_SUCCESS);
+    EXPECT_EQ(parsed.size(), caps.size());
+    EXPECT_TRUE(parsed[3].isAbsent());
+    // 被选择成员之前的数据损坏
+    buf[HEADER_SIZE + 2] = 'x';
+    if (f & CAPS_FLAG_CRC32C)
+      continue;
+    uint32_t off;
+    EXPECT_EQ(parsed.tryParse(buf.data(), size, Caps::Projection{ "5" }, &off),
+        CAPS_ERR_CORRUPTED);
+    EXPECT_EQ(off, HEADER_SIZE + 2);
+  }
+
+  Caps::Projection proj;
+  EXPECT_THROW(proj.add("1."), invalid_argument);
+  EXPECT_THROW(proj.add(".1"), invalid_argument);
+  EXPECT_THROW(proj.add("1a"), invalid_argument);
+  EXPECT_THROW(proj.add(""), invalid_argument);
+  // 下标上限
+  EXPECT_THROW(proj.add(UINT32_MAX), invalid_argument);
+  EXPECT_THROW(proj.add(CAPS_PROJECTION_MAX_INDEX + 1), invalid_argument);
+  EXPECT_THROW(proj.add("4294967295"), invalid_argument);
+  EXPECT_THROW(proj.add("65536.0"), invalid_argument);
+  proj.add(CAPS_PROJECTION_MAX_INDEX);
+
+  // absent成员不可序列化, dump/json可输出
+  Caps parsed;
+  vector<uint8_t> buf(caps.binarySize());
+  caps.serialize(buf.data(), buf.size());
+  parsed.parse(buf.data(), buf.size(), Caps::Projection{ "0" });
+  uint32_t r;
+  EXPECT_EQ(parsed.trySerialize(buf.data(), buf.size(), r), CAPS_ERR_CORRUPTED);
+  string json;
+  parsed.toJson(json);
+  EXPECT_EQ(json, "[0,null,null,null,null,null,null,null]");
+  auto frozen = parsed.freeze();
+  EXPECT_TRUE(frozen[1].isAbsent());
+}
+
+TEST(TestCaps, patch) {
+  Caps caps;
+  caps.write("header");
+  caps.write((int32_t)3);
+  caps.write((uint64_t)1000000);
+  caps.write((int64_t)-200);
+  caps.write((uint32_t)0);
+  caps.write(1.0f);
+  caps.write(2.0);
+  caps.write("tail");
+
+  uint32_t modes[] = { 0, CAPS_FLAG_CRC32C, CAPS_FLAG_FIXED_INT,
+    CAPS_FLAG_FIXED_INT | CAPS_FLAG_CRC32C };
+  for (auto f : modes) {
+    auto size = caps.binarySize(f);
+    vector<uint8_t> buf(size);
+    caps.serialize(buf.data(), size, f);
+    bool fixed = f & CAPS_FLAG_FIXED_INT;
+
+    EXPECT_EQ(Caps::tryPatch(buf.data(), size, 1, (int32_t)-5), CAPS_SUCCESS);
+    // 编码长度变短, 填充
+    EXPECT_EQ(Caps::tryPatch(buf.data(), size, 2, (uint64_t)7), CAPS_SUCCESS);
+    EXPECT_EQ(Caps::tryPatch(buf.data(), size, 3, (int64_t)-1), CAPS_SUCCESS);
+    EXPECT_EQ(Caps::tryPatch(buf.data(), size, 5, 3.5f), CAPS_SUCCESS);
+    EXPECT_EQ(Caps::tryPatch(buf.data(), size, 6, -4.25), CAPS_SUCCESS);
+    // 编码长度变长
+    EXPECT_EQ(Caps::tryPatch(buf.data(), size, 4, (uint32_t)300),
+        fixed ? CAPS_SUCCESS : CAPS_ERR_INSUFFICIENT_BUFFER);
+    EXPECT_EQ(Caps::tryPatch(buf.data(), size, 1, (int32_t)1000),
+        fixed ? CAPS_SUCCESS : CAPS_ERR_INSUFFICIENT_BUFFER);
+    EXPECT_EQ(Caps::tryPatch(buf.data(), size, 1, (int32_t)1), CAPS_SUCCESS);
+    EXPECT_EQ(Caps::tryPatch(buf.data(), size, 1, (uint32_t)1),
+        CAPS_ERR_TYPE_MISMATCH);
+    EXPECT_EQ(Caps::tryPatch(buf.data(), size, 8, (int32_t)1),
+        CAPS_ERR_OUT_OF_RANGE);
+    EXPECT_EQ(Caps::tryPatch(buf.data(), size - 1, 1, (int32_t)1),
+        CAPS_ERR_INVALID_PARAM);
+
+    Caps parsed;
+    ASSERT_EQ(parsed.tryParse(buf.data(), size), CAPS_SUCCESS);
+    EXPECT_EQ((const string&)parsed[0], "header");
+    EXPECT_EQ((int32_t)parsed[1], 1);
+    EXPECT_EQ((uint64_t)parsed[2], 7);
+    EXPECT_EQ((int64_t)parsed[3], -1);
+    EXPECT_EQ((uint32_t)parsed[4], fixed ? 300 : 0);
+    EXPECT_EQ((float)parsed[5], 3.5f);
+    EXPECT_EQ((double)parsed[6], -4.25);
+    EXPECT_EQ((const string&)parsed[7], "tail");
+
+    if (f & CAPS_FLAG_CRC32C) {
+      // 已损坏的数据, 修改后仍校验失败
+      buf[size - 6] ^= 1;
+      EXPECT_EQ(Caps::tryPatch(buf.data(), size, 5, 1.0f), CAPS_SUCCESS);
+      EXPECT_EQ(parsed.tryParse(buf.data(), size), CAPS_ERR_CHECKSUM);
+    }
+  }
+}
+
+TEST(TestCaps, patchLeb128Padding) {
+  uint8_t buf[16];
+  int64_t values[] = { 0, 1, -1, 63, 64, -64, -65, INT32_MAX, INT32_MIN };
+  for (auto v : values) {
+    uint32_t len;
+    for (len = leb128Size(v); len <= LEB128_MAX_INT64_BYTES; ++len) {
+      ASSERT_TRUE(leb128WritePadded(v, buf, len));
+      int64_t r;
+      EXPECT_EQ(leb128TryRead(buf, sizeof(buf), r), len);
+      EXPECT_EQ(r, v);
+      if (len <= LEB128_MAX_INT32_BYTES && v >= INT32_MIN && v <= INT32_MAX) {
+        int32_t r32;
+        ASSERT_TRUE(leb128WritePadded((int32_t)v, buf, len));
+        EXPECT_EQ(leb128TryRead(buf, sizeof(buf), r32), len);
+        EXPECT_EQ(r32, v);
+      }
+    }
+    EXPECT_FALSE(leb128WritePadded(v, buf, leb128Size(v) - 1));
+  }
+  uint64_t u;
+  for (u = 1; u < UINT64_MAX / 3; u *= 3) {
+    uint32_t len = uleb128Size(u);
+    ASSERT_TRUE(uleb128WritePadded(u, buf, LEB128_MAX_INT64_BYTES));
+    uint64_t r;
+    EXPECT_EQ(uleb128TryRead(buf, sizeof(buf), r), LEB128_MAX_INT64_BYTES);
+    EXPECT_EQ(r, u);
+    EXPECT_FALSE(uleb128WritePadded(u, buf, len - 1));
+  }
+}
+
+static void expectSameBinary(const Caps& a, const Caps& b, uint32_t flags) {
+  auto size = a.binarySize(flags);
+  EXPECT_EQ(size, b.binarySize(flags));
+  vector<uint8_t> ba(size);
+  vector<uint8_t> bb(size);
+  EXPECT_EQ(a.serialize(ba.data(), size, flags), size);
+  EXPECT_EQ(b.serialize(bb.data(), size, flags), size);
+  EXPECT_EQ(ba, bb);
+}
+
+TEST(TestCaps, serializeCache) {
+  Caps config;
+  uint32_t i;
+  for (i = 0; i < 32; ++i) {
+    config.write((int32_t)i);
+    config.write("config value");
+  }
+  Caps plain = config;
+  config.setSerializeCache(4096);
+  Caps msg;
+  msg.write(1);
+  msg.write(config);
+  Caps plainMsg;
+  plainMsg.write(1);
+  plainMsg.write(plain);
+
+  uint32_t modes[] = { 0, CAPS_FLAG_FIXED_INT, CAPS_FLAG_CRC32C,
+    CAPS_FLAG_CRC32C | CAPS_FLAG_FIXED_INT };
+  for (auto f : modes) {
+    // 第一次序列化生成缓存, 之后使用缓存
+    expectSameBinary(config, plain, f);
+    expectSameBinary(config, plain, f);
+    expectSameBinary(msg, plainMsg, f);
+    expectSameBinary(msg, plainMsg, f);
+  }
+
+  // 命中缓存时不分配内存由caps-alloc-tests检查
+
+  // 修改后缓存失效
+  config.write("changed");
+  plain.write("changed");
+  expectSameBinary(config, plain, 0);
+  config.clear();
+  plain.clear();
+  expectSameBinary(config, plain, 0);
+  vector<uint8_t> other(plainMsg.binarySize());
+  plainMsg.serialize(other.data(), other.size());
+  config.parse(other.data(), other.size());
+  expectSameBinary(config, plainMsg, 0);
+  config = msg;
+  expectSameBinary(config, plainMsg, 0);
+
+  // 超过maxSize不缓存
+  Caps big = plain;
+  big.setSerializeCache(8);
+  vector<uint8_t> buf(big.binarySize());
+  big.serialize(buf.data(), buf.size());
+  expectSameBinary(big, plain, 0);
+}
+
+TEST(TestCaps, serializeCacheBenchmark) {
+  Caps config;
+  uint32_t i;
+  for (i = 0; i < 256; ++i) {
+    config.write((int32_t)i);
+    config.write("some configuration value");
+  }
+  Caps cached = config;
+  cached.setSerializeCache(64 * 1024);
+  const Caps* blobs[] = { &config, &cached };
+  for (auto blob : blobs) {
+    vector<uint8_t> buf;
+    auto tp = steady_clock::now();
+    for (i = 0; i < 10000; ++i) {
+      Caps msg;
+      msg.write(i);
+      msg.write(*blob);
+      buf.resize(msg.binarySize());
+      msg.serialize(buf.data(), buf.size());
+    }
+    auto us = duration_cast<microseconds>(steady_clock::now() - tp).count();
+    printf("%s: %" PRId64 "us\n", blob == &cached ? "cached" : "uncached",
+        (int64_t)us);
+  }
+}
@@ -0,0 +1,85 @@
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "caps.h"
+#include "capsstats.h"
+
+using namespace std;
+using namespace rokid;
+
+static uint32_t serializeAndParse() {
+  Caps inner;
+  inner << 1;
+  inner << "hello";
+  Caps caps;
+  caps << (int32_t)1;
+  caps << (uint64_t)2;
+  caps << 3.0;
+  caps << "foo";
+  caps << inner;
+  auto size = caps.binarySize();
+  vector<uint8_t> buf(size);
+  caps.serialize(buf.data(), size);
+  Caps parsed;
+  parsed.parse(buf.data(), size);
+  EXPECT_NE(parsed.tryParse(buf.data(), size - 1), CAPS_SUCCESS);
+  return size;
+}
+
+TEST(CapsStats, counters) {
+  CapsStats::reset();
+  auto size = serializeAndParse();
+  auto stats = CapsStats::snapshot();
+  if (!CapsStats::enabled()) {
+    EXPECT_EQ(stats.serializeCalls, 0);
+    EXPECT_EQ(stats.parseCalls, 0);
+    EXPECT_EQ(stats.memberAllocs, 0);
+    EXPECT_EQ(stats.maxDepth, 0);
+    return;
+  }
+  EXPECT_EQ(stats.serializeCalls, 1);
+  EXPECT_EQ(stats.serializeBytes, size);
+  EXPECT_EQ(stats.parseCalls, 2);
+  EXPECT_EQ(stats.parseErrors, 1);
+  EXPECT_EQ(stats.parseBytes, size * 2 - 1);
+  // serialize一次, parse成功一次
+  EXPECT_EQ(stats.nestedObjects, 2);
+  EXPECT_EQ(stats.maxDepth, 1);
+  // 写入7个成员, 成功parse出7个, 失败的parse不确定
+  EXPECT_GE(stats.memberAllocs, 14);
+  EXPECT_GE(stats.memberAllocsOf(CAPS_MEMBER_TYPE_INT32), 4);
+  EXPECT_GE(stats.memberAllocsOf(CAPS_MEMBER_TYPE_OBJECT), 2);
+  EXPECT_EQ(stats.memberAllocsOf(CAPS_MEMBER_TYPE_FLOAT), 0);
+
+  CapsStats::reset();
+  stats = CapsStats::snapshot();
+  EXPECT_EQ(stats.serializeCalls, 0);
+  EXPECT_EQ(stats.parseCalls, 0);
+  EXPECT_EQ(stats.memberAllocs, 0);
+  EXPECT_EQ(stats.maxDepth, 0);
+}
+
+TEST(CapsStats, threads) {
+  if (!CapsStats::enabled())
+    return;
+  CapsStats::reset();
+  vector<thread> threads;
+  uint32_t i;
+  for (i = 0; i < 4; ++i) {
+    threads.emplace_back([]() {
+      uint32_t j;
+      for (j = 0; j < 100; ++j)
+        serializeAndParse();
+    });
+  }
+  // 已退出和运行中的线程都应计入
+  threads[0].join();
+  auto stats = CapsStats::snapshot();
+  EXPECT_GE(stats.serializeCalls, 100);
+  for (i = 1; i < threads.size(); ++i)
+    threads[i].join();
+  stats = CapsStats::snapshot();
+  EXPECT_EQ(stats.serializeCalls, 400);
+  EXPECT_EQ(stats.parseCalls, 800);
+  EXPECT_EQ(stats.parseErrors, 400);
+}
@@ -0,0 +1,494 @@
+// caps-inspect: 分析由连续的Caps序列化数据组成的文件(如抓取的线上流量)
+// 以getBinarySize分帧，报告消息数量与长度分布，各类型成员数量与字节数，
+// 嵌套层数，LEB128编码长度分布，多条消息间重复的字符串，
+// 解析耗时，以及使用其它编码方式的估计收益
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "caps.h"
+#include "capsvisitor.h"
+
+// 统计重复的字符串长度范围
+#define INSPECT_MIN_STRING 4
+#define INSPECT_MAX_STRING 1024
+// 字符串表最多条目数, 超过后不再加入新字符串
+#define INSPECT_MAX_STRINGS (1024 * 1024)
+#define INSPECT_SIZE_BUCKETS 32
+#define INSPECT_MAX_DEPTH 16
+// caps header长度与CRC32C校验长度
+#define INSPECT_HEADER_SIZE 5
+#define INSPECT_CRC_SIZE 4
+
+using namespace std;
+using namespace std::chrono;
+using namespace rokid;
+
+static const char memberTypes[] = {
+  CAPS_MEMBER_TYPE_INT32, CAPS_MEMBER_TYPE_UINT32, CAPS_MEMBER_TYPE_INT64,
+  CAPS_MEMBER_TYPE_UINT64, CAPS_MEMBER_TYPE_FLOAT, CAPS_MEMBER_TYPE_DOUBLE,
+  CAPS_MEMBER_TYPE_STRING, CAPS_MEMBER_TYPE_BINARY, CAPS_MEMBER_TYPE_OBJECT,
+  CAPS_MEMBER_TYPE_VOID
+};
+
+static const char* typeName(char type) {
+  switch (type) {
+  case CAPS_MEMBER_TYPE_INT32:
+    return "int32";
+  case CAPS_MEMBER_TYPE_UINT32:
+    return "uint32";
+  case CAPS_MEMBER_TYPE_INT64:
+    return "int64";
+  case CAPS_MEMBER_TYPE_UINT64:
+    return "uint64";
+  case CAPS_MEMBER_TYPE_FLOAT:
+    return "float";
+  case CAPS_MEMBER_TYPE_DOUBLE:
+    return "double";
+  case CAPS_MEMBER_TYPE_STRING:
+    return "string";
+  case CAPS_MEMBER_TYPE_BINARY:
+    return "binary";
+  case CAPS_MEMBER_TYPE_OBJECT:
+    return "object";
+  default:
+    return "void";
+  }
+}
+
+struct TypeStat {
+  uint64_t count{0};
+  // 成员数据字节数, object不含嵌套Caps的header与类型描述
+  uint64_t bytes{0};
+};
+
+struct StringStat {
+  // 包含此字符串的消息数
+  uint32_t messages{0};
+  uint32_t lastMessage{UINT32_MAX};
+  uint64_t occurrences{0};
+};
+
+struct Stats {
+  uint64_t messages{0};
+  uint64_t corrupted{0};
+  // 所有消息字节数, 不含无法分帧的数据
+  uint64_t bytes{0};
+  uint64_t trailing{0};
+  uint64_t minSize{UINT64_MAX};
+  uint64_t maxSize{0};
+  // 下标k: 长度在[2^k, 2^(k+1))
+  uint64_t sizeBuckets[INSPECT_SIZE_BUCKETS]{};
+  uint64_t crcMessages{0};
+  uint64_t fixedMessages{0};
+  TypeStat types[128];
+  // 下标为最大嵌套层数, 顶层为1
+  uint64_t depthBuckets[INSPECT_MAX_DEPTH + 1]{};
+  uint32_t maxDepth{0};
+  // 变长编码的整数与长度前缀, 下标为LEB128编码字节数
+  uint64_t lebWidths[LEB128_MAX_INT64_BYTES + 1]{};
+  // 整数与长度前缀按LEB128编码与定长编码的字节数
+  uint64_t varintBytes{0};
+  uint64_t fixedIntBytes{0};
+  unordered_map<string, StringStat> strings;
+  bool stringsFull{false};
+  // 顶层成员类型描述 -> 消息数
+  unordered_map<string, uint64_t> shapes;
+  uint64_t visitNanos{0};
+  uint64_t parseNanos{0};
+};
+
+class InspectVisitor : public CapsVisitor {
+public:
+  InspectVisitor(Stats& s, uint32_t m, bool f) : stats(s), message{m}, fixed{f} {
+  }
+
+  void onInt32(int32_t v) {
+    integer(CAPS_MEMBER_TYPE_INT32, leb128Size(v), sizeof(v));
+  }
+
+  void onUint32(uint32_t v) {
+    integer(CAPS_MEMBER_TYPE_UINT32, uleb128Size(v), sizeof(v));
+  }
+
+  void onInt64(int64_t v) {
+    integer(CAPS_MEMBER_TYPE_INT64, leb128Size(v), sizeof(v));
+  }
+
+  void onUint64(uint64_t v) {
+    integer(CAPS_MEMBER_TYPE_UINT64, uleb128Size(v), sizeof(v));
+  }
+
+  void onFloat(float) {
+    add(CAPS_MEMBER_TYPE_FLOAT, sizeof(float));
+  }
+
+  void onDouble(double) {
+    add(CAPS_MEMBER_TYPE_DOUBLE, sizeof(double));
+  }
+
+  void onString(const char* data, uint32_t size) {
+    blob(CAPS_MEMBER_TYPE_STRING, size);
+    if (size < INSPECT_MIN_STRING || size > INSPECT_MAX_STRING)
+      return;
+    string key(data, size);
+    auto it = stats.strings.find(key);
+    if (it == stats.strings.end()) {
+      if (stats.strings.size() >= INSPECT_MAX_STRINGS) {
+        stats.stringsFull = true;
+        return;
+      }
+      it = stats.strings.emplace(move(key), StringStat()).first;
+    }
+    ++it->second.occurrences;
+    if (it->second.lastMessage != message) {
+      it->second.lastMessage = message;
+      ++it->second.messages;
+    }
+  }
+
+  void onBinary(const void*, uint32_t size) {
+    blob(CAPS_MEMBER_TYPE_BINARY, size);
+  }
+
+  void onVoid() {
+    add(CAPS_MEMBER_TYPE_VOID, 0);
+  }
+
+  void onBeginObject(uint32_t) {
+    // 顶层Caps不计入object成员
+    if (depth > 0)
+      add(CAPS_MEMBER_TYPE_OBJECT, 0);
+    ++depth;
+    maxDepth = max(maxDepth, depth);
+  }
+
+  void onEndObject() {
+    --depth;
+  }
+
+  inline uint32_t objectDepth() const { return maxDepth; }
+
+private:
+  void add(char type, uint32_t size) {
+    auto& t = stats.types[(uint8_t)type];
+    ++t.count;
+    t.bytes += size;
+  }
+
+  // 定长格式中按值计算LEB128编码长度, 变长格式中按最短编码计算
+  void integer(char type, uint32_t lebSize, uint32_t fixedSize) {
+    ++stats.lebWidths[lebSize];
+    stats.varintBytes += lebSize;
+    stats.fixedIntBytes += fixedSize;
+    add(type, fixed ? fixedSize : lebSize);
+  }
+
+  void blob(char type, uint32_t size) {
+    auto prefix = uleb128Size(size);
+    ++stats.lebWidths[prefix];
+    stats.varintBytes += prefix;
+    stats.fixedIntBytes += sizeof(uint32_t);
+    add(type, (fixed ? sizeof(uint32_t) : prefix) + size);
+  }
+
+private:
+  Stats& stats;
+  uint32_t message;
+  bool fixed;
+  uint32_t depth{0};
+  uint32_t maxDepth{0};
+};
+
+static uint32_t log2Bucket(uint64_t v) {
+  uint32_t r{0};
+  while (v > 1 && r + 1 < INSPECT_SIZE_BUCKETS) {
+    v >>= 1;
+    ++r;
+  }
+  return r;
+}
+
+static void inspectFrame(Stats& stats, const uint8_t* in, uint32_t size) {
+  auto message = (uint32_t)stats.messages++;
+  stats.bytes += size;
+  stats.minSize = min(stats.minSize, (uint64_t)size);
+  stats.maxSize = max(stats.maxSize, (uint64_t)size);
+  ++stats.sizeBuckets[log2Bucket(size)];
+  bool fixed{false};
+  bool crc{false};
+  if (size > INSPECT_HEADER_SIZE) {
+    fixed = in[4] & CAPS_FLAG_FIXED_INT;
+    crc = in[4] & CAPS_FLAG_CRC32C;
+  }
+
+  // 先以不做任何处理的遍历校验并计时, InspectVisitor直接修改stats,
+  // 只用于完整有效的消息, 避免损坏消息的部分成员计入统计
+  CapsVisitor noop;
+  auto tp = steady_clock::now();
+  auto r = CapsVisitor::visit(in, size, noop);
+  auto visitNanos = duration_cast<nanoseconds>(steady_clock::now() - tp).count();
+  if (r != CAPS_SUCCESS) {
+    ++stats.corrupted;
+    return;
+  }
+  stats.visitNanos += visitNanos;
+  InspectVisitor visitor(stats, message, fixed);
+  CapsVisitor::visit(in, size, visitor);
+  // 耗时: 完整解析
+  Caps caps;
+  tp = steady_clock::now();
+  caps.tryParse(in, size);
+  stats.parseNanos += duration_cast<nanoseconds>(steady_clock::now() - tp).count();
+
+  if (fixed)
+    ++stats.fixedMessages;
+  if (crc)
+    ++stats.crcMessages;
+  auto depth = visitor.objectDepth();
+  ++stats.depthBuckets[min(depth, (uint32_t)INSPECT_MAX_DEPTH)];
+  stats.maxDepth = max(stats.maxDepth, depth);
+  // visit成功时header后的类型描述完整
+  uint32_t descLen;
+  auto c = uleb128TryRead(in + INSPECT_HEADER_SIZE, size - INSPECT_HEADER_SIZE,
+      descLen);
+  ++stats.shapes[string(reinterpret_cast<const char*>(in) + INSPECT_HEADER_SIZE + c,
+      descLen)];
+}
+
+static bool readFile(const char* path, vector<uint8_t>& out) {
+  auto fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if (fp == nullptr) {
+    fprintf(stderr, "caps-inspect: open %s failed: %s\n", path, strerror(errno));
+    return false;
+  }
+  uint8_t buf[64 * 1024];
+  size_t c;
+  while ((c = fread(buf, 1, sizeof(buf), fp)) > 0)
+    out.insert(out.end(), buf, buf + c);
+  auto failed = ferror(fp);
+  if (fp != stdin)
+    fclose(fp);
+  if (failed) {
+    fprintf(stderr, "caps-inspect: read %s failed\n", path);
+    return false;
+  }
+  return true;
+}
+
+static bool inspectFile(Stats& stats, const char* path) {
+  vector<uint8_t> data;
+  if (!readFile(path, data))
+    return false;
+  size_t off{0};
+  while (off < data.size()) {
+    auto left = data.size() - off;
+    if (left < sizeof(uint32_t))
+      break;
+    auto size = Caps::getBinarySize(data.data() + off, left);
+    // 长度错误时无法继续分帧
+    if (size <= INSPECT_HEADER_SIZE || size > left)
+      break;
+    inspectFrame(stats, data.data() + off, size);
+    off += size;
+  }
+  if (off < data.size()) {
+    fprintf(stderr, "caps-inspect: %s: cannot frame %zu bytes at offset %zu\n",
+        path, data.size() - off, off);
+    stats.trailing += data.size() - off;
+  }
+  return true;
+}
+
+static double percent(uint64_t v, uint64_t total) {
+  return total ? v * 100.0 / total : 0;
+}
+
+static string printable(const string& s) {
+  string r;
+  for (auto ch : s) {
+    if (r.length() >= 48) {
+      r += "...";
+      break;
+    }
+    if (isprint((unsigned char)ch)) {
+      r += ch;
+    } else {
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\x%02x", (unsigned char)ch);
+      r += esc;
+    }
+  }
+  return r;
+}
+
+static void report(Stats& stats, uint32_t top) {
+  printf("messages: %" PRIu64 " (%" PRIu64 " corrupted), %" PRIu64 " bytes",
+      stats.messages, stats.corrupted, stats.bytes);
+  if (stats.trailing)
+    printf(", %" PRIu64 " bytes unframed", stats.trailing);
+  printf("\n");
+  if (stats.messages == 0)
+    return;
+  printf("size: min %" PRIu64 ", max %" PRIu64 ", avg %.1f\n", stats.minSize,
+      stats.maxSize, (double)stats.bytes / stats.messages);
+  printf("flags: %" PRIu64 " crc32c, %" PRIu64 " fixed-int\n",
+      stats.crcMessages, stats.fixedMessages);
+
+  printf("\nsize histogram:\n");
+  uint32_t i;
+  for (i = 0; i < INSPECT_SIZE_BUCKETS; ++i) {
+    if (stats.sizeBuckets[i] == 0)
+      continue;
+    printf("  [%10" PRIu64 ", %10" PRIu64 ") %10" PRIu64 " %6.2f%%\n",
+        (uint64_t)1 << i, (uint64_t)1 << (i + 1), stats.sizeBuckets[i],
+        percent(stats.sizeBuckets[i], stats.messages));
+  }
+
+  printf("\nmembers:\n");
+  uint64_t valueBytes{0};
+  for (auto t : memberTypes) {
+    auto& s = stats.types[(uint8_t)t];
+    valueBytes += s.bytes;
+    if (s.count == 0)
+      continue;
+    printf("  %-8s %12" PRIu64 " %14" PRIu64 " bytes %6.2f%%\n", typeName(t),
+        s.count, s.bytes, percent(s.bytes, stats.bytes));
+  }
+  // 其余为header, 成员类型描述, CRC32C校验, 以及LEB128填充
+  auto structure = stats.bytes > valueBytes ? stats.bytes - valueBytes : 0;
+  printf("  %-8s %12s %14" PRIu64 " bytes %6.2f%%\n", "(struct)", "", structure,
+      percent(structure, stats.bytes));
+
+  printf("\nnesting depth (max %u):\n", stats.maxDepth);
+  for (i = 1; i <= INSPECT_MAX_DEPTH; ++i) {
+    if (stats.depthBuckets[i] == 0)
+      continue;
+    printf("  %s%2u %12" PRIu64 " %6.2f%%\n", i == INSPECT_MAX_DEPTH ? ">=" : "  ",
+        i, stats.depthBuckets[i], percent(stats.depthBuckets[i], stats.messages));
+  }
+
+  uint64_t lebCount{0};
+  for (i = 1; i <= LEB128_MAX_INT64_BYTES; ++i)
+    lebCount += stats.lebWidths[i];
+  printf("\nleb128 width (integers and length prefixes):\n");
+  for (i = 1; i <= LEB128_MAX_INT64_BYTES; ++i) {
+    if (stats.lebWidths[i] == 0)
+      continue;
+    printf("  %2u bytes %12" PRIu64 " %6.2f%%\n", i, stats.lebWidths[i],
+        percent(stats.lebWidths[i], lebCount));
+  }
+
+  // 出现在多条消息中的字符串, 按重复字节数排序
+  vector<pair<const string*, const StringStat*>> repeated;
+  for (auto& it : stats.strings) {
+    if (it.second.messages > 1)
+      repeated.emplace_back(&it.first, &it.second);
+  }
+  sort(repeated.begin(), repeated.end(), [](const pair<const string*, const StringStat*>& a,
+        const pair<const string*, const StringStat*>& b) {
+    return (a.second->occurrences - 1) * a.first->length()
+      > (b.second->occurrences - 1) * b.first->length();
+  });
+  printf("\nrepeated strings: %zu distinct strings in more than one message%s\n",
+      repeated.size(), stats.stringsFull ? " (string table full)" : "");
+  for (i = 0; i < repeated.size() && i < top; ++i) {
+    auto& r = repeated[i];
+    printf("  %10" PRIu64 "x %8u msgs %10" PRIu64 " bytes  \"%s\"\n",
+        r.second->occurrences, r.second->messages,
+        r.second->occurrences * r.first->length(), printable(*r.first).c_str());
+  }
+
+  // 负数表示增加的字节数
+  auto valid = stats.messages - stats.corrupted;
+  printf("\nestimated savings:\n");
+  int64_t intSaved = stats.varintBytes - stats.fixedIntBytes;
+  const char* intMode = "fixed-int instead of leb128";
+  if (valid && stats.fixedMessages == valid) {
+    intSaved = -intSaved;
+    intMode = "leb128 instead of fixed-int";
+  }
+  printf("  %s integers: %" PRId64 " bytes (%.2f%%)\n", intMode, intSaved,
+      stats.bytes ? intSaved * 100.0 / stats.bytes : 0);
+  printf("  dropping crc32c: %" PRIu64 " bytes\n",
+      stats.crcMessages * INSPECT_CRC_SIZE);
+  // 字符串字典: 重复出现的字符串以字典序号代替, 字典本身传输一次
+  int64_t dictSaved{0};
+  for (i = 0; i < repeated.size(); ++i) {
+    auto& r = repeated[i];
+    int64_t s = (int64_t)(r.second->occurrences - 1) * r.first->length()
+      - (int64_t)r.second->occurrences * uleb128Size(i);
+    if (s > 0)
+      dictSaved += s;
+  }
+  printf("  string dictionary: %" PRId64 " bytes (%.2f%%)\n", dictSaved,
+      percent(dictSaved, stats.bytes));
+  // CapsBatch: 成员类型相同的消息只保留一份header与类型描述(未计入列编码收益)
+  uint64_t batchSaved{0};
+  uint64_t batchRows{0};
+  for (auto& it : stats.shapes) {
+    if (it.second < 2)
+      continue;
+    uint32_t overhead = INSPECT_HEADER_SIZE + uleb128Size((uint32_t)it.first.length())
+      + it.first.length();
+    batchSaved += (it.second - 1) * overhead;
+    batchRows += it.second;
+  }
+  printf("  CapsBatch per-shape grouping: at least %" PRIu64 " bytes (%.2f%%),"
+      " %zu shapes, %.2f%% of messages share a shape\n", batchSaved,
+      percent(batchSaved, stats.bytes), stats.shapes.size(),
+      percent(batchRows, stats.messages));
+
+  printf("\ncpu:\n");
+  printf("  visit: %.1f ns/msg, %.1f MB/s\n",
+      valid ? (double)stats.visitNanos / valid : 0,
+      stats.visitNanos ? stats.bytes * 1000.0 / stats.visitNanos : 0);
+  printf("  parse: %.1f ns/msg, %.1f MB/s\n",
+      valid ? (double)stats.parseNanos / valid : 0,
+      stats.parseNanos ? stats.bytes * 1000.0 / stats.parseNanos : 0);
+}
+
+static void usage() {
+  fprintf(stderr,
+      "Usage: caps-inspect [--top=N] FILE...\n"
+      "  FILE      concatenated caps frames, '-' for stdin\n"
+      "  --top=N   number of repeated strings to list (default 20)\n");
+}
+
+int main(int argc, char** argv) {
+  uint32_t top{20};
+  vector<const char*> files;
+  int i;
+  for (i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--top=", 6) == 0) {
+      top = strtoul(argv[i] + 6, nullptr, 10);
+    } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+      usage();
+      return 0;
+    } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+      usage();
+      return 1;
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.empty()) {
+    usage();
+    return 1;
+  }
+  Stats stats;
+  int r{0};
+  for (auto f : files) {
+    if (!inspectFile(stats, f))
+      r = 1;
+  }
+  report(stats, top);
+  return r;
+}